@@ -3,8 +3,19 @@
 
 #include <stdint.h>
 
-/* FRAM notification register addresses (global) */
-#define FRAM_NOTIF_BOX_ADDR   0x00010UL   /* bit i: node i's box has new data */
+/* FRAM notification flags (global): one byte per destination box,
+ * non-zero = box i has new data. Senders set their destination's flag
+ * with a single blind write; the arbiter reads and clears the array in
+ * one burst each.
+ */
+#define FRAM_NOTIF_BOX_ADDR      0x00010UL   /* flag for box 0 */
+#define FRAM_NOTIF_MAX_NODES     32u         /* 0x00010..0x0002F */
+#define FRAM_NOTIF_FLAG_ADDR(i)  (FRAM_NOTIF_BOX_ADDR + (uint32_t)(i))
+
+/* Directed release: the node ID the holder hands the bus to (0 = none),
+ * right below the flags so that the arbiter reads both in one burst
+ */
+#define FRAM_HANDOFF_ADDR        0x0000FUL
 
 /* SPI / FRAM API
  *
@@ -13,14 +24,52 @@
  * fram_write_bytes:
  *    - WREN + WRITE command + streaming write
  *    - Uses DMA for larger transfers, polled for very small ones
+ * fram_writev    :
+ *    - scatter-gather write: fragments land back-to-back from addr
+ *    - one WREN and one CS-low window for the whole list
+ * fram_readv     : scatter-gather read, one CS-low window
+ * fram_write_async / fram_read_async:
+ *    - start a DMA transfer and return; DMA_ISR raises CS and runs the
+ *      completion callback (interrupt context)
+ *    - blocking calls, and spi_disable, wait for it first
+ * fram_wait      : sleep in LPM0 until the async transfer has completed
  * fram_read_status: RDSR
  * fram_read_id    : RDID
+ * fram_revoke     : the arbiter took the bus back (ISR-safe); the
+ *                   transaction in progress stops after its current
+ *                   piece of FRAM_REVOKE_PIECE bytes, later ones are
+ *                   dropped (reads return zeros) until spi_enable()
  * spi_deinit      : put SPI pins back to GPIO (to stop leakage)
  */
+
+/* One fragment of a scatter-gather transfer */
+typedef struct {
+    const uint8_t *src;
+    uint16_t       len;
+} fram_wfrag_t;
+
+typedef struct {
+    uint8_t  *dst;
+    uint16_t  len;
+} fram_rfrag_t;
+
 void fram_read_bytes(uint32_t addr, uint8_t *dst, uint32_t len);
 void fram_write_bytes(uint32_t addr, const uint8_t *src, uint32_t len);
+void fram_writev(uint32_t addr, const fram_wfrag_t *frags, uint8_t count);
+void fram_readv(uint32_t addr, const fram_rfrag_t *frags, uint8_t count);
+
+/* Completion callback for async transfers, runs in DMA_ISR */
+typedef void (*fram_done_cb_t)(void *ctx);
+
+void fram_write_async(uint32_t addr, const uint8_t *src, uint16_t len,
+                      fram_done_cb_t cb, void *ctx);
+void fram_read_async(uint32_t addr, uint8_t *dst, uint16_t len,
+                     fram_done_cb_t cb, void *ctx);
+uint8_t fram_busy(void);
+void fram_wait(void);
 uint8_t fram_read_status(void);
 void fram_read_id(uint8_t *id, uint8_t len);
+void fram_revoke(void);
 
 void spi_init(void);
 void spi_enable(uint8_t clk_div);
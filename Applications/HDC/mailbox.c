@@ -1,23 +1,136 @@
 #include <msp430.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "fram.h"
 #include "mailbox.h"
 #include "uart.h"
 
-/* Global notification byte in FRAM (bit i => node i has new messages) */
-#define FRAM_NOTIF_BYTE_ADDR   FRAM_NOTIF_BOX_ADDR
+/* ------------ Layout ------------ */
 
-/* ------------ Layout helpers ------------ */
+static const uint8_t mailbox_box_weights[] = MAILBOX_BOX_WEIGHTS;
+
+static mailbox_layout_t mailbox_layout;
+static uint8_t mailbox_layout_valid;
+
+static uint8_t mailbox_box_weight(uint8_t node_index)
+{
+    if (node_index < sizeof(mailbox_box_weights) &&
+        mailbox_box_weights[node_index] != 0u) {
+        return mailbox_box_weights[node_index];
+    }
+    return 1u;
+}
+
+/* Chip size from the RDID bytes (manufacturer, continuation code, product
+ * ID with log2 of the size in kB in its low 5 bits), 0 if not recognised.
+ */
+static uint16_t mailbox_fram_kb(void)
+{
+    uint8_t id[4];
+    uint8_t density;
+
+    fram_read_id(id, (uint8_t)sizeof(id));
+    if (id[0] == 0x00u || id[0] == 0xFFu || id[1] != 0x7Fu) {
+        return 0u;
+    }
+
+    density = (uint8_t)(id[2] & 0x1Fu);
+    if (density > 14u) {            /* beyond 3-byte addressing */
+        return 0u;
+    }
+    return (uint16_t)(1u << density);
+}
+
+/* Boxes back to back from MAILBOX_BOXES_BASE, each a weighted share of
+ * the chip (rounded down to MAILBOX_BOX_ALIGN, capped at
+ * MAILBOX_BOX_SIZE_MAX), then the multicast buffers.
+ */
+static void mailbox_plan_layout(mailbox_layout_t *l, uint16_t fram_kb)
+{
+    uint32_t avail;
+    uint32_t share;
+    uint32_t base;
+    uint32_t size;
+    uint16_t weight_sum;
+    uint8_t i;
+
+    if (fram_kb < MAILBOX_FRAM_KB_MIN) {
+        fram_kb = MAILBOX_FRAM_KB_DEFAULT;
+    }
+
+    l->magic     = MAILBOX_LAYOUT_MAGIC;
+    l->version   = MAILBOX_LAYOUT_VERSION;
+    l->num_nodes = MAILBOX_NUM_NODES;
+    l->fram_kb   = fram_kb;
+
+    avail = (uint32_t)fram_kb * 1024UL - MAILBOX_BOXES_BASE -
+            (uint32_t)MCAST_NUM_BUFS * MCAST_BUF_SIZE;
+
+    weight_sum = 0u;
+    for (i = 0u; i < MAILBOX_NUM_NODES; i++) {
+        weight_sum = (uint16_t)(weight_sum + mailbox_box_weight(i));
+    }
+    share = avail / weight_sum;
+
+    base = MAILBOX_BOXES_BASE;
+    for (i = 0u; i < MAILBOX_NUM_NODES; i++) {
+        size = (share * mailbox_box_weight(i)) & ~(MAILBOX_BOX_ALIGN - 1UL);
+        if (size > MAILBOX_BOX_SIZE_MAX) {
+            size = MAILBOX_BOX_SIZE_MAX;
+        }
+
+        l->box[i].base = base;
+        l->box[i].size = size;
+        if (((MAILBOX_RECORD_BOXES >> i) & 1u) != 0u) {
+            l->box[i].mode     = MAILBOX_MODE_RECORDS;
+            l->box[i].msg_size = MAILBOX_REC_ALIGN;
+        } else {
+            l->box[i].mode     = MAILBOX_MODE_SLOTS;
+            l->box[i].msg_size = MSG_SLOT_SIZE;
+        }
+        base += size;
+    }
+    l->mcast_base = base;
+}
+
+uint8_t mailbox_load_layout(void)
+{
+    fram_read_bytes(MAILBOX_LAYOUT_ADDR, (uint8_t *)&mailbox_layout,
+                    (uint32_t)sizeof(mailbox_layout));
+
+    mailbox_layout_valid =
+        (uint8_t)(mailbox_layout.magic == MAILBOX_LAYOUT_MAGIC &&
+                  mailbox_layout.version == MAILBOX_LAYOUT_VERSION &&
+                  mailbox_layout.num_nodes == MAILBOX_NUM_NODES);
+    if (!mailbox_layout_valid) {
+        mailbox_plan_layout(&mailbox_layout, MAILBOX_FRAM_KB_DEFAULT);
+    }
+    return mailbox_layout_valid;
+}
+
+/* Read under the lock by whichever mailbox call comes first */
+static const mailbox_layout_t *mailbox_get_layout(void)
+{
+    if (!mailbox_layout_valid) {
+        (void)mailbox_load_layout();
+    }
+    return &mailbox_layout;
+}
 
 uint32_t mailbox_node_box_base(uint8_t node_index)
 {
-    switch (node_index) {
-    case 0u: return NODE1_BASE;
-    case 1u: return NODE2_BASE;
-    case 2u: return NODE3_BASE;
-    case 3u: return NODE4_BASE;
-    default: return NODE1_BASE; /* default */
+    if (node_index >= MAILBOX_NUM_NODES) {
+        node_index = 0u;
+    }
+    return mailbox_get_layout()->box[node_index].base;
+}
+
+uint32_t mailbox_node_box_size(uint8_t node_index)
+{
+    if (node_index >= MAILBOX_NUM_NODES) {
+        return 0u;
     }
+    return mailbox_get_layout()->box[node_index].size;
 }
 
 uint32_t mailbox_node_desc_addr(uint8_t node_index)
@@ -30,38 +143,73 @@ uint32_t mailbox_node_data_base(uint8_t node_index)
     return mailbox_node_box_base(node_index) + NODE_DATA_OFFSET;
 }
 
+static uint32_t mailbox_mcast_base(void)
+{
+    return mailbox_get_layout()->mcast_base;
+}
+
 /* ------------ Descriptor init ------------ */
 
 static void mailbox_init_one_node(uint8_t node_index)
 {
-    node_box_desc_t d;
+    const mailbox_box_entry_t *b = &mailbox_layout.box[node_index];
+    node_box_desc_t d[MAILBOX_NUM_LANES];
+    uint32_t normal_size;
+    uint8_t lane;
+
+    for (lane = 0u; lane < MAILBOX_NUM_LANES; lane++) {
+        d[lane].head      = 0u;
+        d[lane].tail      = 0u;
+        d[lane].reserved1 = 0u;
+        d[lane].mode      = b->mode;
+        d[lane].msg_size  = b->msg_size;
+    }
+
+    normal_size = b->size - NODE_DATA_OFFSET - NODE_HIGH_DATA_SIZE;
 
-    d.base      = mailbox_node_data_base(node_index);
-    d.size      = (uint16_t)NODE_BOX_DATA_SIZE;
-    d.head      = 0u;
-    d.tail      = 0u;
-    d.used      = 0u;
-    d.msg_size  = MSG_SLOT_SIZE;
-    d.reserved0 = 0u;
-    d.reserved1 = 0u;
-
-    fram_write_bytes(mailbox_node_desc_addr(node_index),
-                     (const uint8_t *)&d,
+    d[MAILBOX_PRIO_NORMAL].base = b->base + NODE_DATA_OFFSET;
+    d[MAILBOX_PRIO_NORMAL].size = (uint16_t)normal_size;
+    d[MAILBOX_PRIO_HIGH].base   = b->base + NODE_DATA_OFFSET + normal_size;
+    d[MAILBOX_PRIO_HIGH].size   = (uint16_t)NODE_HIGH_DATA_SIZE;
+
+    /* Lane descriptors are adjacent: one write */
+    fram_write_bytes(b->base + NODE_DESC_OFFSET,
+                     (const uint8_t *)d,
                      (uint32_t)sizeof(d));
 }
 
 void mailbox_init_layout(void)
 {
     uint8_t i;
-    uint8_t zero = 0u;
+    uint8_t zero[FRAM_NOTIF_MAX_NODES];
+    mailbox_credit_t none = { 0u, 0u, 0u };
+
+    /* Size the boxes to the chip and publish the table; the copy kept
+     * here is what reads back, so it never differs from other nodes'
+     */
+    mailbox_plan_layout(&mailbox_layout, mailbox_fram_kb());
+    fram_write_bytes(MAILBOX_LAYOUT_ADDR, (const uint8_t *)&mailbox_layout,
+                     (uint32_t)sizeof(mailbox_layout));
+    (void)mailbox_load_layout();
 
-    /* Init all 4 boxes */
     for (i = 0u; i < MAILBOX_NUM_NODES; i++) {
         mailbox_init_one_node(i);
     }
 
-    /* Clear notification byte */
-    fram_write_bytes(FRAM_NOTIF_BYTE_ADDR, &zero, 1u);
+    /* Clear all notification flags */
+    for (i = 0u; i < FRAM_NOTIF_MAX_NODES; i++) {
+        zero[i] = 0u;
+    }
+    fram_write_bytes(FRAM_NOTIF_BOX_ADDR, zero, FRAM_NOTIF_MAX_NODES);
+
+    /* All multicast buffers free */
+    fram_write_bytes(MCAST_REF_ADDR, zero, MCAST_NUM_BUFS);
+
+    /* No sender waiting for space */
+    for (i = 0u; i < MAILBOX_NUM_NODES; i++) {
+        fram_write_bytes(MAILBOX_CREDIT_ADDR_OF(i), (const uint8_t *)&none,
+                         (uint32_t)sizeof(none));
+    }
 }
 
 /* ------------ Internal helpers ------------ */
@@ -81,44 +229,312 @@ static uint16_t mailbox_slot_count(const node_box_desc_t *d)
     return count;
 }
 
-/* Write a single slot (header + payload) to FRAM.
- * - Uses two FRAM writes: one for header (4B), one for payload (len B).
- * - Does NOT update descriptor or notification.
+/* Occupied slots, derived from the two indices. One slot is always kept
+ * free so that head == tail means empty.
+ */
+static uint16_t mailbox_used_slots(const node_box_desc_t *d, uint16_t slot_count)
+{
+    if (d->tail >= d->head) {
+        return (uint16_t)(d->tail - d->head);
+    }
+    return (uint16_t)(slot_count - d->head + d->tail);
+}
+
+static uint16_t mailbox_free_slots(const node_box_desc_t *d, uint16_t slot_count)
+{
+    uint16_t used = mailbox_used_slots(d, slot_count);
+
+    if (used >= slot_count) {
+        return 0u;      /* corrupt indices */
+    }
+    return (uint16_t)(slot_count - 1u - used);
+}
+
+/* Descriptor address of one lane of a box */
+static uint32_t mailbox_lane_desc_addr(uint8_t node_index, uint8_t lane)
+{
+    return mailbox_node_desc_addr(node_index) +
+           ((uint32_t)lane * (uint32_t)sizeof(node_box_desc_t));
+}
+
+/* Receiver: read all lane descriptors in one burst and pick the lane to
+ * serve, the high lane whenever it is not empty.
+ * Returns the lane, with its descriptor in *d.
+ */
+static uint8_t mailbox_pick_lane(uint8_t node_index, node_box_desc_t *d)
+{
+    node_box_desc_t lanes[MAILBOX_NUM_LANES];
+    uint8_t lane = MAILBOX_PRIO_NORMAL;
+
+    fram_read_bytes(mailbox_node_desc_addr(node_index),
+                    (uint8_t *)lanes,
+                    (uint32_t)sizeof(lanes));
+
+    if (lanes[MAILBOX_PRIO_HIGH].head != lanes[MAILBOX_PRIO_HIGH].tail) {
+        lane = MAILBOX_PRIO_HIGH;
+    }
+    *d = lanes[lane];
+    return lane;
+}
+
+/* Set once a flag was raised under the current lock hold */
+static uint8_t mailbox_notified;
+
+/* Raise dest's notification flag: one blind write, no read-modify-write */
+static void mailbox_notify(uint8_t dest_index)
+{
+    static const uint8_t flag = 1u;
+
+    fram_write_bytes(FRAM_NOTIF_FLAG_ADDR(dest_index), &flag, 1u);
+    mailbox_notified = 1u;
+}
+
+/* Each side writes back only the index it owns: senders the tail,
+ * the receiver the head. base/size/msg_size never change after
+ * mailbox_init_layout().
+ */
+static void mailbox_store_tail(uint32_t desc_addr, const node_box_desc_t *d)
+{
+    fram_write_bytes(desc_addr + (uint32_t)offsetof(node_box_desc_t, tail),
+                     (const uint8_t *)&d->tail,
+                     (uint32_t)sizeof(d->tail));
+}
+
+static void mailbox_store_head(uint32_t desc_addr, const node_box_desc_t *d)
+{
+    fram_write_bytes(desc_addr + (uint32_t)offsetof(node_box_desc_t, head),
+                     (const uint8_t *)&d->head,
+                     (uint32_t)sizeof(d->head));
+}
+
+/* Payload length from a header: bulk headers keep a 16-bit total_len in
+ * len/reserved, single messages have reserved == 0.
+ */
+static uint16_t mailbox_hdr_len(const msg_hdr_t *h)
+{
+    return (uint16_t)h->len | ((uint16_t)h->reserved << 8);
+}
+
+/* Units (slots, or MAILBOX_REC_ALIGN-byte units in record mode) taken by
+ * a message with these header flags and payload length.
+ */
+static uint16_t mailbox_msg_units(uint16_t msg_size, uint8_t flags, uint16_t len)
+{
+    uint32_t bytes;
+
+    if ((flags & MSG_FLAG_BULK) == 0u && msg_size >= MSG_SLOT_SIZE) {
+        return 1u;
+    }
+
+    bytes = (uint32_t)sizeof(msg_hdr_t) + (uint32_t)len;
+    return (uint16_t)((bytes + (uint32_t)msg_size - 1u) / (uint32_t)msg_size);
+}
+
+/* Find 'units' contiguous free units at tail, or at 0 if they would cross
+ * the ring end (the caller then puts a wrap marker at tail).
+ * Returns 1 and the first unit in *start, 0 if there is no room.
+ */
+static uint8_t mailbox_alloc_units(const node_box_desc_t *d,
+                                   uint16_t slot_count,
+                                   uint16_t units,
+                                   uint16_t *start)
+{
+    if (units > mailbox_free_slots(d, slot_count)) {
+        return 0u;
+    }
+
+    /* With tail < head the free run tail..head-1 is contiguous, and with
+     * tail >= head the free-space check keeps tail + units below the end
+     * unless head > 0.
+     */
+    if (d->tail < d->head || (uint32_t)d->tail + units <= slot_count) {
+        *start = d->tail;
+        return 1u;
+    }
+
+    /* Skip the rest of the ring; one unit stays free before head */
+    if (units < d->head) {
+        *start = 0u;
+        return 1u;
+    }
+    return 0u;
+}
+
+/* Max fragments handed to mailbox_writev_ring() */
+#define MAILBOX_RING_MAX_FRAGS  4u
+
+/* Write a fragment list into the node's FRAM ring at
+ * offset 'pos' (0..ring_size-1), wrapping as needed.
+ * Each contiguous FRAM segment is one fram_writev() (at most two, as
+ * callers never write more than ring_size bytes).
+ * Returns new offset in [0, ring_size).
+ */
+static uint32_t mailbox_writev_ring(uint32_t base,
+                                    uint32_t ring_size,
+                                    uint32_t pos,
+                                    const fram_wfrag_t *frags,
+                                    uint8_t count)
+{
+    fram_wfrag_t seg[MAILBOX_RING_MAX_FRAGS + 1u];
+    uint8_t  nseg      = 0u;
+    uint32_t seg_start = pos;
+    uint32_t offset    = pos;
+    uint8_t  k;
+
+    if (count > MAILBOX_RING_MAX_FRAGS) {
+        count = MAILBOX_RING_MAX_FRAGS;
+    }
+
+    for (k = 0u; k < count; k++) {
+        const uint8_t *p = frags[k].src;
+        uint32_t remaining = frags[k].len;
+
+        while (remaining > 0u) {
+            uint32_t chunk = ring_size - offset;
+            if (chunk > remaining) {
+                chunk = remaining;
+            }
+
+            seg[nseg].src = p;
+            seg[nseg].len = (uint16_t)chunk;
+            nseg++;
+
+            p        += chunk;
+            remaining -= chunk;
+            offset   += chunk;
+            if (offset >= ring_size) {
+                /* End of ring: flush this segment, continue from 0 */
+                fram_writev(base + seg_start, seg, nseg);
+                nseg      = 0u;
+                offset    = 0u;
+                seg_start = 0u;
+            }
+        }
+    }
+
+    if (nseg != 0u) {
+        fram_writev(base + seg_start, seg, nseg);
+    }
+
+    return offset;
+}
+
+/* Slot mode: a bulk with room in the lane but no contiguous run for it
+ * is split across the ring end instead (the MAILBOX_CONTIG_BULK 0 layout,
+ * which every receive path reads). Otherwise a lane drained empty with
+ * head mid-ring never takes a bulk of head units or more that would cross
+ * the end: head only moves when there is something to read.
+ */
+static uint8_t mailbox_bulk_splits(const node_box_desc_t *d,
+                                   uint16_t slot_count,
+                                   uint8_t  flags,
+                                   uint16_t units)
+{
+    return (uint8_t)(d->mode == MAILBOX_MODE_SLOTS &&
+                     (flags & MSG_FLAG_BULK) != 0u &&
+                     units <= mailbox_free_slots(d, slot_count));
+}
+
+static const msg_hdr_t mailbox_wrap_hdr = { 0u, MSG_FLAG_WRAP, 0u, 0u };
+
+/* Write one message as a contiguous record at tail (after a wrap marker
+ * if it would cross the ring end) and publish the new tail.
+ * - One gathered FRAM write: header (4B) followed by the payload, given
+ *   as frags[1..count-1]; frags[0] is filled in with the header. A slot
+ *   mode bulk split by mailbox_bulk_splits() takes two.
+ * - Does NOT raise the notification.
+ * Returns 1 on success, 0 if the box has no room.
  */
-static void mailbox_write_one_slot(uint32_t slot_addr,
+static uint8_t mailbox_put_recordv(uint32_t desc_addr,
+                                   node_box_desc_t *d,
+                                   uint16_t slot_count,
                                    uint8_t  src_id,
-                                   uint8_t  len,
-                                   const uint8_t *payload)
+                                   uint8_t  flags,
+                                   fram_wfrag_t *frags,
+                                   uint8_t  count)
 {
-    uint8_t header[4];
+    msg_hdr_t hdr;
+    uint16_t len = 0u;
+    uint16_t units;
+    uint16_t start;
+    uint8_t  i;
+
+    for (i = 1u; i < count; i++) {
+        len = (uint16_t)(len + frags[i].len);
+    }
+
+    units = mailbox_msg_units(d->msg_size, flags, len);
+    if (!mailbox_alloc_units(d, slot_count, units, &start)) {
+        if (!mailbox_bulk_splits(d, slot_count, flags, units)) {
+            return 0u;
+        }
+        start = d->tail;
+    }
 
-    header[0] = src_id;
-    header[1] = 0u;       /* flags */
-    header[2] = len;
-    header[3] = 0u;       /* reserved */
+    if (start != d->tail) {
+        fram_write_bytes(d->base + ((uint32_t)d->tail * (uint32_t)d->msg_size),
+                         (const uint8_t *)&mailbox_wrap_hdr,
+                         (uint32_t)sizeof(mailbox_wrap_hdr));
+    }
 
-    /* Header */
-    fram_write_bytes(slot_addr, header, (uint32_t)sizeof(header));
+    hdr.src_id   = src_id;
+    hdr.flags    = flags;
+    hdr.len      = (uint8_t)len;
+    hdr.reserved = (uint8_t)(len >> 8);
 
     /* Payload: only len bytes; remainder of the slot is don't-care */
-    if (len != 0u) {
-        fram_write_bytes(slot_addr + 4u, payload, (uint32_t)len);
+    frags[0].src = (const uint8_t *)&hdr;
+    frags[0].len = (uint16_t)sizeof(hdr);
+
+    (void)mailbox_writev_ring(d->base, (uint32_t)d->size,
+                              (uint32_t)start * (uint32_t)d->msg_size,
+                              frags, count);
+
+    d->tail = (uint16_t)(start + units);
+    if (d->tail >= slot_count) {
+        d->tail = (uint16_t)(d->tail - slot_count);
     }
+    mailbox_store_tail(desc_addr, d);
+
+    return 1u;
+}
+
+/* mailbox_put_recordv() with the payload in one buffer */
+static uint8_t mailbox_put_record(uint32_t desc_addr,
+                                  node_box_desc_t *d,
+                                  uint16_t slot_count,
+                                  uint8_t  src_id,
+                                  uint8_t  flags,
+                                  const uint8_t *data,
+                                  uint16_t len)
+{
+    fram_wfrag_t frags[2];
+
+    frags[1].src = data;
+    frags[1].len = len;
+
+    return mailbox_put_recordv(desc_addr, d, slot_count, src_id, flags, frags, 2u);
 }
 
 /* ------------ Public send/recv ------------ */
 
+uint8_t mailbox_take_notified(void)
+{
+    uint8_t notified = mailbox_notified;
+
+    mailbox_notified = 0u;
+    return notified;
+}
+
 uint8_t mailbox_send_msg(uint8_t dest_index,
                          uint8_t src_id,
                          const uint8_t *data,
-                         uint8_t len)
+                         uint8_t len,
+                         uint8_t prio)
 {
     node_box_desc_t d;
     uint16_t slot_count;
-    uint16_t slot_index;
     uint32_t desc_addr;
-    uint32_t slot_addr;
-    uint8_t  notif;
 
     if (dest_index >= MAILBOX_NUM_NODES) {
         uart0_println("Bad dest index");
@@ -132,12 +548,19 @@ uint8_t mailbox_send_msg(uint8_t dest_index,
         uart0_println("Length too big");
         return 0u;
     }
+    if (prio >= MAILBOX_NUM_LANES) {
+        uart0_println("Bad priority");
+        return 0u;
+    }
 
     // uart0_println("Will read descriptor");
-    /* Read descriptor for this box */
-    desc_addr = mailbox_node_desc_addr(dest_index);
+    /* Read descriptor for this box's lane */
+    desc_addr = mailbox_lane_desc_addr(dest_index, prio);
+    // uart0_print_hex(desc_addr);
+    // uart0_println("");
     fram_read_bytes(desc_addr, (uint8_t *)&d, (uint32_t)sizeof(d));
 
+
     // print the descriptor values for debugging
     // uart0_println("Descriptor early:");
     // uart0_print(" base=0x");
@@ -148,8 +571,6 @@ uint8_t mailbox_send_msg(uint8_t dest_index,
     // uart0_print_uint(d.head);
     // uart0_print(" tail=");
     // uart0_print_uint(d.tail);
-    // uart0_print(" used=");
-    // uart0_print_uint(d.used);
     // uart0_print(" msg_size=");
     // uart0_print_uint(d.msg_size);
     // uart0_println("");
@@ -162,29 +583,14 @@ uint8_t mailbox_send_msg(uint8_t dest_index,
         return 0u;
     }
 
-    /* Queue full? */
-    if (d.used >= slot_count) {
+    // uart0_println("Will write one slot");
+    /* Write single slot (or record) and advance tail; fails if full */
+    if (!mailbox_put_record(desc_addr, &d, slot_count, src_id, 0u, data, len)) {
         uart0_println("Queue full");
         return 0u;
     }
-
-    /* Compute slot address */
-    slot_index = d.tail;
-    slot_addr  = d.base + ((uint32_t)slot_index * (uint32_t)d.msg_size);
-
-    // uart0_println("Will write one slot");
-    /* Write single slot */
-    mailbox_write_one_slot(slot_addr, src_id, len, data);
     // uart0_println("Slot written");
 
-    /* Advance tail and used (ring buffer) */
-    slot_index++;
-    if (slot_index >= slot_count) {
-        slot_index = 0u;
-    }
-    d.tail = slot_index;
-    d.used++;
-
     // uart0_println("Will update descriptor");
 
     //     // print the descriptor values for debugging
@@ -197,65 +603,150 @@ uint8_t mailbox_send_msg(uint8_t dest_index,
     // uart0_print_uint(d.head);
     // uart0_print(" tail=");
     // uart0_print_uint(d.tail);
-    // uart0_print(" used=");
-    // uart0_print_uint(d.used);
     // uart0_print(" msg_size=");
     // uart0_print_uint(d.msg_size);
     // uart0_println(" ");
 
-    /* Write back descriptor */
-    fram_write_bytes(desc_addr, (const uint8_t *)&d, (uint32_t)sizeof(d));
-    // uart0_println("Descriptor updated");
-    
-    /* Set notification bit for this dest node */
-    // fram_read_bytes(FRAM_NOTIF_BYTE_ADDR, &notif, 1u);
-    // // uart0_println("Will update notification byte");
-    // notif |= (uint8_t)(1u << dest_index);
-    // fram_write_bytes(FRAM_NOTIF_BYTE_ADDR, &notif, 1u);
-    // uart0_println("Notification byte updated");
+    /* Set notification flag for this dest node */
+    mailbox_notify(dest_index);
 
     return 1u;
 }
 
-/* Max number of slots batched into one FRAM write */
+/* Max number of slots gathered into one FRAM write */
+#define MAILBOX_BATCH_RUN_MAX   8u
+
+uint8_t mailbox_send_batch(uint8_t dest_index,
+                           uint8_t src_id,
+                           const mailbox_msg_t *msgs,
+                           uint8_t count)
+{
+    node_box_desc_t d;
+    msg_hdr_t    hdr[MAILBOX_BATCH_RUN_MAX];
+    fram_wfrag_t frags[3u * MAILBOX_BATCH_RUN_MAX + 1u];
+    /* Unused slot tails are clocked out to keep a whole run in one burst
+     * (cheaper than a new transaction: WREN + CS cycle + 4-byte prefix +
+     * DMA setup). Any readable bytes do: frags is over MSG_SLOT_SIZE.
+     */
+    const uint8_t *pad_src = (const uint8_t *)frags;
+    uint16_t slot_count;
+    uint16_t slot_index;
+    uint16_t units;
+    uint16_t start;
+    uint32_t desc_addr;
+    uint32_t run_addr = 0u;
+    uint16_t pad      = 0u;
+    uint8_t  nfrag    = 0u;
+    uint8_t  nrun     = 0u;
+    uint8_t  sent     = 0u;
+    uint8_t  k;
+
+    if (dest_index >= MAILBOX_NUM_NODES || count == 0u) {
+        return 0u;
+    }
+
+    /* ---------- Read descriptor once ---------- */
 
-/* Batch buffer: each entry is a full msg_slot_t */
+    desc_addr = mailbox_node_desc_addr(dest_index);
+    fram_read_bytes(desc_addr, (uint8_t *)&d, (uint32_t)sizeof(d));
 
+    slot_count = mailbox_slot_count(&d);
+    if (slot_count == 0u) {
+        return 0u;
+    }
 
-/* Write 'len' bytes from src into the node's FRAM ring at
- * offset 'pos' (0..ring_size-1), wrapping as needed.
- * Returns new offset in [0, ring_size).
- */
-static uint32_t mailbox_write_bytes_ring(uint32_t base,
-                                         uint32_t ring_size,
-                                         uint32_t pos,
-                                         const uint8_t *src,
-                                         uint32_t len)
-{
-    uint32_t remaining = len;
-    uint32_t offset    = pos;
-    const uint8_t *p   = src;
+    /* ---------- Gather consecutive slots into runs ---------- */
 
-    while (remaining > 0u) {
-        uint32_t chunk = ring_size - offset;
-        if (chunk > remaining) {
-            chunk = remaining;
+    slot_index = d.tail;
+
+    for (k = 0u; k < count; k++) {
+        uint8_t len = msgs[k].len;
+
+        if (len == 0u || len > MSG_SLOT_PAYLOAD_MAX) {
+            break;
         }
 
-        fram_write_bytes(base + offset, p, chunk);
+        /* One slot, or a record of len rounded up in record mode */
+        units  = mailbox_msg_units(d.msg_size, 0u, len);
+        d.tail = slot_index;
+        if (!mailbox_alloc_units(&d, slot_count, units, &start)) {
+            break;      /* box full */
+        }
 
-        p        += chunk;
-        remaining -= chunk;
-        offset   += chunk;
-        if (offset >= ring_size) {
-            offset = 0u;
+        if (start != slot_index) {
+            /* Record mode, would cross the ring end: close the current run
+             * with a wrap marker at slot_index and restart at 0.
+             */
+            if (nrun == 0u) {
+                run_addr = d.base + ((uint32_t)slot_index * (uint32_t)d.msg_size);
+            } else if (pad != 0u) {
+                frags[nfrag].src = pad_src;
+                frags[nfrag].len = pad;
+                nfrag++;
+            }
+            frags[nfrag].src = (const uint8_t *)&mailbox_wrap_hdr;
+            frags[nfrag].len = (uint16_t)sizeof(mailbox_wrap_hdr);
+            nfrag++;
+            fram_writev(run_addr, frags, nfrag);
+            nrun       = 0u;
+            nfrag      = 0u;
+            slot_index = start;
+        } else if (nrun != 0u) {
+            if (slot_index == 0u ||                 /* ring wrapped */
+                nrun == MAILBOX_BATCH_RUN_MAX) {
+                fram_writev(run_addr, frags, nfrag);
+                nrun  = 0u;
+                nfrag = 0u;
+            } else if (pad != 0u) {
+                /* Fill the previous slot's tail, stay in this burst */
+                frags[nfrag].src = pad_src;
+                frags[nfrag].len = pad;
+                nfrag++;
+            }
+        }
+        if (nrun == 0u) {
+            run_addr = d.base + ((uint32_t)slot_index * (uint32_t)d.msg_size);
+        }
+
+        hdr[nrun].src_id   = src_id;
+        hdr[nrun].flags    = 0u;
+        hdr[nrun].len      = len;
+        hdr[nrun].reserved = 0u;
+
+        frags[nfrag].src = (const uint8_t *)&hdr[nrun];
+        frags[nfrag].len = (uint16_t)sizeof(msg_hdr_t);
+        nfrag++;
+        frags[nfrag].src = msgs[k].data;
+        frags[nfrag].len = len;
+        nfrag++;
+        nrun++;
+
+        pad = (uint16_t)((uint32_t)units * (uint32_t)d.msg_size -
+                         sizeof(msg_hdr_t) - len);
+
+        slot_index = (uint16_t)(slot_index + units);
+        if (slot_index >= slot_count) {
+            slot_index = (uint16_t)(slot_index - slot_count);
         }
+        sent++;
     }
 
-    return offset;
-}
+    if (nrun != 0u) {
+        fram_writev(run_addr, frags, nfrag);
+    }
+    if (sent == 0u) {
+        return 0u;
+    }
+
+    /* ---------- One tail update + notification ---------- */
+
+    d.tail = slot_index;
+    mailbox_store_tail(desc_addr, &d);
 
+    mailbox_notify(dest_index);
 
+    return sent;
+}
 
 uint8_t mailbox_send_bulk(uint8_t dest_index,
                           uint8_t src_id,
@@ -270,71 +761,51 @@ uint8_t mailbox_send_bulk(uint8_t dest_index,
     uint32_t ring_size;
     uint32_t write_pos;
     uint32_t bytes_to_write;
-    uint8_t  notif;
 
     bulk_header_t hdr;
+    fram_wfrag_t  frags[2];
 
 
     /* ---------- Basic argument checks ---------- */
 
     if (dest_index >= MAILBOX_NUM_NODES) {
-        uart0_println("Bad dest index");
         return 0u;
     }
     if (total_len == 0u) {
-        uart0_println("Zero length");
-        return 0u;
-    }
-
-    /* total_len will be stored in 16 bits */
-    if (total_len > 0xFFFFu) {
-        uart0_println("Total length too big");
         return 0u;
     }
 
     /* ---------- Read descriptor once ---------- */
 
     desc_addr = mailbox_node_desc_addr(dest_index);
-    // uart0_print_hex(desc_addr);
-    // uart0_println("");
     fram_read_bytes(desc_addr, (uint8_t *)&d, (uint32_t)sizeof(d));
 
-    // print all the descriptor values for debugging
-    // uart0_println("Descriptor early:");
-    // uart0_print(" base=0x");
-    // uart0_print_hex(d.base);
-    // uart0_print(" size=");
-    // uart0_print_uint(d.size);
-    // uart0_print(" head=");
-    // uart0_print_uint(d.head);
-    // uart0_print(" tail=");
-    // uart0_print_uint(d.tail);
-    // uart0_print(" used=");
-    // uart0_print_uint(d.used);
-    // uart0_print(" msg_size=");
-    // uart0_print_uint(d.msg_size);
-    // uart0_println("");
-
     slot_count = mailbox_slot_count(&d);
     if (slot_count == 0u) {
-        uart0_println("Zero slot count");
         return 0u;
     }
     if (d.msg_size == 0u) {
-        uart0_println("Zero message size");
         return 0u;
     }
 
     ring_size = (uint32_t)d.size;  /* should be slot_count * d.msg_size */
 
-    if (d.used >= slot_count) {
-        uart0_println("Queue full");
+    if (d.mode == MAILBOX_MODE_RECORDS || MAILBOX_CONTIG_BULK != 0u) {
+        /* One contiguous record, never split at the ring end */
+        if (!mailbox_put_record(desc_addr, &d, slot_count,
+                                src_id, MSG_FLAG_BULK, data, total_len)) {
+            return 0u;
+        }
+        mailbox_notify(dest_index);
+        return 1u;
+    }
+
+    free_slots = mailbox_free_slots(&d, slot_count);
+    if (free_slots == 0u) {
         /* Queue full */
         return 0u;
     }
 
-    free_slots = (uint16_t)(slot_count - d.used);
-
     /* ---------- Compute bytes, slots required ---------- */
 
     {
@@ -370,52 +841,267 @@ uint8_t mailbox_send_bulk(uint8_t dest_index,
 
     write_pos = (uint32_t)d.tail * (uint32_t)d.msg_size;  /* 0..ring_size-1 */
 
-    /* ---------- Write header then payload into FRAM ring ---------- */
+    /* ---------- Write header + payload into FRAM ring ---------- */
 
-    /* 1) Header */
-    write_pos = mailbox_write_bytes_ring(d.base,
-                                         ring_size,
-                                         write_pos,
-                                         (const uint8_t *)&hdr,
-                                         (uint32_t)sizeof(hdr));
+    frags[0].src = (const uint8_t *)&hdr;
+    frags[0].len = (uint16_t)sizeof(hdr);
+    frags[1].src = data;
+    frags[1].len = total_len;
 
-    /* 2) Payload (total_len bytes) */
-    write_pos = mailbox_write_bytes_ring(d.base,
-                                         ring_size,
-                                         write_pos,
-                                         data,
-                                         (uint32_t)total_len);
+    write_pos = mailbox_writev_ring(d.base, ring_size, write_pos, frags, 2u);
 
     /* No padding is explicitly written; the last partially used slot
      * contains some “unused” tail bytes. The receiver will rely on
      * hdr.total_len, not on slot fullness.
      */
 
-    /* ---------- Update descriptor (slot space) ---------- */
-
-
-    d.used = (uint16_t)(d.used + used_slots);
-    if (d.used > slot_count) {
-        d.used = slot_count;    /* safety clamp */
-    }
+    /* ---------- Update tail (slot space) ---------- */
 
     d.tail = (uint16_t)(d.tail + used_slots);
     if (d.tail >= slot_count) {
         d.tail = (uint16_t)(d.tail - slot_count);  /* wrap in slot-space */
     }
 
-    /* Write back descriptor once after the bulk */
-    fram_write_bytes(desc_addr, (const uint8_t *)&d, (uint32_t)sizeof(d));
+    /* Write back tail once after the bulk */
+    mailbox_store_tail(desc_addr, &d);
+
+    /* ---------- Notification flag ---------- */
+
+    mailbox_notify(dest_index);
+
+    return 1u;
+}
+
+/* ------------ Flow control ------------ */
+
+uint8_t mailbox_want_space(uint8_t dest_index,
+                           uint8_t node_index,
+                           uint16_t len)
+{
+    node_box_desc_t d;
+    mailbox_credit_t c;
+    uint16_t slot_count;
+    uint16_t units;
+    uint16_t want;
+    uint16_t start;
+    uint8_t  bulk;
+
+    if (dest_index >= MAILBOX_NUM_NODES || node_index >= MAILBOX_MAX_NODES) {
+        return 0u;
+    }
+    if (len == 0u || dest_index == node_index) {
+        /* Nobody else drains our own box */
+        return 0u;
+    }
+
+    fram_read_bytes(mailbox_node_desc_addr(dest_index), (uint8_t *)&d,
+                    (uint32_t)sizeof(d));
 
-    /* ---------- Notification byte ---------- */
+    slot_count = mailbox_slot_count(&d);
+    if (slot_count == 0u) {
+        return 0u;
+    }
 
-    // fram_read_bytes(FRAM_NOTIF_BOX_ADDR, &notif, 1u);
-    // notif |= (uint8_t)(1u << dest_index);
-    // fram_write_bytes(FRAM_NOTIF_BOX_ADDR, &notif, 1u);
+    bulk  = (len > MSG_SLOT_PAYLOAD_MAX) ? MSG_FLAG_BULK : 0u;
+    units = mailbox_msg_units(d.msg_size, bulk, len);
+    if (units >= slot_count) {
+        return 0u;
+    }
+
+    /* Same placement rules as the send: records (and contiguous bulks)
+     * that would cross the ring end also need the units skipped there.
+     */
+    want = units;
+    if (d.mode == MAILBOX_MODE_RECORDS || bulk == 0u || MAILBOX_CONTIG_BULK != 0u) {
+        if (mailbox_alloc_units(&d, slot_count, units, &start) ||
+            mailbox_bulk_splits(&d, slot_count, bulk, units)) {
+            return 0u;
+        }
+        if (d.tail >= d.head && (uint32_t)d.tail + units > slot_count) {
+            if (d.tail == d.head) {
+                /* Empty record lane: no drain moves head, it never fits */
+                return 0u;
+            }
+            want = (uint16_t)(slot_count - d.tail + units);
+            if (want >= slot_count) {
+                want = (uint16_t)(slot_count - 1u);
+            }
+        }
+    } else if (units <= mailbox_free_slots(&d, slot_count)) {
+        return 0u;
+    }
+
+    /* Join the waiters; the largest request sets the threshold */
+    fram_read_bytes(MAILBOX_CREDIT_ADDR_OF(dest_index), (uint8_t *)&c,
+                    (uint32_t)sizeof(c));
+    c.waiters |= (mailbox_mask_t)1u << node_index;
+    if (want > c.want) {
+        c.want = want;
+    }
+    fram_write_bytes(MAILBOX_CREDIT_ADDR_OF(dest_index), (const uint8_t *)&c,
+                     (uint32_t)sizeof(c));
 
     return 1u;
 }
 
+/* ------------ Multicast ------------ */
+
+static uint32_t mailbox_mcast_buf_addr(uint8_t buf)
+{
+    return mailbox_mcast_base() + ((uint32_t)buf * (uint32_t)MCAST_BUF_SIZE);
+}
+
+/* Drop one reference to shared buffer 'buf' */
+static void mailbox_mcast_release(uint8_t buf)
+{
+    uint8_t ref;
+
+    if (buf >= MCAST_NUM_BUFS) {
+        return;
+    }
+    fram_read_bytes(MCAST_REF_ADDR + buf, &ref, 1u);
+    if (ref != 0u) {
+        ref--;
+        fram_write_bytes(MCAST_REF_ADDR + buf, &ref, 1u);
+    }
+}
+
+/* Decode the mailbox_mcast_ref_t at the start of 'payload'.
+ * Returns 0 (len 0) if it does not name a valid buffer.
+ */
+static uint8_t mailbox_mcast_decode(const uint8_t *payload,
+                                    uint8_t *buf_out,
+                                    uint16_t *len_out)
+{
+    *buf_out = payload[offsetof(mailbox_mcast_ref_t, buf)];
+    *len_out = (uint16_t)payload[offsetof(mailbox_mcast_ref_t, len)] |
+               ((uint16_t)payload[offsetof(mailbox_mcast_ref_t, len) + 1u] << 8);
+
+    if (*buf_out >= MCAST_NUM_BUFS || *len_out > MCAST_BUF_SIZE) {
+        *len_out = 0u;
+        return 0u;
+    }
+    return 1u;
+}
+
+mailbox_mask_t mailbox_send_multicast(mailbox_mask_t dest_mask,
+                                      uint8_t src_id,
+                                      const uint8_t *data,
+                                      uint16_t total_len)
+{
+    uint8_t refs[MCAST_NUM_BUFS];
+    mailbox_mcast_ref_t ref;
+    node_box_desc_t d;
+    uint16_t slot_count;
+    uint32_t desc_addr;
+    mailbox_mask_t delivered = 0u;
+    uint8_t  count     = 0u;
+    uint8_t  i;
+
+    dest_mask &= MAILBOX_NODES_MASK;
+    if (dest_mask == 0u || total_len == 0u || total_len > MCAST_BUF_SIZE) {
+        return 0u;
+    }
+
+    /* ---------- Find a free shared buffer ---------- */
+
+    fram_read_bytes(MCAST_REF_ADDR, refs, MCAST_NUM_BUFS);
+    for (i = 0u; i < MCAST_NUM_BUFS; i++) {
+        if (refs[i] == 0u) {
+            break;
+        }
+    }
+    if (i == MCAST_NUM_BUFS) {
+        return 0u;
+    }
+
+    ref.buf      = i;
+    ref.reserved = 0u;
+    ref.len      = total_len;
+
+    /* ---------- Payload once ---------- */
+
+    fram_write_bytes(mailbox_mcast_buf_addr(ref.buf), data, total_len);
+
+    /* ---------- Small reference record per destination ---------- */
+
+    for (i = 0u; i < MAILBOX_NUM_NODES; i++) {
+        if (((dest_mask >> i) & 1u) == 0u) {
+            continue;
+        }
+
+        desc_addr = mailbox_node_desc_addr(i);
+        fram_read_bytes(desc_addr, (uint8_t *)&d, (uint32_t)sizeof(d));
+
+        slot_count = mailbox_slot_count(&d);
+        if (slot_count == 0u) {
+            continue;
+        }
+        if (mailbox_put_record(desc_addr, &d, slot_count, src_id, MSG_FLAG_MCAST,
+                               (const uint8_t *)&ref, (uint16_t)sizeof(ref))) {
+            mailbox_notify(i);
+            delivered |= (mailbox_mask_t)1u << i;
+            count++;
+        }
+    }
+
+    /* ---------- One reference per box that got the record ---------- */
+
+    if (count != 0u) {
+        fram_write_bytes(MCAST_REF_ADDR + ref.buf, &count, 1u);
+    }
+
+    return delivered;
+}
+
+/* Empty the lane after a record that claims more than is queued.
+ * Multicast references in it still count against their shared buffer,
+ * so the dropped records are walked and those give the buffer back;
+ * units whose header does not fit (the corrupt one) are stepped over
+ * one at a time.
+ */
+static void mailbox_drop_queued(uint32_t desc_addr,
+                                node_box_desc_t *d,
+                                uint16_t slot_count)
+{
+    uint8_t  rec[sizeof(msg_hdr_t) + sizeof(mailbox_mcast_ref_t)];
+    const msg_hdr_t *h = (const msg_hdr_t *)rec;
+    uint16_t left;
+    uint16_t pos;
+    uint16_t n;
+    uint16_t len;
+    uint8_t  buf;
+
+    left = mailbox_used_slots(d, slot_count);
+    pos  = d->head;
+
+    while (left != 0u) {
+        fram_read_bytes(d->base + ((uint32_t)pos * (uint32_t)d->msg_size),
+                        rec, (uint32_t)sizeof(rec));
+        if ((h->flags & MSG_FLAG_WRAP) != 0u) {
+            n = (uint16_t)(slot_count - pos);
+        } else {
+            n = mailbox_msg_units(d->msg_size, h->flags, mailbox_hdr_len(h));
+        }
+        if (n == 0u || n > left) {
+            n = 1u;
+        } else if (h->flags == MSG_FLAG_MCAST &&
+                   mailbox_hdr_len(h) == (uint16_t)sizeof(mailbox_mcast_ref_t) &&
+                   mailbox_mcast_decode(rec + sizeof(msg_hdr_t), &buf, &len)) {
+            mailbox_mcast_release(buf);
+        }
+
+        pos = (uint16_t)(pos + n);
+        if (pos >= slot_count) {
+            pos = (uint16_t)(pos - slot_count);
+        }
+        left = (uint16_t)(left - n);
+    }
+
+    d->head = d->tail;
+    mailbox_store_head(desc_addr, d);
+}
+
 /* Read 'len' bytes from the node's FRAM ring at
  * offset 'pos' (0..ring_size-1), wrapping as needed.
  * Returns new offset in [0, ring_size).
@@ -455,21 +1141,34 @@ uint8_t mailbox_recv_msg(uint8_t node_index,
                          uint8_t *data_out)
 {
     node_box_desc_t d;
-    msg_slot_t slot;
+    msg_hdr_t hdr;
+    fram_rfrag_t frags[2];
     uint16_t slot_count;
     uint16_t slot_index;
     uint32_t desc_addr;
     uint32_t slot_addr;
     uint32_t ring_size;
-    uint8_t  i;
 
     if (node_index >= MAILBOX_NUM_NODES) {
         return 0u;
     }
 
-    /* Read descriptor */
-    desc_addr = mailbox_node_desc_addr(node_index);
-    fram_read_bytes(desc_addr, (uint8_t *)&d, (uint32_t)sizeof(d));
+    /* Read descriptors, pick the lane (high first) */
+    desc_addr = mailbox_lane_desc_addr(node_index,
+                                       mailbox_pick_lane(node_index, &d));
+
+    // uart0_println("Read Descriptor:");
+    // uart0_print(" base=0x");
+    // uart0_print_hex(d.base);
+    // uart0_print(" size=");
+    // uart0_print_uint(d.size);
+    // uart0_print(" head=");
+    // uart0_print_uint(d.head);
+    // uart0_print(" tail=");
+    // uart0_print_uint(d.tail);
+    // uart0_print(" msg_size=");
+    // uart0_print_uint(d.msg_size);
+    // uart0_println("");
 
     slot_count = mailbox_slot_count(&d);
     if (slot_count == 0u) {
@@ -477,7 +1176,7 @@ uint8_t mailbox_recv_msg(uint8_t node_index,
     }
 
     /* Empty? */
-    if (d.used == 0u) {
+    if (d.head == d.tail) {
         return 0u;
     }
 
@@ -487,16 +1186,53 @@ uint8_t mailbox_recv_msg(uint8_t node_index,
     slot_index = d.head;
     slot_addr  = d.base + ((uint32_t)slot_index * (uint32_t)d.msg_size);
 
-    /* Read full slot from FRAM (backwards compatible) */
-    fram_read_bytes(slot_addr, (uint8_t *)&slot, (uint32_t)MSG_SLOT_SIZE);
+    /* Read the full slot in one go: header into RAM, payload straight
+     * into data_out (at least MSG_SLOT_PAYLOAD_MAX bytes by contract).
+     */
+    frags[0].dst = (uint8_t *)&hdr;
+    frags[0].len = (uint16_t)sizeof(hdr);
+    frags[1].dst = data_out;
+    frags[1].len = (uint16_t)MSG_SLOT_PAYLOAD_MAX;
+    fram_readv(slot_addr, frags, 2u);
+
+    if ((hdr.flags & MSG_FLAG_WRAP) != 0u && slot_index != 0u) {
+        /* Record mode wrap marker: the message is at the ring start */
+        slot_index = 0u;
+        d.head     = 0u;
+        if (d.head == d.tail) {
+            mailbox_store_head(desc_addr, &d);
+            return 0u;
+        }
+        fram_readv(d.base, frags, 2u);
+    }
+
+    *src_id_out = hdr.src_id;
+
+    /* Check flags to distinguish multicast, normal and bulk messages */
+    if ((hdr.flags & MSG_FLAG_MCAST) != 0u) {
+        /* ---------- Reference to a shared multicast buffer ---------- */
+
+        uint8_t  buf;
+        uint16_t len;
 
-    *src_id_out = slot.src_id;
+        if (mailbox_mcast_decode(data_out, &buf, &len)) {
+            /* Caller must ensure data_out holds len bytes */
+            fram_read_bytes(mailbox_mcast_buf_addr(buf), data_out, len);
+            mailbox_mcast_release(buf);
+        }
+        *len_out = len;
 
-    /* Check flags to distinguish normal vs bulk message */
-    if ((slot.flags & MSG_FLAG_BULK) == 0u) {
+        slot_index = (uint16_t)(slot_index +
+                                mailbox_msg_units(d.msg_size, hdr.flags,
+                                                  mailbox_hdr_len(&hdr)));
+        if (slot_index >= slot_count) {
+            slot_index = (uint16_t)(slot_index - slot_count);
+        }
+        d.head = slot_index;
+    } else if ((hdr.flags & MSG_FLAG_BULK) == 0u) {
         /* ---------- Normal single-slot message ---------- */
 
-        uint8_t len = slot.len;
+        uint8_t len = hdr.len;
 
         if (len > MSG_SLOT_PAYLOAD_MAX) {
             /* Corrupt entry; drop this slot */
@@ -504,20 +1240,13 @@ uint8_t mailbox_recv_msg(uint8_t node_index,
         }
         *len_out = len;
 
-        /* Copy payload */
-        for (i = 0u; i < len; i++) {
-            data_out[i] = slot.payload[i];
-        }
-
-        /* Advance head by 1 slot and decrease used by 1 */
-        slot_index++;
+        /* Advance head by 1 slot (by the record in record mode) */
+        slot_index = (uint16_t)(slot_index +
+                                mailbox_msg_units(d.msg_size, 0u, hdr.len));
         if (slot_index >= slot_count) {
-            slot_index = 0u;
+            slot_index = (uint16_t)(slot_index - slot_count);
         }
         d.head = slot_index;
-        if (d.used > 0u) {
-            d.used--;
-        }
     } else {
         /* ---------- Bulk message (spans multiple slots) ---------- */
 
@@ -532,11 +1261,11 @@ uint8_t mailbox_recv_msg(uint8_t node_index,
          *   flags  (byte 1)
          *   total_len LSB (byte 2)
          *   total_len MSB (byte 3)
-         * msg_slot_t has: src_id, flags, len, reserved,
+         * msg_hdr_t has: src_id, flags, len, reserved,
          * so len and reserved hold the 16-bit total_len in bulk case.
          */
-        total_len = (uint16_t)slot.len |
-                    ((uint16_t)slot.reserved << 8);
+        total_len = (uint16_t)hdr.len |
+                    ((uint16_t)hdr.reserved << 8);
 
         if (total_len == 0u) {
             /* Corrupt bulk header; drop this slot */
@@ -547,11 +1276,8 @@ uint8_t mailbox_recv_msg(uint8_t node_index,
                 slot_index = 0u;
             }
             d.head = slot_index;
-            if (d.used > 0u) {
-                d.used--;
-            }
 
-            fram_write_bytes(desc_addr, (const uint8_t *)&d, (uint32_t)sizeof(d));
+            mailbox_store_head(desc_addr, &d);
             return 0u;
         }
 
@@ -559,31 +1285,41 @@ uint8_t mailbox_recv_msg(uint8_t node_index,
         bytes_total = (uint32_t)sizeof(bulk_header_t) +
                       (uint32_t)total_len;
 
-        /* Guard: corruption check vs ring size */
-        if (bytes_total > ring_size) {
-            /* Header claims more bytes than ring; drop everything */
+        /* Compute how many slots this bulk message consumed:
+         * used_slots = ceil(bytes_total / msg_size)
+         */
+        used_slots = (uint16_t)((bytes_total +
+                                (uint32_t)d.msg_size - 1u) /
+                                (uint32_t)d.msg_size);
+
+        /* Guard: corruption check vs ring size and queued slots */
+        if (bytes_total > ring_size ||
+            used_slots > mailbox_used_slots(&d, slot_count)) {
+            /* Header claims more than is queued; drop everything */
             *len_out = 0u;
-            d.used = 0u;
-            d.head = 0u;
-            fram_write_bytes(desc_addr, (const uint8_t *)&d, (uint32_t)sizeof(d));
+            mailbox_drop_queued(desc_addr, &d, slot_count);
             return 0u;
         }
 
-        /* Read bulk payload from ring, starting just after header.
+        /* The first MSG_SLOT_PAYLOAD_MAX payload bytes came in with the
+         * header slot; read the rest from the ring, wrapping as needed.
          * Header starts at offset: slot_index * msg_size.
          */
-        start_offset = (uint32_t)slot_index * (uint32_t)d.msg_size;
-        payload_pos  = start_offset + (uint32_t)sizeof(bulk_header_t);
-        if (payload_pos >= ring_size) {
-            payload_pos -= ring_size;
-        }
+        if (total_len > MSG_SLOT_PAYLOAD_MAX) {
+            start_offset = (uint32_t)slot_index * (uint32_t)d.msg_size;
+            payload_pos  = start_offset + (uint32_t)MSG_SLOT_SIZE;
+            if (payload_pos >= ring_size) {
+                payload_pos -= ring_size;
+            }
 
-        /* Read total_len bytes into data_out (caller must ensure buffer large enough). */
-        (void)mailbox_read_bytes_ring(d.base,
-                                      ring_size,
-                                      payload_pos,
-                                      data_out,
-                                      (uint32_t)total_len);
+            /* Caller must ensure data_out holds total_len bytes */
+            (void)mailbox_read_bytes_ring(d.base,
+                                          ring_size,
+                                          payload_pos,
+                                          data_out + MSG_SLOT_PAYLOAD_MAX,
+                                          (uint32_t)total_len -
+                                          (uint32_t)MSG_SLOT_PAYLOAD_MAX);
+        }
 
         /* Note: len_out is uint8_t, bulk length is uint16_t.
          * We store the lower 8 bits; if you need full length,
@@ -593,29 +1329,550 @@ uint8_t mailbox_recv_msg(uint8_t node_index,
         *len_out = total_len;
         // *len_out = (uint8_t)total_len;
 
-        /* Compute how many slots this bulk message consumed:
-         * used_slots = ceil(bytes_total / msg_size)
-         */
-        used_slots = (uint16_t)((bytes_total +
-                                (uint32_t)d.msg_size - 1u) /
-                                (uint32_t)d.msg_size);
-
-        /* Advance head and decrease used by used_slots */
+        /* Advance head by used_slots */
         slot_index = (uint16_t)(slot_index + used_slots);
         if (slot_index >= slot_count) {
             slot_index = (uint16_t)(slot_index - slot_count);
         }
         d.head = slot_index;
+    }
 
-        if (d.used >= used_slots) {
-            d.used = (uint16_t)(d.used - used_slots);
-        } else {
-            d.used = 0u;
+    /* Write back head */
+    mailbox_store_head(desc_addr, &d);
+
+    return 1u;
+}
+
+/* ------------ Batched receive ------------ */
+
+/* Slots taken by the message whose header starts at 'slot' */
+static uint16_t mailbox_msg_slots(const uint8_t *slot, uint16_t msg_size)
+{
+    const msg_hdr_t *h = (const msg_hdr_t *)slot;
+
+    return mailbox_msg_units(msg_size, h->flags, mailbox_hdr_len(h));
+}
+
+uint16_t mailbox_recv_batch(uint8_t node_index,
+                            uint8_t *buf,
+                            uint16_t buf_len,
+                            mailbox_iter_t *it)
+{
+    node_box_desc_t d;
+    const msg_hdr_t *h;
+    uint16_t slot_count;
+    uint16_t used;
+    uint16_t want;
+    uint16_t to_end;
+    uint16_t first;
+    uint16_t taken;
+    uint16_t msgs;
+    uint16_t n;
+    uint32_t desc_addr;
+
+    it->next     = buf;
+    it->wrap     = buf;
+    it->left     = 0u;
+    it->msg_size = MSG_SLOT_SIZE;
+
+    if (node_index >= MAILBOX_NUM_NODES) {
+        return 0u;
+    }
+
+    /* ---------- Read descriptors once, pick the lane ---------- */
+
+    desc_addr = mailbox_lane_desc_addr(node_index,
+                                       mailbox_pick_lane(node_index, &d));
+
+    slot_count = mailbox_slot_count(&d);
+    if (slot_count == 0u) {
+        return 0u;
+    }
+
+    for (;;) {
+        used = mailbox_used_slots(&d, slot_count);
+        if (used == 0u) {
+            return 0u;
+        }
+
+        want = (uint16_t)(buf_len / d.msg_size);
+        if (want > used) {
+            want = used;
         }
+        if (want == 0u) {
+            return 0u;
+        }
+
+        /* ---------- Used slots: up to the ring end, then from slot 0 ---------- */
+
+        to_end = (uint16_t)(slot_count - d.head);
+        first  = (to_end > want) ? want : to_end;
+        fram_read_bytes(d.base + ((uint32_t)d.head * (uint32_t)d.msg_size),
+                        buf,
+                        (uint32_t)first * (uint32_t)d.msg_size);
+        if (want > first) {
+            fram_read_bytes(d.base,
+                            buf + ((uint32_t)first * (uint32_t)d.msg_size),
+                            (uint32_t)(want - first) * (uint32_t)d.msg_size);
+        }
+
+        /* ---------- Keep whole messages only ---------- */
+
+        taken = 0u;
+        msgs  = 0u;
+        while (taken < want) {
+            h = (const msg_hdr_t *)(buf + ((uint32_t)taken * (uint32_t)d.msg_size));
+            if ((h->flags & MSG_FLAG_WRAP) != 0u) {
+                /* Wrap marker: the rest of the ring is unused */
+                n = (taken < to_end) ? (uint16_t)(to_end - taken) : slot_count;
+            } else {
+                n = mailbox_msg_slots((const uint8_t *)h, d.msg_size);
+            }
+            if ((uint32_t)taken + n > used) {
+                /* Header claims more slots than are queued: drop everything,
+                 * as mailbox_recv_msg() does for a corrupt bulk header.
+                 */
+                if (msgs == 0u) {
+                    mailbox_drop_queued(desc_addr, &d, slot_count);
+                    return 0u;
+                }
+                break;
+            }
+            if ((h->flags & MSG_FLAG_WRAP) != 0u) {
+                taken = (uint16_t)(taken + n);
+                continue;
+            }
+            if ((h->flags & MSG_FLAG_MCAST) != 0u ||
+                (uint16_t)(taken + n) > want) {
+                break;      /* multicast, or bulk that does not fit in buf */
+            }
+            taken = (uint16_t)(taken + n);
+            msgs++;
+        }
+
+        if (msgs != 0u || taken == 0u) {
+            break;
+        }
+
+        /* Only a wrap marker was drained: commit it, read again from 0 */
+        d.head = 0u;
+        mailbox_store_head(desc_addr, &d);
+    }
+
+    if (msgs == 0u) {
+        return 0u;
+    }
+
+    /* ---------- One head update ---------- */
+
+    d.head = (uint16_t)(d.head + taken);
+    if (d.head >= slot_count) {
+        d.head = (uint16_t)(d.head - slot_count);
+    }
+    mailbox_store_head(desc_addr, &d);
+
+    it->wrap     = buf + ((uint32_t)first * (uint32_t)d.msg_size);
+    it->left     = msgs;
+    it->msg_size = d.msg_size;
+    return msgs;
+}
+
+uint8_t mailbox_iter_next(mailbox_iter_t *it,
+                          uint8_t *src_id_out,
+                          uint16_t *len_out,
+                          const uint8_t **data_out)
+{
+    const msg_hdr_t *h;
+    uint16_t len;
+
+    if (it->left == 0u) {
+        return 0u;
     }
 
-    /* Write back descriptor */
-    fram_write_bytes(desc_addr, (const uint8_t *)&d, (uint32_t)sizeof(d));
+    if ((((const msg_hdr_t *)it->next)->flags & MSG_FLAG_WRAP) != 0u) {
+        it->next = it->wrap;
+    }
+    h = (const msg_hdr_t *)it->next;
+
+    len = mailbox_hdr_len(h);
+    if ((h->flags & MSG_FLAG_BULK) == 0u && len > MSG_SLOT_PAYLOAD_MAX) {
+        len = 0u;   /* corrupt entry */
+    }
+
+    *src_id_out = h->src_id;
+    *len_out    = len;
+    *data_out   = it->next + sizeof(msg_hdr_t);
+
+    it->next += (uint32_t)mailbox_msg_slots(it->next, it->msg_size) *
+                (uint32_t)it->msg_size;
+    it->left--;
 
     return 1u;
 }
+
+/* ------------ Zero-copy receive ------------ */
+
+uint8_t mailbox_peek(uint8_t node_index, mailbox_peek_t *hdr)
+{
+    msg_hdr_t h;
+    uint16_t slot_count;
+    uint16_t used;
+    uint32_t pos;
+
+    if (node_index >= MAILBOX_NUM_NODES) {
+        return 0u;
+    }
+
+    hdr->lane = mailbox_pick_lane(node_index, &hdr->desc);
+
+    slot_count = mailbox_slot_count(&hdr->desc);
+    if (slot_count == 0u) {
+        return 0u;
+    }
+    used = mailbox_used_slots(&hdr->desc, slot_count);
+    if (used == 0u) {
+        return 0u;
+    }
+
+    /* Header only */
+    pos = (uint32_t)hdr->desc.head * (uint32_t)hdr->desc.msg_size;
+    fram_read_bytes(hdr->desc.base + pos, (uint8_t *)&h, (uint32_t)sizeof(h));
+
+    if ((h.flags & MSG_FLAG_WRAP) != 0u &&
+        hdr->desc.head != 0u &&
+        (uint16_t)(slot_count - hdr->desc.head) < used) {
+        /* Wrap marker: the message is at the ring start; consume()
+         * commits the skip together with the message.
+         */
+        used = (uint16_t)(used - (slot_count - hdr->desc.head));
+        hdr->desc.head = 0u;
+        pos = 0u;
+        fram_read_bytes(hdr->desc.base, (uint8_t *)&h, (uint32_t)sizeof(h));
+    }
+
+    hdr->node_index = node_index;
+    hdr->src_id     = h.src_id;
+    hdr->flags      = h.flags;
+    hdr->slots      = mailbox_msg_slots((const uint8_t *)&h,
+                                        hdr->desc.msg_size);
+
+    if ((h.flags & MSG_FLAG_BULK) == 0u) {
+        hdr->len = h.len;
+        if (hdr->len > MSG_SLOT_PAYLOAD_MAX) {
+            hdr->len = 0u;      /* corrupt entry; consume drops the slot */
+        }
+    } else {
+        /* len/reserved hold total_len (see mailbox_recv_msg) */
+        hdr->len = (uint16_t)h.len | ((uint16_t)h.reserved << 8);
+        if (hdr->slots > used) {
+            /* Header claims more than is queued; consume drops everything */
+            hdr->len   = 0u;
+            hdr->slots = used;
+        }
+    }
+
+    pos += (uint32_t)sizeof(msg_hdr_t);
+    if (pos >= (uint32_t)hdr->desc.size) {
+        pos -= (uint32_t)hdr->desc.size;
+    }
+    hdr->payload_pos  = (uint16_t)pos;
+    hdr->payload_addr = hdr->desc.base + pos;
+
+    if ((h.flags & MSG_FLAG_MCAST) != 0u) {
+        /* Payload lives in a shared buffer: follow the reference */
+        uint8_t ref[sizeof(mailbox_mcast_ref_t)];
+        uint8_t buf;
+
+        fram_read_bytes(hdr->payload_addr, ref, (uint32_t)sizeof(ref));
+        (void)mailbox_mcast_decode(ref, &buf, &hdr->len);
+        hdr->payload_addr = mailbox_mcast_buf_addr(buf);
+    }
+
+    return 1u;
+}
+
+uint16_t mailbox_read_at(const mailbox_peek_t *hdr,
+                         uint16_t offset,
+                         uint8_t *dst,
+                         uint16_t n)
+{
+    uint32_t pos;
+
+    if (offset >= hdr->len) {
+        return 0u;
+    }
+    if (n > (uint16_t)(hdr->len - offset)) {
+        n = (uint16_t)(hdr->len - offset);
+    }
+
+    if ((hdr->flags & MSG_FLAG_MCAST) != 0u) {
+        fram_read_bytes(hdr->payload_addr + offset, dst, (uint32_t)n);
+        return n;
+    }
+
+    pos = (uint32_t)hdr->payload_pos + (uint32_t)offset;
+    if (pos >= (uint32_t)hdr->desc.size) {
+        pos -= (uint32_t)hdr->desc.size;
+    }
+
+    (void)mailbox_read_bytes_ring(hdr->desc.base,
+                                  (uint32_t)hdr->desc.size,
+                                  pos,
+                                  dst,
+                                  (uint32_t)n);
+    return n;
+}
+
+void mailbox_consume(const mailbox_peek_t *hdr)
+{
+    node_box_desc_t d = hdr->desc;
+    uint16_t slot_count = mailbox_slot_count(&d);
+
+    if ((hdr->flags & MSG_FLAG_BULK) != 0u && hdr->len == 0u &&
+        hdr->slots >= mailbox_used_slots(&d, slot_count)) {
+        /* Corrupt bulk header: mailbox_peek() set it to drop everything */
+        mailbox_drop_queued(mailbox_lane_desc_addr(hdr->node_index, hdr->lane),
+                            &d, slot_count);
+        return;
+    }
+
+    d.head = (uint16_t)(d.head + hdr->slots);
+    if (d.head >= slot_count) {
+        d.head = (uint16_t)(d.head - slot_count);
+    }
+
+    mailbox_store_head(mailbox_lane_desc_addr(hdr->node_index, hdr->lane), &d);
+
+    if ((hdr->flags & MSG_FLAG_MCAST) != 0u && hdr->len != 0u) {
+        mailbox_mcast_release((uint8_t)((hdr->payload_addr - mailbox_mcast_base()) /
+                                        MCAST_BUF_SIZE));
+    }
+}
+
+/* ------------ Streams ------------ */
+
+/* Queue one fragment (header + data) of stream s at the lane's tail */
+static uint8_t mailbox_stream_put(mailbox_stream_t *s,
+                                  uint32_t desc_addr,
+                                  node_box_desc_t *d,
+                                  uint16_t slot_count,
+                                  uint8_t  kind,
+                                  const uint8_t *data,
+                                  uint16_t len)
+{
+    mailbox_stream_hdr_t sh;
+    fram_wfrag_t frags[3];
+
+    sh.id   = s->id;
+    sh.kind = kind;
+    sh.seq  = s->seq;
+
+    frags[1].src = (const uint8_t *)&sh;
+    frags[1].len = (uint16_t)sizeof(sh);
+    frags[2].src = data;
+    frags[2].len = len;
+
+    if (!mailbox_put_recordv(desc_addr, d, slot_count, s->src_id,
+                             (uint8_t)(MSG_FLAG_BULK | MSG_FLAG_STREAM),
+                             frags, 3u)) {
+        return 0u;
+    }
+    s->seq++;
+    return 1u;
+}
+
+/* OPEN / CLOSE: a fragment carrying one 32-bit value */
+static uint8_t mailbox_stream_control(mailbox_stream_t *s,
+                                      uint8_t kind,
+                                      uint32_t value)
+{
+    node_box_desc_t d;
+    uint16_t slot_count;
+    uint32_t desc_addr;
+
+    desc_addr = mailbox_node_desc_addr(s->dest_index);
+    fram_read_bytes(desc_addr, (uint8_t *)&d, (uint32_t)sizeof(d));
+
+    slot_count = mailbox_slot_count(&d);
+    if (slot_count == 0u) {
+        return 0u;
+    }
+    if (!mailbox_stream_put(s, desc_addr, &d, slot_count, kind,
+                            (const uint8_t *)&value, (uint16_t)sizeof(value))) {
+        return 0u;
+    }
+
+    mailbox_notify(s->dest_index);
+    return 1u;
+}
+
+uint8_t mailbox_stream_open(mailbox_stream_t *s,
+                            uint8_t dest_index,
+                            uint8_t src_id,
+                            uint8_t id,
+                            uint32_t total_len)
+{
+    if (dest_index >= MAILBOX_NUM_NODES) {
+        return 0u;
+    }
+
+    s->dest_index = dest_index;
+    s->src_id     = src_id;
+    s->id         = id;
+    s->seq        = 0u;
+    s->sent       = 0u;
+
+    return mailbox_stream_control(s, MAILBOX_STREAM_KIND_OPEN, total_len);
+}
+
+uint16_t mailbox_stream_write(mailbox_stream_t *s,
+                              const uint8_t *data,
+                              uint16_t len)
+{
+    node_box_desc_t d;
+    uint16_t slot_count;
+    uint32_t desc_addr;
+    uint16_t done = 0u;
+    uint16_t chunk;
+
+    /* One descriptor read for all fragments of this call */
+    desc_addr = mailbox_node_desc_addr(s->dest_index);
+    fram_read_bytes(desc_addr, (uint8_t *)&d, (uint32_t)sizeof(d));
+
+    slot_count = mailbox_slot_count(&d);
+    if (slot_count == 0u) {
+        return 0u;
+    }
+
+    while (done < len) {
+        chunk = (uint16_t)(len - done);
+        if (chunk > MAILBOX_STREAM_FRAG_MAX) {
+            chunk = MAILBOX_STREAM_FRAG_MAX;
+        }
+        if (!mailbox_stream_put(s, desc_addr, &d, slot_count,
+                                MAILBOX_STREAM_KIND_DATA, &data[done], chunk)) {
+            break;      /* box full: the rest goes in a later call */
+        }
+        done = (uint16_t)(done + chunk);
+    }
+
+    if (done != 0u) {
+        s->sent += done;
+        mailbox_notify(s->dest_index);
+    }
+    return done;
+}
+
+uint8_t mailbox_stream_close(mailbox_stream_t *s)
+{
+    return mailbox_stream_control(s, MAILBOX_STREAM_KIND_CLOSE, s->sent);
+}
+
+/* Peek the head message: 1 if it is a stream fragment, with its stream
+ * header in *sh
+ */
+static uint8_t mailbox_stream_head(uint8_t node_index,
+                                   mailbox_peek_t *h,
+                                   mailbox_stream_hdr_t *sh)
+{
+    if (!mailbox_peek(node_index, h)) {
+        return 0u;
+    }
+    if ((h->flags & MSG_FLAG_STREAM) == 0u || h->len < sizeof(*sh)) {
+        return 0u;
+    }
+    (void)mailbox_read_at(h, 0u, (uint8_t *)sh, (uint16_t)sizeof(*sh));
+    return 1u;
+}
+
+uint8_t mailbox_stream_accept(mailbox_stream_reader_t *r,
+                              uint8_t node_index)
+{
+    mailbox_stream_hdr_t sh;
+    uint32_t total = 0u;
+
+    r->state    = MAILBOX_STREAM_IDLE;
+    r->have_cur = 0u;
+
+    if (!mailbox_stream_head(node_index, &r->cur, &sh) ||
+        sh.kind != MAILBOX_STREAM_KIND_OPEN || sh.seq != 0u) {
+        return 0u;
+    }
+    (void)mailbox_read_at(&r->cur, (uint16_t)sizeof(sh),
+                          (uint8_t *)&total, (uint16_t)sizeof(total));
+    mailbox_consume(&r->cur);
+
+    r->node_index = node_index;
+    r->src_id     = r->cur.src_id;
+    r->id         = sh.id;
+    r->total      = total;
+    r->received   = 0u;
+    r->seq        = 1u;
+    r->offset     = 0u;
+    r->state      = MAILBOX_STREAM_ACTIVE;
+    return 1u;
+}
+
+uint16_t mailbox_stream_read(mailbox_stream_reader_t *r,
+                             uint8_t *dst,
+                             uint16_t n)
+{
+    mailbox_stream_hdr_t sh;
+    uint32_t sent;
+    uint16_t done = 0u;
+    uint16_t chunk;
+
+    while (done < n && r->state == MAILBOX_STREAM_ACTIVE) {
+        if (!r->have_cur) {
+            /* Next fragment: must be this stream's, in sequence */
+            if (!mailbox_stream_head(r->node_index, &r->cur, &sh) ||
+                sh.id != r->id || r->cur.src_id != r->src_id) {
+                break;
+            }
+            if (sh.seq != r->seq) {
+                r->state = MAILBOX_STREAM_ERROR;
+                break;
+            }
+            if (sh.kind == MAILBOX_STREAM_KIND_CLOSE) {
+                sent = 0u;
+                (void)mailbox_read_at(&r->cur, (uint16_t)sizeof(sh),
+                                      (uint8_t *)&sent, (uint16_t)sizeof(sent));
+                mailbox_consume(&r->cur);
+                r->state = (sent == r->received &&
+                            (r->total == 0u || r->total == r->received))
+                           ? MAILBOX_STREAM_DONE : MAILBOX_STREAM_ERROR;
+                break;
+            }
+            if (sh.kind != MAILBOX_STREAM_KIND_DATA) {
+                r->state = MAILBOX_STREAM_ERROR;
+                break;
+            }
+            if (r->total != 0u &&
+                r->received + (uint32_t)(r->cur.len - sizeof(sh)) > r->total) {
+                /* More than was announced at OPEN */
+                r->state = MAILBOX_STREAM_ERROR;
+                break;
+            }
+            r->have_cur = 1u;
+            r->offset   = (uint16_t)sizeof(sh);
+        }
+
+        chunk = (uint16_t)(r->cur.len - r->offset);
+        if (chunk > (uint16_t)(n - done)) {
+            chunk = (uint16_t)(n - done);
+        }
+        chunk = mailbox_read_at(&r->cur, r->offset, &dst[done], chunk);
+
+        done        = (uint16_t)(done + chunk);
+        r->offset   = (uint16_t)(r->offset + chunk);
+        r->received += chunk;
+
+        if (r->offset >= r->cur.len) {
+            mailbox_consume(&r->cur);
+            r->have_cur = 0u;
+            r->seq++;
+        }
+    }
+
+    return done;
+}
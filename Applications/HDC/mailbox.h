@@ -3,24 +3,62 @@
 
 #include <stdint.h>
 
-/* Logical number of boxes defined in FRAM layout (4 total).
- * Your current hardware uses 3 nodes; the 4th is reserved for future.
+/* Number of boxes in the FRAM layout, one per node index. Set it with
+ * -DMAILBOX_NUM_NODES=n on every node (the layout table records it);
+ * 4 by default: the current hardware uses 3 nodes, the 4th is spare.
+ * Node and box bitmaps are mailbox_mask_t, so MAILBOX_MAX_NODES is the
+ * ceiling, as for the per-box notification flags and credit entries.
  */
+#ifndef MAILBOX_NUM_NODES
 #define MAILBOX_NUM_NODES      4u
+#endif
+#define MAILBOX_MAX_NODES      32u
 
-/* Per-node region in FRAM: 20 kB = 0x5000 bytes */
-#define NODE_BOX_SIZE          0x5000UL
+#if MAILBOX_NUM_NODES > MAILBOX_MAX_NODES
+#error "MAILBOX_NUM_NODES exceeds MAILBOX_MAX_NODES"
+#endif
 
-/* Node base addresses (4 boxes, 20 kB each) */
-#define NODE1_BASE             0x01000UL
-#define NODE2_BASE             0x06000UL
-#define NODE3_BASE             0x0B000UL
-#define NODE4_BASE             0x10000UL
+/* Bit k = node index / box k */
+typedef uint32_t mailbox_mask_t;
+#define MAILBOX_NODES_MASK \
+    ((mailbox_mask_t)(0xFFFFFFFFUL >> (MAILBOX_MAX_NODES - MAILBOX_NUM_NODES)))
+
+/* Box layout: mailbox_init_layout() reads the FRAM density (RDID) and
+ * splits everything from MAILBOX_BOXES_BASE to the end of the chip, less
+ * the multicast buffers that follow the last box, between the boxes in
+ * proportion to MAILBOX_BOX_WEIGHTS. The result is written as a
+ * mailbox_layout_t at MAILBOX_LAYOUT_ADDR; every node reads it once
+ * (mailbox_load_layout()) and keeps a copy.
+ */
+#define MAILBOX_LAYOUT_ADDR    0x00200UL   /* 0x00200..0x005FF */
+#define MAILBOX_LAYOUT_MAGIC   0x584F424DUL /* "MBOX" */
+#define MAILBOX_LAYOUT_VERSION 1u
+#define MAILBOX_BOXES_BASE     0x01000UL
+#define MAILBOX_BOX_ALIGN      0x0100UL
+#define MAILBOX_BOX_SIZE_MAX   0x10000UL   /* lane sizes are 16-bit */
+#define MAILBOX_FRAM_KB_MIN    64u
+#define MAILBOX_FRAM_KB_DEFAULT 128u       /* RDID not recognised */
+
+/* Relative box sizes, box 0 first; missing or zero entries count as 1.
+ * Only the node that runs mailbox_init_layout() uses them.
+ */
+#ifndef MAILBOX_BOX_WEIGHTS
+#define MAILBOX_BOX_WEIGHTS    { 1u }
+#endif
 
 /* Descriptor + data offsets within each box */
 #define NODE_DESC_OFFSET       0x0000UL
 #define NODE_DATA_OFFSET       0x0100UL
-#define NODE_BOX_DATA_SIZE     0x4F00UL   /* 0x5000 - 0x0100 = 0x4F00 (~20kB-256B) */
+
+/* Priority lanes: each box holds two rings, each with its own descriptor
+ * (lane k's at NODE_DESC_OFFSET + k * sizeof(node_box_desc_t)). Every
+ * receive call drains the high lane first, so control messages neither
+ * wait behind queued bulk data nor fail because the normal lane is full.
+ */
+#define MAILBOX_NUM_LANES      2u
+#define MAILBOX_PRIO_NORMAL    0u         /* data, bulk, multicast */
+#define MAILBOX_PRIO_HIGH      1u         /* control messages */
+#define NODE_HIGH_DATA_SIZE    0x0300UL   /* 11 messages, at the end of the box */
 
 /* Fixed-size message slots */
 #define MSG_SLOT_SIZE          64u 
@@ -28,6 +66,77 @@
 
 /* Flags in first-byte header */
 #define MSG_FLAG_BULK   0x01u
+#define MSG_FLAG_WRAP   0x02u   /* not a message: continue at ring offset 0 */
+#define MSG_FLAG_MCAST  0x04u   /* payload is a mailbox_mcast_ref_t */
+#define MSG_FLAG_STREAM 0x08u   /* bulk payload is a stream fragment */
+
+/* Ring modes (node_box_desc_t.mode), chosen per box by mailbox_init_layout().
+ * In record mode a message takes its 4-byte header plus payload rounded up
+ * to MAILBOX_REC_ALIGN bytes instead of whole MSG_SLOT_SIZE slots, and
+ * msg_size/head/tail count MAILBOX_REC_ALIGN-byte units. A record never
+ * crosses the ring end; a MSG_FLAG_WRAP marker sends the reader back to 0.
+ */
+#define MAILBOX_MODE_SLOTS     0u
+#define MAILBOX_MODE_RECORDS   1u
+#define MAILBOX_REC_ALIGN      4u
+
+/* Boxes set up in record mode: bit k = box k. Only mailbox_init_layout()
+ * reads it; the layout table and the descriptors carry each box's mode.
+ */
+#ifndef MAILBOX_RECORD_BOXES
+#define MAILBOX_RECORD_BOXES   0x0u
+#endif
+
+/* Slot mode: 1 = a bulk that would cross the ring end is put at slot 0
+ * after a MSG_FLAG_WRAP marker, so its header + payload is one FRAM
+ * burst each way; 0 = split it across the wrap (uses the box fully).
+ */
+#ifndef MAILBOX_CONTIG_BULK
+#define MAILBOX_CONTIG_BULK    1u
+#endif
+
+/* Shared multicast buffers, after the last box (mailbox_layout_t.mcast_base).
+ * mailbox_send_multicast() writes a payload once into a free buffer and
+ * puts a small reference in each destination box; the buffer's reference
+ * count (one byte per buffer at MCAST_REF_ADDR) is the number of boxes
+ * still pointing at it, and it is free again at 0.
+ */
+#define MCAST_REF_ADDR         0x00030UL   /* 0x00030..0x00033 */
+#define MCAST_NUM_BUFS         4u
+#define MCAST_BUF_SIZE         0x1400UL    /* 5 kB per buffer */
+
+/* Flow control: one mailbox_credit_t per box. A sender that finds the
+ * normal lane full registers with mailbox_want_space() and sleeps. The
+ * head index the receiver writes back as it drains is its credit: after
+ * every lock release the arbiter compares the free units against 'want',
+ * and once they suffice clears the entry and pulses GNT of each waiter.
+ */
+#define MAILBOX_CREDIT_ADDR    0x00040UL   /* 0x00040..0x0013F */
+#define MAILBOX_CREDIT_ADDR_OF(i) \
+    (MAILBOX_CREDIT_ADDR + (uint32_t)(i) * (uint32_t)sizeof(mailbox_credit_t))
+
+/* Streams: a transfer of any length (32-bit) sent as bulk fragments of
+ * up to MAILBOX_STREAM_FRAG_MAX bytes, each led by a mailbox_stream_hdr_t.
+ * The sender queues fragments while the box has room and the receiver
+ * reads them in pieces of any size, so neither side holds the whole
+ * transfer anywhere. Fragments are numbered from 0 (the OPEN fragment);
+ * a gap, or a byte count that does not match the CLOSE fragment or the
+ * length announced at OPEN, fails the stream.
+ */
+#ifndef MAILBOX_STREAM_FRAG_MAX
+#define MAILBOX_STREAM_FRAG_MAX   1024u
+#endif
+
+/* mailbox_stream_hdr_t.kind */
+#define MAILBOX_STREAM_KIND_OPEN  0u   /* payload: uint32_t total length (0: unknown) */
+#define MAILBOX_STREAM_KIND_DATA  1u
+#define MAILBOX_STREAM_KIND_CLOSE 2u   /* payload: uint32_t bytes sent */
+
+/* mailbox_stream_reader_t.state */
+#define MAILBOX_STREAM_IDLE       0u
+#define MAILBOX_STREAM_ACTIVE     1u
+#define MAILBOX_STREAM_DONE       2u   /* CLOSE seen, byte counts matched */
+#define MAILBOX_STREAM_ERROR      3u   /* fragment missing or count mismatch */
 
 /* Bulk header placed at the start of the first slot.
  * The bytes immediately following this header are raw payload bytes.
@@ -40,15 +149,58 @@ typedef struct {
 } bulk_header_t;
 
 
-/* Descriptor stored at NODEk_BASE + NODE_DESC_OFFSET */
+/* Payload of an MSG_FLAG_MCAST message */
+typedef struct {
+    uint8_t  buf;       /* shared buffer index */
+    uint8_t  reserved;
+    uint16_t len;       /* payload bytes in the buffer */
+} mailbox_mcast_ref_t;
+
+/* Leads the payload of every MSG_FLAG_STREAM fragment */
+typedef struct {
+    uint8_t  id;        /* stream id, chosen by the sender */
+    uint8_t  kind;      /* MAILBOX_STREAM_KIND_* */
+    uint16_t seq;       /* fragment number, 0 = OPEN */
+} mailbox_stream_hdr_t;
+
+/* Flow-control entry of one box, at MAILBOX_CREDIT_ADDR_OF(box) */
+typedef struct {
+    mailbox_mask_t waiters;  /* bit k = node index k is blocked on this box */
+    uint16_t       want;     /* free units the largest waiter needs */
+    uint16_t       reserved;
+} mailbox_credit_t;
+
+/* One box of the layout table */
+typedef struct {
+    uint32_t base;      /* box start; descriptors at NODE_DESC_OFFSET */
+    uint32_t size;      /* whole box in bytes, descriptors included */
+    uint16_t msg_size;  /* MSG_SLOT_SIZE, or MAILBOX_REC_ALIGN in record mode */
+    uint16_t mode;      /* MAILBOX_MODE_SLOTS / MAILBOX_MODE_RECORDS */
+} mailbox_box_entry_t;
+
+/* Layout table at MAILBOX_LAYOUT_ADDR, written by mailbox_init_layout() */
+typedef struct {
+    uint32_t magic;       /* MAILBOX_LAYOUT_MAGIC */
+    uint8_t  version;     /* MAILBOX_LAYOUT_VERSION */
+    uint8_t  num_nodes;   /* entries in box[] */
+    uint16_t fram_kb;     /* chip size the layout was planned for */
+    uint32_t mcast_base;  /* MCAST_NUM_BUFS buffers of MCAST_BUF_SIZE */
+    mailbox_box_entry_t box[MAILBOX_NUM_NODES];
+} mailbox_layout_t;
+
+/* Descriptor stored at box base + NODE_DESC_OFFSET.
+ * head is written only by the receiver and tail only by senders, each in
+ * its own word, so either side updates the box with one 2-byte write.
+ * Occupancy is (tail - head) mod slot count; one slot is always left
+ * free so that head == tail means empty.
+ */
 typedef struct {
     uint32_t base;      /* absolute FRAM address of data region */
-    uint16_t size;      /* total size in bytes (NODE_BOX_DATA_SIZE) */
+    uint16_t size;      /* lane size in bytes */
+    uint16_t msg_size;  /* slot size in bytes (MSG_SLOT_SIZE) */
     uint16_t head;      /* slot index of next message to read */
+    uint16_t mode;      /* MAILBOX_MODE_SLOTS / MAILBOX_MODE_RECORDS */
     uint16_t tail;      /* slot index of next free slot to write */
-    uint16_t used;      /* number of slots currently used */
-    uint16_t msg_size;  /* slot size in bytes (MSG_SLOT_SIZE) */
-    uint16_t reserved0;
     uint16_t reserved1;
 } node_box_desc_t;
 
@@ -61,30 +213,119 @@ typedef struct {
     uint8_t  payload[MSG_SLOT_PAYLOAD_MAX];
 } msg_slot_t;
 
+typedef struct {
+    uint8_t src_id;
+    uint8_t flags;
+    uint8_t len;
+    uint8_t reserved;
+} msg_hdr_t;
+
+/* Messages drained by mailbox_recv_batch(), returned in order by
+ * mailbox_iter_next(). Points into the caller's buffer.
+ */
+typedef struct {
+    const uint8_t *next;        /* header of the next message */
+    const uint8_t *wrap;        /* data read from ring offset 0 */
+    uint16_t       left;        /* messages not yet returned */
+    uint16_t       msg_size;
+} mailbox_iter_t;
+
+/* Head message of a box as returned by mailbox_peek(); nothing but the
+ * header has been read. Pass it to mailbox_read_at() / mailbox_consume().
+ */
+typedef struct {
+    uint8_t  src_id;
+    uint8_t  flags;         /* MSG_FLAG_BULK for bulk messages */
+    uint16_t len;           /* payload bytes */
+    uint32_t payload_addr;  /* FRAM address of payload byte 0 */
+    uint16_t payload_pos;   /* same, as offset into the ring at desc.base
+                             * (except for MSG_FLAG_MCAST messages) */
+    uint16_t slots;         /* slots the message occupies */
+    uint8_t  node_index;
+    uint8_t  lane;          /* MAILBOX_PRIO_* lane the message is in */
+    node_box_desc_t desc;   /* descriptor as read by mailbox_peek() */
+} mailbox_peek_t;
+
+/* Sending end of a stream, set up by mailbox_stream_open() */
+typedef struct {
+    uint32_t sent;          /* payload bytes queued so far */
+    uint16_t seq;           /* number of the next fragment */
+    uint8_t  dest_index;
+    uint8_t  src_id;
+    uint8_t  id;
+} mailbox_stream_t;
+
+/* Receiving end of a stream, set up by mailbox_stream_accept(). Only the
+ * receiver moves its box's head, so the fragment being read stays valid
+ * while the lock is released between reads.
+ */
+typedef struct {
+    mailbox_peek_t cur;     /* fragment being read */
+    uint32_t total;         /* length announced at OPEN (0: unknown) */
+    uint32_t received;      /* payload bytes read so far */
+    uint16_t seq;           /* number of the next fragment expected */
+    uint16_t offset;        /* read position in cur */
+    uint8_t  node_index;
+    uint8_t  src_id;
+    uint8_t  id;
+    uint8_t  state;         /* MAILBOX_STREAM_* */
+    uint8_t  have_cur;
+} mailbox_stream_reader_t;
+
+/* One entry of a mailbox_send_batch() request */
+typedef struct {
+    const uint8_t *data;
+    uint8_t        len;     /* 1..MSG_SLOT_PAYLOAD_MAX */
+} mailbox_msg_t;
+
+
+
 /* Layout helpers */
 uint32_t mailbox_node_box_base(uint8_t node_index);
 uint32_t mailbox_node_desc_addr(uint8_t node_index);
 uint32_t mailbox_node_data_base(uint8_t node_index);
+uint32_t mailbox_node_box_size(uint8_t node_index);
 
-/* One-time init: sets up descriptors for all 4 boxes, clears notification byte. */
+/* One-time init: plans the layout from the FRAM's RDID, writes the layout
+ * table, sets up descriptors for all boxes, clears notification flags.
+ */
 void mailbox_init_layout(void);
 
+/* Reads the layout table into this node's copy. Returns 1 if a valid
+ * table was found; otherwise 0, and the layout helpers keep using the
+ * default plan and try again on their next call.
+ */
+uint8_t mailbox_load_layout(void);
+
 /* Send fixed-size message into dest node's box.
  * dest_index: 0..MAILBOX_NUM_NODES-1
  * src_id    : logical sender ID (1..N)
  * data      : payload (len bytes)
  * len       : payload length (<= MSG_SLOT_PAYLOAD_MAX)
+ * prio      : MAILBOX_PRIO_NORMAL, or MAILBOX_PRIO_HIGH for control
+ *             messages that must overtake queued data
  * Returns 1 on success, 0 on failure (queue full or bad args).
  * Must be called only while holding global FRAM lock.
- *
- * Backwards-compatible behaviour with your existing code.
  */
 uint8_t mailbox_send_msg(uint8_t dest_index,
                          uint8_t src_id,
                          const uint8_t *data,
-                         uint8_t len);
+                         uint8_t len,
+                         uint8_t prio);
 
-/* Receive one message from this node's own box.
+/* Batched send: queue msgs[0..count-1] into dest's box as consecutive
+ * slots, with one descriptor read, one descriptor write and one
+ * notification for the whole batch.
+ * Returns the number of messages queued: fewer than count if the box
+ * fills up or msgs[k] has a bad length (messages from k on are not sent).
+ * Must be called only while holding global FRAM lock.
+ */
+uint8_t mailbox_send_batch(uint8_t dest_index,
+                           uint8_t src_id,
+                           const mailbox_msg_t *msgs,
+                           uint8_t count);
+
+/* Receive one message from this node's own box, high lane first.
  * node_index: this node's index (0..)
  * src_id_out: set to source ID
  * len_out   : set to payload length
@@ -97,6 +338,68 @@ uint8_t mailbox_recv_msg(uint8_t node_index,
                          uint16_t *len_out,
                          uint8_t *data_out);
 
+/* Batched receive: drain as many whole messages as fit in buf from one
+ * lane of this node's own box (the high lane if it is not empty), with
+ * one descriptor read, one or two slot bursts (two if the run wraps) and
+ * one descriptor write.
+ * buf_len   : bytes available; whole slots are read, so at least
+ *             MSG_SLOT_SIZE. A bulk message is taken only if all of its
+ *             slots fit, and a batch stops at a multicast message;
+ *             returns 0 with the box non-empty if the head message is
+ *             one of those, use mailbox_recv_msg() for it then.
+ * it        : set up for mailbox_iter_next()
+ * Returns the number of messages drained (0 if none).
+ * Must be called only while holding global FRAM lock; the iterator stays
+ * valid after the lock is released (it only reads buf).
+ */
+uint16_t mailbox_recv_batch(uint8_t node_index,
+                            uint8_t *buf,
+                            uint16_t buf_len,
+                            mailbox_iter_t *it);
+
+/* Next drained message: data_out points into the batch buffer.
+ * Returns 1 while messages remain, 0 at the end.
+ */
+uint8_t mailbox_iter_next(mailbox_iter_t *it,
+                          uint8_t *src_id_out,
+                          uint16_t *len_out,
+                          const uint8_t **data_out);
+
+/* Zero-copy receive: look at the head message of this node's own box
+ * (high lane first) without reading its payload.
+ * Returns 1 and fills hdr if a message is queued, 0 if box empty.
+ * The payload (which may wrap around the ring end) is then fetched in
+ * pieces of any size with mailbox_read_at(), and the message dropped
+ * with mailbox_consume(). The FRAM lock must be held from the peek
+ * through the consume.
+ */
+uint8_t mailbox_peek(uint8_t node_index, mailbox_peek_t *hdr);
+
+/* Read n payload bytes starting at payload offset 'offset'.
+ * Returns the number of bytes read (clamped to hdr->len).
+ */
+uint16_t mailbox_read_at(const mailbox_peek_t *hdr,
+                         uint16_t offset,
+                         uint8_t *dst,
+                         uint16_t n);
+
+/* Remove the peeked message from the box (one descriptor write). */
+void mailbox_consume(const mailbox_peek_t *hdr);
+
+/* Multicast send: write data once into a shared buffer and queue a
+ * 4-byte reference to it in every box in dest_mask (bit k = box k).
+ * Receivers get it like a bulk message from mailbox_recv_msg() (or via
+ * mailbox_peek()/mailbox_read_at()); the last one frees the buffer.
+ * total_len : 1..MCAST_BUF_SIZE
+ * Returns the mask of boxes that got the message: 0 if no buffer is free
+ * or bad args, without the bits of boxes that were full.
+ * Must be called while holding the FRAM lock.
+ */
+mailbox_mask_t mailbox_send_multicast(mailbox_mask_t dest_mask,
+                                      uint8_t src_id,
+                                      const uint8_t *data,
+                                      uint16_t total_len);
+
 /* Bulk send:
  *  - data:      contiguous buffer of total_len bytes
  *  - total_len: total payload bytes
@@ -108,4 +411,61 @@ uint8_t mailbox_send_bulk(uint8_t dest_index,
                           const uint8_t *data,
                           uint16_t total_len);
 
+/* Flow control, after a send to dest's normal lane found it full:
+ * register node_index as waiting until a message of len payload bytes
+ * (a bulk if len > MSG_SLOT_PAYLOAD_MAX) fits. The arbiter then sends a
+ * notification pulse, like for new mail.
+ * Returns 1 if registered: release the lock, wait for the pulse, retry.
+ * Returns 0 if it fits already (retry now) or never will: too big for
+ * the box, or dest is node_index's own box.
+ * Must be called while holding the FRAM lock.
+ */
+uint8_t mailbox_want_space(uint8_t dest_index,
+                           uint8_t node_index,
+                           uint16_t len);
+
+/* Returns 1 if a send raised a notification flag since the last call,
+ * and clears that. The lock is released so the arbiter knows whether to
+ * read the flags: call it once per lock hold, at release.
+ */
+uint8_t mailbox_take_notified(void);
+
+/* Streams, sending end (normal lane; hold the FRAM lock for each call).
+ * mailbox_stream_open : queue the OPEN fragment announcing total_len
+ *                       (0 if not known up front) in dest's box.
+ *                       Returns 1, or 0 if the box is full (call again).
+ * mailbox_stream_write: queue data as fragments while the box has room.
+ *                       Returns the bytes queued; if fewer than len, wait
+ *                       for space (mailbox_want_space() with a length of
+ *                       MAILBOX_STREAM_FRAG_MAX + sizeof(mailbox_stream_hdr_t))
+ *                       and write the rest.
+ * mailbox_stream_close: queue the CLOSE fragment. Returns 1, or 0 if the
+ *                       box is full (call again).
+ */
+uint8_t mailbox_stream_open(mailbox_stream_t *s,
+                            uint8_t dest_index,
+                            uint8_t src_id,
+                            uint8_t id,
+                            uint32_t total_len);
+uint16_t mailbox_stream_write(mailbox_stream_t *s,
+                              const uint8_t *data,
+                              uint16_t len);
+uint8_t mailbox_stream_close(mailbox_stream_t *s);
+
+/* Streams, receiving end (hold the FRAM lock for each call).
+ * mailbox_stream_accept: if the head message of this node's box opens a
+ *                        stream, take it and set up r. Returns 1, or 0
+ *                        if it does not (nothing is consumed then).
+ * mailbox_stream_read  : read up to n payload bytes in order. Returns
+ *                        the bytes read; fewer than n when the sender has
+ *                        not caught up, the head message belongs to
+ *                        something else (receive it the usual way), or
+ *                        r->state has left MAILBOX_STREAM_ACTIVE.
+ */
+uint8_t mailbox_stream_accept(mailbox_stream_reader_t *r,
+                              uint8_t node_index);
+uint16_t mailbox_stream_read(mailbox_stream_reader_t *r,
+                             uint8_t *dst,
+                             uint16_t n);
+
 #endif /* MAILBOX_H_ */
@@ -15,8 +15,24 @@
 /* Total cooperating MCUs */
 #define N_NODES       3u      /* change to 3 or 4 later */
 
-/* Node ID: 0 .. N_NODES-1 (set individually per build) */
+/* Node ID: 0 .. N_NODES-1 (set individually per build, or -DNODE_ID=k) */
+#ifndef NODE_ID
 #define NODE_ID       0u
+#endif
+
+/* Lock session on node 0 while slices arrive: the grant is kept this
+ * long after a receive, so a slice that is already there is read
+ * without a new REQ/GNT round trip. A sender that asks for the bus
+ * meanwhile gets it at once (the arbiter's nudge, ARB_NUDGE_HOLDER).
+ */
+#define SESSION_IDLE_US   20000u
+
+/* 1: print the result on UART0 and return from main() when done, for
+ * runs on the host simulator (IPC/SPI_Sim_Linux, make run-hdc)
+ */
+#ifndef HDC_REPORT
+#define HDC_REPORT    0u
+#endif
 
 /* MNIST image size */
 #define IMG_W         28u
@@ -51,6 +67,7 @@ void timer_start(void){
  * COMMUNICATION STUBS (YOU FILL THESE)
  * ================================================================ */
 
+#if NODE_ID != 0
 /* Now takes uint8_t* slice (BYTES_PER_NODE bytes) */
 static void send_hv_slice_to_node0(const uint8_t *slice)
 {
@@ -60,10 +77,14 @@ static void send_hv_slice_to_node0(const uint8_t *slice)
     resp = mailbox_send_bulk(0u, NODE_ID, slice, BYTES_PER_NODE);
     // __delay_cycles(40000); // small delay (switch to level based)
     // uart0_println("Send failed");
-    lock_release();
+    lock_session_done();    /* plain release outside a session */
     if (!resp) {P4OUT |= BIT6; P1OUT |= BIT0;}
+#if HDC_REPORT
+    uart0_println(resp ? "Slice sent" : "Send failed");
+#endif
 
 }
+#endif
 
 #if NODE_ID == 0
 /* Now receives uint8_t* slice (BYTES_PER_NODE bytes) */
@@ -75,7 +96,7 @@ static uint8_t recv_hv_slice_from_node(uint8_t *src, uint8_t *dst)
     uint8_t resp = 1;
     resp = mailbox_recv_msg(0u, src, &len, dst);
 
-    lock_release();
+    lock_session_done();
     return resp;
 }
 #endif
@@ -286,13 +307,13 @@ static void node_run(void)
     timer_start();
     e1 = TA0R;
     /* For N_NODES == 1 this loop is skipped (no remote nodes). */
-    
+    lock_session_begin(SESSION_IDLE_US, 0u);
     while (counter < (uint8_t)(N_NODES - 1u))
     {
 
         if (!recv_hv_slice_from_node(&src, my_slice)) {
-            /* No message yet; you can spin, sleep, or just retry */
-            __delay_cycles(500000u);
+            /* No message yet: sleep until a sender's mail pulse */
+            node_wait_mail();
             continue;
         }
 
@@ -319,6 +340,7 @@ static void node_run(void)
 
         // __delay_cycles(16000000u);
     }
+    lock_session_end();
 
     e1 = TA0R - e1;
     /* Now img_hv_full[] contains the full HV_DIM_BITS final HV */
@@ -328,6 +350,21 @@ static void node_run(void)
     uint8_t predicted = classify_image();
     e2 = TA0R - e2;
 
+#if HDC_REPORT
+    uart0_print("Predicted class: ");
+    uart0_print_uint(predicted);
+    uart0_println("");
+    uart0_print("Communication time (microseconds): ");
+    uart0_print_uint(e1*8u);
+    uart0_println("");
+    uart0_print("Classification time (microseconds): ");
+    uart0_print_uint(e2*8u);
+    uart0_println("");
+    uart0_print("Session yields to waiting senders: ");
+    uart0_print_uint(lock_session_yields());
+    uart0_println("");
+#endif
+
     // uart0_print("Predicted class: ");
     // uart0_print_uint(predicted);
     // uart0_println("");
@@ -368,6 +405,9 @@ int main(void)
     /* TODO: clock / UART / SPI init */
     clock_init_8mhz();
     // uart0_init();
+#if HDC_REPORT
+    uart0_init();
+#endif
     node_gpio_init();
 
 
@@ -387,7 +427,9 @@ int main(void)
     // uart0_println("HyperCam HDC Node Starting...");
 
     node_run();
+#if !HDC_REPORT
     __bis_SR_register(LPM0_bits | GIE);
+#endif
     
 }
 
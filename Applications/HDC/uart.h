@@ -4,7 +4,6 @@
 #include <stdint.h>
 
 void uart0_init(void);
-static void uart0_send(char c);
 void uart0_print(const char *s);
 void uart0_println(const char *s);
 void uart0_print_uint(uint32_t num);
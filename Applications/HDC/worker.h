@@ -3,28 +3,110 @@
 
 #include <stdint.h>
 
-/* REQ = P1.4, GNT = P1.3 */
+/* Worker side of the REQ/GNT lock, shared by main.c, the evals and
+ * Applications/HDC (an identical copy there): GPIO and clock setup, the
+ * Timer_A1 GNT decoder and the lock API. Node IDs here are the arbiter's
+ * (1..NUM_NODES).
+ */
+
+/* REQ = P1.4, GNT = P1.3 (TA1.2) */
 #define NODE_REQ_PIN    BIT4
 #define NODE_GNT_PIN    BIT3
-#define NODE_GNT_IV     0x08    /* P1.3 in P1IV */
 
 typedef enum {
     LOCK_IDLE = 0,
     LOCK_WAIT_GRANT,
-    LOCK_HELD
+    LOCK_HELD,
+    LOCK_REVOKED,       /* lease check not answered: the bus is gone */
+    LOCK_HANDED         /* granted by another node's lock_release_to() */
 } lock_state_t;
 
-
-
+typedef void (*lock_callback_t)(void);
 
 void clock_init_8mhz(void);
 void node_gpio_init(void);
 void node_pulse_req_line(void);
 void node_pulse_reset_on_gnt(void);
 
+/* Sleep until a mail or space-available pulse comes (or one came since
+ * the last call)
+ */
+void node_wait_mail(void);
+
 /* ---- Lock API ---- */
 
+/* SPI clock divider used while the lock is held (SMCLK / div) */
+void lock_set_spi_div(uint8_t div);
+
 void lock_acquire(void);
+
+/* Release on REQ if no flag was raised under this hold: the arbiter then
+ * has nothing to read. After a send it is a GNT pulse, on which the
+ * arbiter reads the flags (and an empty handoff byte).
+ */
 void lock_release(void);
-    
+
+/* Release the bus straight to node_id: the arbiter grants it next, ahead
+ * of its queue, and that grant is also its mail pulse. For request /
+ * response exchanges: send, then hand the bus to the peer, which needs no
+ * REQ of its own to read the message. Costs one 1-byte FRAM write.
+ */
+void lock_release_to(uint8_t node_id);
+
+/* Wait at most timeout_us (Timer_A1, 1 MHz) for the grant; 1 if held.
+ * On 0 the request stays queued at the arbiter and the grant is given
+ * back as soon as it arrives, unless another acquire call comes first.
+ */
+uint8_t lock_try_acquire(uint16_t timeout_us);
+
+/* Post REQ and return at once. When the grant arrives the GNT interrupt
+ * wakes the CPU and the next lock_poll() from the main loop runs cb with
+ * the lock held; cb must release it (lock_release() or
+ * lock_session_done()). lock_release() before the grant cancels, and a
+ * blocking acquire takes the request over.
+ */
+void lock_acquire_async(lock_callback_t cb);
+
+/* Run a granted async callback; 1 if one ran */
+uint8_t lock_poll(void);
+
+/* Ask for one more lease period: the arbiter's next lease check is
+ * answered instead of ending the grant. Call ahead of work that may
+ * outlast the arbiter's ARB_LEASE_TICKS.
+ */
+void lock_extend_lease(void);
+
+/* Non-zero if the lease ran out under the current grant: FRAM accesses
+ * since then were dropped, so their results are not valid. Release as
+ * usual; the next acquire asks for the bus again.
+ */
+uint8_t lock_revoked(void);
+
+/* A send to box dest failed because it is full: register box id for a
+ * "space available" wakeup, hand the bus back and sleep until the
+ * arbiter's next notification pulse, then take the bus again. Called and
+ * returns with the lock held; 0 if the message fits already or never can
+ * (retry once, or give up).
+ */
+uint8_t lock_wait_space(uint8_t dest, uint8_t id, uint16_t len);
+
+/* ---- Lock sessions ----
+ *
+ * A session keeps the grant after an operation, so a burst of them pays
+ * for one REQ/GNT round trip instead of one each. Wrap every operation in
+ * lock_acquire() / lock_session_done(): the lock is released idle_us
+ * microseconds after the last one (Timer_A1), after max_ops operations
+ * (0 = no limit), or at once when the arbiter pulses the holder because
+ * another node waits (the arbiter's nudge, ARB_NUDGE_HOLDER) or its lease
+ * ran out. Keep idle_us well below the arbiter's lease: a lease check in
+ * the middle of an operation revokes the grant unless it was extended.
+ * lock_session_end() releases and goes back to one grant per operation.
+ */
+void lock_session_begin(uint16_t idle_us, uint8_t max_ops);
+void lock_session_done(void);
+void lock_session_end(void);
+
+/* Times a session gave the bus up early because another node waited */
+uint16_t lock_session_yields(void);
+
 #endif /* WORKER_H_ */
@@ -169,6 +169,12 @@ void fram_read_id(uint8_t *id, uint8_t len)
 {
     uint8_t i;
 
+    if (len == 0u) {
+        return;
+    }
+
+    spi_init(SPI_CLK_DIV);
+
     FRAM_CS_LOW();
     spi_transfer(FRAM_CMD_RDID);
     for (i = len; i > 0u; i--) {
@@ -176,6 +182,7 @@ void fram_read_id(uint8_t *id, uint8_t len)
         id++;
     }
     FRAM_CS_HIGH();
+    spi_deinit();
 }
 
 uint8_t fram_init(void)
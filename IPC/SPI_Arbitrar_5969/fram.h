@@ -3,8 +3,19 @@
 
 #include <stdint.h>
 
-/* FRAM notification register addresses (global) */
-#define FRAM_NOTIF_BOX_ADDR   0x00010UL   /* bit i: node i's box has new data */
+/* FRAM notification flags (global): one byte per destination box,
+ * non-zero = box i has new data. Senders set their destination's flag
+ * with a single blind write; the arbiter reads and clears the array in
+ * one burst each.
+ */
+#define FRAM_NOTIF_BOX_ADDR      0x00010UL   /* flag for box 0 */
+#define FRAM_NOTIF_MAX_NODES     32u         /* 0x00010..0x0002F */
+#define FRAM_NOTIF_FLAG_ADDR(i)  (FRAM_NOTIF_BOX_ADDR + (uint32_t)(i))
+
+/* Directed release: the node ID the holder hands the bus to (0 = none),
+ * right below the flags so that the arbiter reads both in one burst
+ */
+#define FRAM_HANDOFF_ADDR        0x0000FUL
 #define SPI_CLK_DIV           16u
 
 /* API */
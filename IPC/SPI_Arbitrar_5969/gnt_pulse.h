@@ -0,0 +1,64 @@
+#ifndef GNT_PULSE_H_
+#define GNT_PULSE_H_
+
+#include <stdint.h>
+
+/* GNT pulse codes, shared by the arbiter and every worker build. The
+ * copies in SPI_Arbitrar_5969 and Applications/HDC are kept identical
+ * (SPI_Sim_Linux checks them).
+ *
+ * The arbiter codes the pulses it drives by width, in MCLK cycles:
+ *   GNT_PULSE_GRANT_CYCLES    grant, or lease check to the holder
+ *   GNT_PULSE_MAIL_CYCLES     "you have mail" / "space available", or
+ *                             the nudge of a holder (ARB_NUDGE_HOLDER)
+ *   GNT_PULSE_HANDOFF_CYCLES  grant and mail at once, for the node named
+ *                             by the holder's lock_release_to()
+ */
+#define GNT_PULSE_GRANT_CYCLES      50u
+#define GNT_PULSE_MAIL_CYCLES       150u
+#define GNT_PULSE_HANDOFF_CYCLES    400u
+
+/* Workers drive GNT back to the arbiter, which sees the rising edge and,
+ * while a lease check is out, samples the line GNT_PULSE_RENEW_SAMPLE
+ * cycles into its port ISR:
+ *   GNT_PULSE_RELEASE_CYCLES  release after raising flags or to a node
+ *                             named in FRAM, or the reset notice
+ *   GNT_PULSE_RENEW_CYCLES    answer to a lease check: one more lease
+ * The renewal outlasts the sample by more than the arbiter's longest
+ * interrupt latency, a release is over long before it.
+ */
+#define GNT_PULSE_RELEASE_CYCLES    50u
+#define GNT_PULSE_RENEW_CYCLES      1000u
+#define GNT_PULSE_RENEW_SAMPLE \
+    ((GNT_PULSE_RELEASE_CYCLES + GNT_PULSE_RENEW_CYCLES) / 2u)
+
+/* Workers capture both GNT edges on TA1.2 with Timer_A1 at SMCLK/8
+ * (1 us ticks) and decode the width at the falling edge; the limits sit
+ * halfway between the codes
+ */
+#define GNT_CAPTURE_DIV             8u
+#define GNT_PULSE_MAIL_MIN \
+    ((GNT_PULSE_GRANT_CYCLES + GNT_PULSE_MAIL_CYCLES) / 2u / GNT_CAPTURE_DIV)
+#define GNT_PULSE_HANDOFF_MIN \
+    ((GNT_PULSE_MAIL_CYCLES + GNT_PULSE_HANDOFF_CYCLES) / 2u / GNT_CAPTURE_DIV)
+
+typedef enum {
+    GNT_PULSE_GRANT = 0,
+    GNT_PULSE_MAIL,
+    GNT_PULSE_HANDOFF,
+    GNT_PULSE_LOST          /* both edges went by before the ISR (COV) */
+} gnt_pulse_t;
+
+/* Pulse code of a captured width, in Timer_A1 ticks */
+static inline gnt_pulse_t gnt_pulse_decode(uint16_t ticks)
+{
+    if (ticks >= GNT_PULSE_HANDOFF_MIN) {
+        return GNT_PULSE_HANDOFF;
+    }
+    if (ticks >= GNT_PULSE_MAIL_MIN) {
+        return GNT_PULSE_MAIL;
+    }
+    return GNT_PULSE_GRANT;
+}
+
+#endif /* GNT_PULSE_H_ */
@@ -1,22 +1,103 @@
 #include <msp430.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "fram.h"
 #include "mailbox.h"
 
-/* Global notification byte in FRAM (bit i => node i has new messages) */
-#define FRAM_NOTIF_BYTE_ADDR   FRAM_NOTIF_BOX_ADDR
+/* ---- Layout ---- */
 
-/* ---- Layout helpers ---- */
+static const uint8_t mailbox_box_weights[] = MAILBOX_BOX_WEIGHTS;
+
+/* Planned and published at boot by mailbox_init_layout() */
+static mailbox_layout_t mailbox_layout;
+
+static uint8_t mailbox_box_weight(uint8_t node_index)
+{
+    if (node_index < sizeof(mailbox_box_weights) &&
+        mailbox_box_weights[node_index] != 0u) {
+        return mailbox_box_weights[node_index];
+    }
+    return 1u;
+}
+
+/* Chip size from the RDID bytes (manufacturer, continuation code, product
+ * ID with log2 of the size in kB in its low 5 bits), 0 if not recognised.
+ */
+static uint16_t mailbox_fram_kb(void)
+{
+    uint8_t id[4];
+    uint8_t density;
+
+    fram_read_id(id, (uint8_t)sizeof(id));
+    if (id[0] == 0x00u || id[0] == 0xFFu || id[1] != 0x7Fu) {
+        return 0u;
+    }
+
+    density = (uint8_t)(id[2] & 0x1Fu);
+    if (density > 14u) {            /* beyond 3-byte addressing */
+        return 0u;
+    }
+    return (uint16_t)(1u << density);
+}
+
+/* Boxes back to back from MAILBOX_BOXES_BASE, each a weighted share of
+ * the chip (rounded down to MAILBOX_BOX_ALIGN, capped at
+ * MAILBOX_BOX_SIZE_MAX), then the multicast buffers.
+ */
+static void mailbox_plan_layout(mailbox_layout_t *l, uint16_t fram_kb)
+{
+    uint32_t avail;
+    uint32_t share;
+    uint32_t base;
+    uint32_t size;
+    uint16_t weight_sum;
+    uint8_t i;
+
+    if (fram_kb < MAILBOX_FRAM_KB_MIN) {
+        fram_kb = MAILBOX_FRAM_KB_DEFAULT;
+    }
+
+    l->magic     = MAILBOX_LAYOUT_MAGIC;
+    l->version   = MAILBOX_LAYOUT_VERSION;
+    l->num_nodes = MAILBOX_NUM_NODES;
+    l->fram_kb   = fram_kb;
+
+    avail = (uint32_t)fram_kb * 1024UL - MAILBOX_BOXES_BASE -
+            (uint32_t)MCAST_NUM_BUFS * MCAST_BUF_SIZE;
+
+    weight_sum = 0u;
+    for (i = 0u; i < MAILBOX_NUM_NODES; i++) {
+        weight_sum = (uint16_t)(weight_sum + mailbox_box_weight(i));
+    }
+    share = avail / weight_sum;
+
+    base = MAILBOX_BOXES_BASE;
+    for (i = 0u; i < MAILBOX_NUM_NODES; i++) {
+        size = (share * mailbox_box_weight(i)) & ~(MAILBOX_BOX_ALIGN - 1UL);
+        if (size > MAILBOX_BOX_SIZE_MAX) {
+            size = MAILBOX_BOX_SIZE_MAX;
+        }
+
+        l->box[i].base = base;
+        l->box[i].size = size;
+        if (((MAILBOX_RECORD_BOXES >> i) & 1u) != 0u) {
+            l->box[i].mode     = MAILBOX_MODE_RECORDS;
+            l->box[i].msg_size = MAILBOX_REC_ALIGN;
+        } else {
+            l->box[i].mode     = MAILBOX_MODE_SLOTS;
+            l->box[i].msg_size = MSG_SLOT_SIZE;
+        }
+        base += size;
+    }
+    l->mcast_base = base;
+}
 
 uint32_t mailbox_node_box_base(uint8_t node_index)
 {
-    switch (node_index) {
-    case 0u: return NODE1_BASE;
-    case 1u: return NODE2_BASE;
-    case 2u: return NODE3_BASE;
-    case 3u: return NODE4_BASE;
-    default: return NODE1_BASE; /* default */
+    if (node_index >= MAILBOX_NUM_NODES) {
+        node_index = 0u;
     }
+    return mailbox_layout.box[node_index].base;
 }
 
 uint32_t mailbox_node_desc_addr(uint8_t node_index)
@@ -33,34 +114,72 @@ uint32_t mailbox_node_data_base(uint8_t node_index)
 
 static void mailbox_init_one_node(uint8_t node_index)
 {
-    node_box_desc_t d;
+    const mailbox_box_entry_t *b = &mailbox_layout.box[node_index];
+    node_box_desc_t d[MAILBOX_NUM_LANES];
+    uint32_t normal_size;
+    uint8_t lane;
+
+    for (lane = 0u; lane < MAILBOX_NUM_LANES; lane++) {
+        d[lane].head      = 0u;
+        d[lane].tail      = 0u;
+        d[lane].reserved1 = 0u;
+        d[lane].mode      = b->mode;
+        d[lane].msg_size  = b->msg_size;
+    }
+
+    normal_size = b->size - NODE_DATA_OFFSET - NODE_HIGH_DATA_SIZE;
 
-    d.base      = mailbox_node_data_base(node_index);
-    d.size      = (uint16_t)NODE_BOX_DATA_SIZE;
-    d.head      = 0u;
-    d.tail      = 0u;
-    d.used      = 0u;
-    d.msg_size  = MSG_SLOT_SIZE;
-    d.reserved0 = 0u;
-    d.reserved1 = 0u;
-
-    fram_write_bytes(mailbox_node_desc_addr(node_index),
-                     (const uint8_t *)&d,
+    d[MAILBOX_PRIO_NORMAL].base = b->base + NODE_DATA_OFFSET;
+    d[MAILBOX_PRIO_NORMAL].size = (uint16_t)normal_size;
+    d[MAILBOX_PRIO_HIGH].base   = b->base + NODE_DATA_OFFSET + normal_size;
+    d[MAILBOX_PRIO_HIGH].size   = (uint16_t)NODE_HIGH_DATA_SIZE;
+
+    /* Lane descriptors are adjacent: one write */
+    fram_write_bytes(b->base + NODE_DESC_OFFSET,
+                     (const uint8_t *)d,
                      (uint32_t)sizeof(d));
 }
 
 void mailbox_init_layout(void)
 {
     uint8_t i;
-    uint8_t zero = 0u;
+    uint8_t zero[FRAM_NOTIF_MAX_NODES];
+    mailbox_credit_t none = { 0u, 0u, 0u };
+
+    /* Size the boxes to the chip and publish the table */
+    mailbox_plan_layout(&mailbox_layout, mailbox_fram_kb());
+    fram_write_bytes(MAILBOX_LAYOUT_ADDR, (const uint8_t *)&mailbox_layout,
+                     (uint32_t)sizeof(mailbox_layout));
 
-    /* Init all 4 boxes */
     for (i = 0u; i < MAILBOX_NUM_NODES; i++) {
         mailbox_init_one_node(i);
     }
 
-    /* Clear notification byte */
-    fram_write_bytes(FRAM_NOTIF_BYTE_ADDR, &zero, 1u);
+    /* Clear all notification flags */
+    for (i = 0u; i < FRAM_NOTIF_MAX_NODES; i++) {
+        zero[i] = 0u;
+    }
+    fram_write_bytes(FRAM_NOTIF_BOX_ADDR, zero, FRAM_NOTIF_MAX_NODES);
+
+    /* All multicast buffers free */
+    fram_write_bytes(MCAST_REF_ADDR, zero, MCAST_NUM_BUFS);
+
+    /* No sender waiting for space */
+    for (i = 0u; i < MAILBOX_NUM_NODES; i++) {
+        fram_write_bytes(MAILBOX_CREDIT_ADDR_OF(i), (const uint8_t *)&none,
+                         (uint32_t)sizeof(none));
+    }
+}
+
+void mailbox_reset_box(uint8_t node_index)
+{
+    uint8_t zero = 0u;
+
+    if (node_index >= MAILBOX_NUM_NODES) {
+        return;
+    }
+    mailbox_init_one_node(node_index);
+    fram_write_bytes(FRAM_NOTIF_FLAG_ADDR(node_index), &zero, 1u);
 }
 
 /* ---- Internal helpers ---- */
@@ -80,12 +199,22 @@ static uint16_t mailbox_slot_count(const node_box_desc_t *d)
     return count;
 }
 
+/* Occupied slots; head == tail means empty (one slot is kept free) */
+static uint16_t mailbox_used_slots(const node_box_desc_t *d, uint16_t slot_count)
+{
+    if (d->tail >= d->head) {
+        return (uint16_t)(d->tail - d->head);
+    }
+    return (uint16_t)(slot_count - d->head + d->tail);
+}
+
 /* ---- Public send/recv ---- */
 
 uint8_t mailbox_send_msg(uint8_t dest_index,
                          uint8_t src_id,
                          const uint8_t *data,
-                         uint8_t len)
+                         uint8_t len,
+                         uint8_t prio)
 {
     node_box_desc_t d;
     msg_slot_t slot;
@@ -93,26 +222,27 @@ uint8_t mailbox_send_msg(uint8_t dest_index,
     uint16_t slot_index;
     uint32_t desc_addr;
     uint32_t slot_addr;
-    uint8_t  notif;
+    uint8_t  flag = 1u;
 
     if (dest_index >= MAILBOX_NUM_NODES) {
         return 0u;
     }
-    if (len > MSG_SLOT_PAYLOAD_MAX) {
+    if (len > MSG_SLOT_PAYLOAD_MAX || prio >= MAILBOX_NUM_LANES) {
         return 0u;
     }
 
-    /* Read descriptor */
-    desc_addr = mailbox_node_desc_addr(dest_index);
+    /* Read the lane's descriptor */
+    desc_addr = mailbox_node_desc_addr(dest_index) +
+                ((uint32_t)prio * (uint32_t)sizeof(node_box_desc_t));
     fram_read_bytes(desc_addr, (uint8_t *)&d, (uint32_t)sizeof(d));
 
     slot_count = mailbox_slot_count(&d);
-    if (slot_count == 0u) {
+    if (slot_count == 0u || d.mode != MAILBOX_MODE_SLOTS) {
         return 0u;
     }
 
     /* Queue full? */
-    if (d.used >= slot_count) {
+    if (mailbox_used_slots(&d, slot_count) + 1u >= slot_count) {
         return 0u;
     }
 
@@ -141,21 +271,20 @@ uint8_t mailbox_send_msg(uint8_t dest_index,
     /* Write slot to FRAM */
     fram_write_bytes(slot_addr, (const uint8_t *)&slot, (uint32_t)MSG_SLOT_SIZE);
 
-    /* Advance tail and used */
+    /* Advance tail */
     slot_index++;
     if (slot_index >= slot_count) {
         slot_index = 0u;
     }
     d.tail = slot_index;
-    d.used++;
 
-    /* Write back descriptor */
-    fram_write_bytes(desc_addr, (const uint8_t *)&d, (uint32_t)sizeof(d));
+    /* Write back tail only (senders own it) */
+    fram_write_bytes(desc_addr + (uint32_t)offsetof(node_box_desc_t, tail),
+                     (const uint8_t *)&d.tail,
+                     (uint32_t)sizeof(d.tail));
 
-    /* Set notification bit for this dest node */
-    fram_read_bytes(FRAM_NOTIF_BYTE_ADDR, &notif, 1u);
-    notif |= (uint8_t)(1u << dest_index);
-    fram_write_bytes(FRAM_NOTIF_BYTE_ADDR, &notif, 1u);
+    /* Set notification flag for this dest node (blind write) */
+    fram_write_bytes(FRAM_NOTIF_FLAG_ADDR(dest_index), &flag, 1u);
 
     return 1u;
 }
@@ -173,22 +302,29 @@ uint8_t mailbox_recv_msg(uint8_t node_index,
     uint32_t slot_addr;
     uint8_t  i;
     uint8_t  len;
+    node_box_desc_t lanes[MAILBOX_NUM_LANES];
 
     if (node_index >= MAILBOX_NUM_NODES) {
         return 0u;
     }
 
-    /* Read descriptor */
+    /* Read both lane descriptors, serve the high lane first */
     desc_addr = mailbox_node_desc_addr(node_index);
-    fram_read_bytes(desc_addr, (uint8_t *)&d, (uint32_t)sizeof(d));
+    fram_read_bytes(desc_addr, (uint8_t *)lanes, (uint32_t)sizeof(lanes));
+
+    d = lanes[MAILBOX_PRIO_NORMAL];
+    if (lanes[MAILBOX_PRIO_HIGH].head != lanes[MAILBOX_PRIO_HIGH].tail) {
+        d = lanes[MAILBOX_PRIO_HIGH];
+        desc_addr += (uint32_t)MAILBOX_PRIO_HIGH * (uint32_t)sizeof(node_box_desc_t);
+    }
 
     slot_count = mailbox_slot_count(&d);
-    if (slot_count == 0u) {
+    if (slot_count == 0u || d.mode != MAILBOX_MODE_SLOTS) {
         return 0u;
     }
 
     /* Empty? */
-    if (d.used == 0u) {
+    if (d.head == d.tail) {
         return 0u;
     }
 
@@ -214,18 +350,60 @@ uint8_t mailbox_recv_msg(uint8_t node_index,
         data_out[i] = slot.payload[i];
     }
 
-    /* Advance head and decrease used */
+    /* Advance head */
     slot_index++;
     if (slot_index >= slot_count) {
         slot_index = 0u;
     }
     d.head = slot_index;
-    if (d.used > 0u) {
-        d.used--;
-    }
 
-    /* Write back descriptor */
-    fram_write_bytes(desc_addr, (const uint8_t *)&d, (uint32_t)sizeof(d));
+    /* Write back head only (the receiver owns it) */
+    fram_write_bytes(desc_addr + (uint32_t)offsetof(node_box_desc_t, head),
+                     (const uint8_t *)&d.head,
+                     (uint32_t)sizeof(d.head));
 
     return 1u;
 }
+
+/* ---- Flow control ---- */
+
+mailbox_mask_t mailbox_collect_wakeups(void)
+{
+    mailbox_credit_t c[MAILBOX_NUM_NODES];
+    node_box_desc_t d;
+    mailbox_mask_t wake = 0u;
+    uint16_t slot_count;
+    uint16_t used;
+    uint16_t free_units;
+    uint8_t  idx;
+
+    /* One burst for all entries; boxes without waiters cost nothing more */
+    fram_read_bytes(MAILBOX_CREDIT_ADDR, (uint8_t *)c, (uint32_t)sizeof(c));
+
+    for (idx = 0u; idx < MAILBOX_NUM_NODES; idx++) {
+        if (c[idx].waiters == 0u) {
+            continue;
+        }
+
+        /* The head the receiver wrote back is its credit */
+        fram_read_bytes(mailbox_node_desc_addr(idx), (uint8_t *)&d,
+                        (uint32_t)sizeof(d));
+        slot_count = mailbox_slot_count(&d);
+        used       = mailbox_used_slots(&d, slot_count);
+        if (used >= slot_count) {
+            continue;   /* no box, or corrupt indices */
+        }
+        free_units = (uint16_t)(slot_count - 1u - used);
+        if (free_units < c[idx].want) {
+            continue;
+        }
+
+        wake |= c[idx].waiters;
+        c[idx].waiters = 0u;
+        c[idx].want    = 0u;
+        fram_write_bytes(MAILBOX_CREDIT_ADDR_OF(idx), (const uint8_t *)&c[idx],
+                         (uint32_t)sizeof(c[idx]));
+    }
+
+    return wake;
+}
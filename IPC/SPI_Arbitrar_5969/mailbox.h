@@ -3,38 +3,119 @@
 
 #include <stdint.h>
 
-/* Logical number of boxes defined in FRAM layout (4 total).
- * Your current hardware uses 3 nodes; the 4th is reserved for future.
+/* Number of boxes in the FRAM layout, one per node index. Set it with
+ * -DMAILBOX_NUM_NODES=n on every node (the layout table records it);
+ * 4 by default: the current hardware uses 3 nodes, the 4th is spare.
+ * Node and box bitmaps are mailbox_mask_t, so MAILBOX_MAX_NODES is the
+ * ceiling, as for the per-box notification flags and credit entries.
  */
+#ifndef MAILBOX_NUM_NODES
 #define MAILBOX_NUM_NODES      4u
+#endif
+#define MAILBOX_MAX_NODES      32u
 
-/* Per-node region in FRAM: 20 kB = 0x5000 bytes */
-#define NODE_BOX_SIZE          0x5000UL
+#if MAILBOX_NUM_NODES > MAILBOX_MAX_NODES
+#error "MAILBOX_NUM_NODES exceeds MAILBOX_MAX_NODES"
+#endif
 
-/* Node base addresses (4 boxes, 20 kB each) */
-#define NODE1_BASE             0x01000UL
-#define NODE2_BASE             0x06000UL
-#define NODE3_BASE             0x0B000UL
-#define NODE4_BASE             0x10000UL
+/* Bit k = node index / box k */
+typedef uint32_t mailbox_mask_t;
+#define MAILBOX_NODES_MASK \
+    ((mailbox_mask_t)(0xFFFFFFFFUL >> (MAILBOX_MAX_NODES - MAILBOX_NUM_NODES)))
+
+/* Box layout, planned from the FRAM's RDID by mailbox_init_layout() and
+ * published as a mailbox_layout_t (see the worker's mailbox.h).
+ */
+#define MAILBOX_LAYOUT_ADDR    0x00200UL   /* 0x00200..0x005FF */
+#define MAILBOX_LAYOUT_MAGIC   0x584F424DUL /* "MBOX" */
+#define MAILBOX_LAYOUT_VERSION 1u
+#define MAILBOX_BOXES_BASE     0x01000UL
+#define MAILBOX_BOX_ALIGN      0x0100UL
+#define MAILBOX_BOX_SIZE_MAX   0x10000UL   /* lane sizes are 16-bit */
+#define MAILBOX_FRAM_KB_MIN    64u
+#define MAILBOX_FRAM_KB_DEFAULT 128u       /* RDID not recognised */
+
+/* Relative box sizes, box 0 first; missing or zero entries count as 1 */
+#ifndef MAILBOX_BOX_WEIGHTS
+#define MAILBOX_BOX_WEIGHTS    { 1u }
+#endif
 
 /* Descriptor + data offsets within each box */
 #define NODE_DESC_OFFSET       0x0000UL
 #define NODE_DATA_OFFSET       0x0100UL
-#define NODE_BOX_DATA_SIZE     0x4F00UL   /* 0x5000 - 0x0100 = 0x4F00 (~20kB-256B) */
+
+/* Priority lanes: each box holds two rings, each with its own descriptor
+ * (lane k's at NODE_DESC_OFFSET + k * sizeof(node_box_desc_t)). Every
+ * receive call drains the high lane first, so control messages neither
+ * wait behind queued bulk data nor fail because the normal lane is full.
+ */
+#define MAILBOX_NUM_LANES      2u
+#define MAILBOX_PRIO_NORMAL    0u         /* data, bulk, multicast */
+#define MAILBOX_PRIO_HIGH      1u         /* control messages */
+#define NODE_HIGH_DATA_SIZE    0x0300UL   /* 11 messages, at the end of the box */
 
 /* Fixed-size message slots */
 #define MSG_SLOT_SIZE          64u
 #define MSG_SLOT_PAYLOAD_MAX   (MSG_SLOT_SIZE - 4u)
 
-/* Descriptor stored at NODEk_BASE + NODE_DESC_OFFSET */
+/* Ring modes (node_box_desc_t.mode), chosen per box by mailbox_init_layout().
+ * Record-mode boxes (byte-granular, see the worker's mailbox.h) are only
+ * served by the worker mailbox code; send/recv here handle slot mode.
+ */
+#define MAILBOX_MODE_SLOTS     0u
+#define MAILBOX_MODE_RECORDS   1u
+#define MAILBOX_REC_ALIGN      4u
+
+/* Boxes set up in record mode: bit k = box k. Only mailbox_init_layout()
+ * reads it; the layout table and the descriptors carry each box's mode.
+ */
+#ifndef MAILBOX_RECORD_BOXES
+#define MAILBOX_RECORD_BOXES   0x0u
+#endif
+
+/* Multicast buffer reference counts (see the worker's mailbox.h) */
+#define MCAST_REF_ADDR         0x00030UL   /* 0x00030..0x00033 */
+#define MCAST_NUM_BUFS         4u
+#define MCAST_BUF_SIZE         0x1400UL    /* placed after the last box */
+
+/* Flow control: per-box waiting senders (see the worker's mailbox.h).
+ * The arbiter wakes them once the receiver has freed 'want' units.
+ */
+#define MAILBOX_CREDIT_ADDR    0x00040UL   /* 0x00040..0x0013F */
+#define MAILBOX_CREDIT_ADDR_OF(i) \
+    (MAILBOX_CREDIT_ADDR + (uint32_t)(i) * (uint32_t)sizeof(mailbox_credit_t))
+
+/* One box of the layout table */
+typedef struct {
+    uint32_t base;      /* box start; descriptors at NODE_DESC_OFFSET */
+    uint32_t size;      /* whole box in bytes, descriptors included */
+    uint16_t msg_size;  /* MSG_SLOT_SIZE, or MAILBOX_REC_ALIGN in record mode */
+    uint16_t mode;      /* MAILBOX_MODE_SLOTS / MAILBOX_MODE_RECORDS */
+} mailbox_box_entry_t;
+
+/* Layout table at MAILBOX_LAYOUT_ADDR */
+typedef struct {
+    uint32_t magic;       /* MAILBOX_LAYOUT_MAGIC */
+    uint8_t  version;     /* MAILBOX_LAYOUT_VERSION */
+    uint8_t  num_nodes;   /* entries in box[] */
+    uint16_t fram_kb;     /* chip size the layout was planned for */
+    uint32_t mcast_base;  /* MCAST_NUM_BUFS buffers of MCAST_BUF_SIZE */
+    mailbox_box_entry_t box[MAILBOX_NUM_NODES];
+} mailbox_layout_t;
+
+/* Descriptor stored at box base + NODE_DESC_OFFSET.
+ * head is written only by the receiver and tail only by senders, each in
+ * its own word, so either side updates the box with one 2-byte write.
+ * Occupancy is (tail - head) mod slot count; one slot is always left
+ * free so that head == tail means empty.
+ */
 typedef struct {
     uint32_t base;      /* absolute FRAM address of data region */
-    uint16_t size;      /* total size in bytes (NODE_BOX_DATA_SIZE) */
+    uint16_t size;      /* lane size in bytes */
+    uint16_t msg_size;  /* slot size in bytes (MSG_SLOT_SIZE) */
     uint16_t head;      /* slot index of next message to read */
+    uint16_t mode;      /* MAILBOX_MODE_SLOTS / MAILBOX_MODE_RECORDS */
     uint16_t tail;      /* slot index of next free slot to write */
-    uint16_t used;      /* number of slots currently used */
-    uint16_t msg_size;  /* slot size in bytes (MSG_SLOT_SIZE) */
-    uint16_t reserved0;
     uint16_t reserved1;
 } node_box_desc_t;
 
@@ -47,28 +128,44 @@ typedef struct {
     uint8_t  payload[MSG_SLOT_PAYLOAD_MAX];
 } msg_slot_t;
 
+/* Flow-control entry of one box, at MAILBOX_CREDIT_ADDR_OF(box) */
+typedef struct {
+    mailbox_mask_t waiters;  /* bit k = node index k is blocked on this box */
+    uint16_t       want;     /* free units the largest waiter needs */
+    uint16_t       reserved;
+} mailbox_credit_t;
+
 /* Layout helpers */
 uint32_t mailbox_node_box_base(uint8_t node_index);
 uint32_t mailbox_node_desc_addr(uint8_t node_index);
 uint32_t mailbox_node_data_base(uint8_t node_index);
 
-/* One-time init: sets up descriptors for all 4 boxes, clears notification byte. */
+/* One-time init: plans the layout from the FRAM's RDID, writes the layout
+ * table, sets up descriptors for all boxes, clears notification flags.
+ */
 void mailbox_init_layout(void);
 
+/* Empty one box (both lanes) and clear its notification flag, e.g. after
+ * its owner lost the bus halfway through an update. Bus must be free.
+ */
+void mailbox_reset_box(uint8_t node_index);
+
 /* Send fixed-size message into dest node's box.
  * dest_index: 0..MAILBOX_NUM_NODES-1
  * src_id    : logical sender ID (1..N)
  * data      : payload (len bytes)
  * len       : payload length (<= MSG_SLOT_PAYLOAD_MAX)
+ * prio      : MAILBOX_PRIO_NORMAL or MAILBOX_PRIO_HIGH (lane)
  * Returns 1 on success, 0 on failure (queue full or bad args).
  * Must be called only while holding global FRAM lock.
  */
 uint8_t mailbox_send_msg(uint8_t dest_index,
                          uint8_t src_id,
                          const uint8_t *data,
-                         uint8_t len);
+                         uint8_t len,
+                         uint8_t prio);
 
-/* Receive one message from this node's own box.
+/* Receive one message from this node's own box, high lane first.
  * node_index: this node's index (0..)
  * src_id_out: set to source ID
  * len_out   : set to payload length
@@ -81,4 +178,11 @@ uint8_t mailbox_recv_msg(uint8_t node_index,
                          uint8_t *len_out,
                          uint8_t *data_out);
 
+/* Flow control: clear the credit entry of every box whose normal lane
+ * now has the free units its waiters asked for.
+ * Returns the senders to wake, bit k = node index k.
+ * Must be called only while no node holds the FRAM lock.
+ */
+mailbox_mask_t mailbox_collect_wakeups(void);
+
 #endif /* MAILBOX_H_ */
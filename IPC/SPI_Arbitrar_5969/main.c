@@ -28,26 +28,168 @@
 #include <msp430.h>
 #include <stdint.h>
 #include "fram.h"
+#include "gnt_pulse.h"
 #include "mailbox.h"
 #include "uart.h"
 
-/* Arbiter supports 3 physical nodes for now */
+/* ---- Node pin map ----
+ *
+ * One row per worker in node index order (row k serves node ID k + 1):
+ *     X(index, REQ port, REQ pin, GNT port, GNT pin)
+ * Rows 0..2 are the wiring drawn above; the others use the remaining
+ * interrupt-capable pins of the FR5969 (P1-P4). NUM_NODES picks how many
+ * rows are live. GPIO setup, GNT pulses and the port ISRs' decode are all
+ * generated from this table, so adding a worker is adding a row (and its
+ * port vector, on a part with more than four interrupt ports).
+ */
+#ifndef ARB_NODE_PINS
+#define ARB_NODE_PINS(X) \
+    X( 0, 1, 4, 1, 3)   /* node  1: REQ P1.4, GNT P1.3 */ \
+    X( 1, 1, 2, 3, 0)   /* node  2: REQ P1.2, GNT P3.0 */ \
+    X( 2, 3, 5, 3, 6)   /* node  3: REQ P3.5, GNT P3.6 */ \
+    X( 3, 3, 1, 3, 2)   /* node  4: REQ P3.1, GNT P3.2 */ \
+    X( 4, 3, 3, 3, 4)   /* node  5: REQ P3.3, GNT P3.4 */ \
+    X( 5, 2, 3, 2, 4)   /* node  6: REQ P2.3, GNT P2.4 */ \
+    X( 6, 2, 5, 2, 6)   /* node  7: REQ P2.5, GNT P2.6 */ \
+    X( 7, 4, 0, 4, 1)   /* node  8: REQ P4.0, GNT P4.1 */ \
+    X( 8, 4, 2, 4, 3)   /* node  9: REQ P4.2, GNT P4.3 */ \
+    X( 9, 4, 4, 4, 5)   /* node 10: REQ P4.4, GNT P4.5 */ \
+    X(10, 3, 7, 4, 7)   /* node 11: REQ P3.7, GNT P4.7 */ \
+    X(11, 1, 1, 2, 7)   /* node 12: REQ P1.1, GNT P2.7 */
+#endif
+
+/* Workers served; node IDs are 1..NUM_NODES */
+#ifndef NUM_NODES
 #define NUM_NODES    3u
+#endif
+
+#define ARB_PIN_ROW(i, rp, rb, gp, gb)  + 1u
+#define ARB_PIN_ROWS (0u ARB_NODE_PINS(ARB_PIN_ROW))
+
+#if NUM_NODES > ARB_PIN_ROWS
+#error "NUM_NODES exceeds the rows of ARB_NODE_PINS"
+#endif
+#if NUM_NODES > MAILBOX_NUM_NODES
+#error "every node needs a box: raise MAILBOX_NUM_NODES"
+#endif
+
+#define ARB_NUM_PORTS     4u
+#define ARB_NODE_ID(idx)  ((uint8_t)((idx) + 1u))
+#define ARB_NODE_BIT(id)  ((mailbox_mask_t)1u << ((id) - 1u))
+
+/* ---- Scheduling policy ----
+ *
+ * Which waiting node the next grant goes to:
+ *   FCFS      arrival order
+ *   PRIORITY  highest ARB_NODE_PRIORITIES entry, arrival order on ties
+ *   DRR       deficit round-robin: each visit at the head of the queue
+ *             adds weight * ARB_DRR_QUANTUM ticks, a grant needs a
+ *             positive deficit and is charged the bus time it really used
+ *   EDF       earliest deadline, the deadline being the REQ time plus
+ *             the node's ARB_NODE_DEADLINES entry
+ * Times are Timer_A0 ticks (SMCLK / 64 = 8 us); the per-node tables are
+ * in node index order and missing entries take the default.
+ */
+#define ARB_SCHED_FCFS      0u
+#define ARB_SCHED_PRIORITY  1u
+#define ARB_SCHED_DRR       2u
+#define ARB_SCHED_EDF       3u
+
+#ifndef ARB_SCHED_POLICY
+#define ARB_SCHED_POLICY    ARB_SCHED_FCFS
+#endif
+#if ARB_SCHED_POLICY > ARB_SCHED_EDF
+#error "unknown ARB_SCHED_POLICY"
+#endif
+
+/* Higher is served first; default 0 */
+#ifndef ARB_NODE_PRIORITIES
+#define ARB_NODE_PRIORITIES { 0u }
+#endif
+
+/* DRR share of bus time; missing or zero entries count as 1 */
+#ifndef ARB_NODE_WEIGHTS
+#define ARB_NODE_WEIGHTS    { 1u }
+#endif
+#ifndef ARB_DRR_QUANTUM
+#define ARB_DRR_QUANTUM     125u      /* 1 ms */
+#endif
+
+/* EDF: REQ-to-grant deadline; missing or zero entries use the default */
+#ifndef ARB_NODE_DEADLINES
+#define ARB_NODE_DEADLINES  { 0u }
+#endif
+#ifndef ARB_DEADLINE_DEFAULT
+#define ARB_DEADLINE_DEFAULT 1250u    /* 10 ms */
+#endif
+
+/* Hold-time budget per grant; 0 = none. A holder that overruns it owes
+ * the excess: under PRIORITY it loses to every node that does not owe,
+ * under EDF its next deadline moves out by the excess, and DRR charges
+ * the whole hold anyway. FCFS only counts the overrun.
+ */
+#ifndef ARB_NODE_BUDGETS
+#define ARB_NODE_BUDGETS    { 0u }
+#endif
+
+/* ---- Lock lease ----
+ *
+ * Every grant is a lease of ARB_LEASE_TICKS, timed by TA0CCR0. At expiry
+ * the holder's GNT line is pulsed as a lease check (a holder gets no
+ * other pulse, but the nudge below). A holder that asked for more time
+ * (lock_extend_lease()) answers within ARB_LEASE_GRACE with the long
+ * GNT_PULSE_RENEW_CYCLES pulse and gets a new lease, at most
+ * ARB_LEASE_RENEWALS times per grant. A release ends it as usual; one on
+ * REQ while the check is out has its flags read like a GNT release (an
+ * idle lock session releases that way). Without either, the lock is
+ * revoked and the next node granted. A live holder stops at the check,
+ * after the piece of FRAM transfer in progress (FRAM_REVOKE_PIECE bytes
+ * at most); the grace is what that piece gets to finish, sized for the
+ * slowest SPI clock the workers use (SMCLK/16).
+ */
+#ifndef ARB_LEASE_TICKS
+#define ARB_LEASE_TICKS     31250u    /* 250 ms; 0 = no lease */
+#endif
+#ifndef ARB_LEASE_GRACE
+#define ARB_LEASE_GRACE     625u      /* 5 ms */
+#endif
+#ifndef ARB_LEASE_RENEWALS
+#define ARB_LEASE_RENEWALS  8u
+#endif
+
+/* Also empty the revoked holder's own box: it may have been stopped
+ * halfway through updating it
+ */
+#ifndef ARB_LEASE_RESET_BOX
+#define ARB_LEASE_RESET_BOX 0u
+#endif
+
+/* Grant handoff: a release pulse with a node waiting is answered with the
+ * next grant from the port ISR itself, without waking the main loop first
+ * (which would only grant too).
+ * 0 = every release goes through the main loop like any REQ edge.
+ */
+#ifndef ARB_DIRECT_HANDOFF
+#define ARB_DIRECT_HANDOFF  1u
+#endif
+
+/* Nudge the holder once per grant, with a mail-width pulse, when a node
+ * waits behind it (queued before the grant or after): a worker that
+ * keeps the lock between operations (a lock session, Applications/HDC)
+ * gives it back then. Every worker build decodes it with worker.c, which
+ * never takes it for mail. The nudge comes ARB_NUDGE_GAP cycles after
+ * the grant at the earliest, so the holder's capture has taken the grant
+ * pulse apart first.
+ * 0 = a session keeps the bus until its idle time or max_ops is up.
+ */
+#ifndef ARB_NUDGE_HOLDER
+#define ARB_NUDGE_HOLDER    1u
+#endif
+#define ARB_NUDGE_GAP       400u
 
-#define NODE1_ID     1u
-#define NODE2_ID     2u
-#define NODE3_ID     3u
-
-/* REQ pins on arbiter */
-#define N1_REQ_P1_PIN   BIT4      /* P1.4 */
-#define N2_REQ_P1_PIN   BIT2      /* P1.2 */
-#define N3_REQ_P3_PIN   BIT5      /* P3.5 */
-
-/* GNT pins on arbiter */
-#define N1_GNT_P1_PIN   BIT3      /* P1.3 */
-#define N2_GNT_P3_PIN   BIT0      /* P3.0 */
-#define N3_GNT_P3_PIN   BIT6      /* P3.6 */
-
+#define LEASE_OFF           0u
+#define LEASE_RUNNING       1u
+#define LEASE_CHECK         2u
 
 /* ---- Clock ---- */
 
@@ -63,133 +205,240 @@ static void clock_init_8mhz(void)
 /* ---- Globals ---- */
 
 /* 0   = no one holds bus
- * 1..3 = node ID currently owning SPI/FRAM bus
+ * 1..NUM_NODES = node ID currently owning SPI/FRAM bus
  */
 static volatile uint8_t g_lock_holder     = 0u;
 
-/* Pending REQ events encoded as bits 0..(NUM_NODES-1) */
-static volatile uint8_t g_req_event_mask  = 0u;
+/* Pending REQ events, bit k = node index k */
+static volatile mailbox_mask_t g_req_event_mask = 0u;
 
-/* FCFS queue */
+/* FCFS ready queue: a ring of node IDs plus a bitmap of the nodes in
+ * it, so push, pop and the "already queued?" test are all O(1)
+ */
 static volatile uint8_t g_queue[NUM_NODES];
+static volatile uint8_t g_q_head          = 0u;
 static volatile uint8_t g_q_len           = 0u;
+static volatile mailbox_mask_t g_q_mask   = 0u;
 
 /* Need to schedule */
 static volatile uint8_t g_need_schedule   = 0u;
 
+/* A holder released the bus: a receiver may have freed space */
+static volatile uint8_t g_credit_check    = 0u;
+
+/* Scheduler state, index = node index. Timestamps and debts are kept
+ * under every policy, so g_sched_policy may also be switched at run time.
+ */
+static volatile uint8_t g_sched_policy            = ARB_SCHED_POLICY;
+static uint16_t g_grant_time              = 0u;
+static uint16_t g_req_time[NUM_NODES];
+static int32_t  g_deficit[NUM_NODES];
+static uint16_t g_debt[NUM_NODES];
+
+/* Last hold time and budget overruns, for tuning */
+static volatile uint16_t g_hold_ticks[NUM_NODES];
+static volatile uint16_t g_overruns[NUM_NODES];
+
+static const uint8_t  arb_priorities[] = ARB_NODE_PRIORITIES;
+static const uint8_t  arb_weights[]    = ARB_NODE_WEIGHTS;
+static const uint16_t arb_deadlines[]  = ARB_NODE_DEADLINES;
+static const uint16_t arb_budgets[]    = ARB_NODE_BUDGETS;
+
+/* Lease of the current grant */
+static volatile uint8_t  g_lease_state    = LEASE_OFF;
+static volatile uint8_t  g_lease_renewals = 0u;
+
+/* The current holder was nudged (ARB_NUDGE_HOLDER) */
+static uint8_t           g_nudged         = 0u;
+
+/* Holder whose lease ran out, handed from the timer ISR to the main loop */
+static volatile uint8_t  g_lease_revoked  = 0u;
+static volatile uint16_t g_revocations    = 0u;
+
+/* Holder that released with a GNT pulse, for the main loop: a directed
+ * release, or a release after raising flags if no handoff target was
+ * written
+ */
+static volatile uint8_t  g_handoff_from   = 0u;
+
+/* Flags left set in FRAM for nodes that were waiting for the bus when
+ * they were read, bit k = box k; mailed once the node stops waiting
+ */
+static mailbox_mask_t    g_notif_owed     = 0u;
+
+/* ISR decode, generated from the pin map: node ID on each port pin
+ * (0 = none), one table for REQ lines and one for GNT lines
+ */
+#define ARB_REQ_ENTRY(i, rp, rb, gp, gb) \
+    [(rp) - 1][(rb)] = ((i) < NUM_NODES) ? ARB_NODE_ID(i) : 0u,
+#define ARB_GNT_ENTRY(i, rp, rb, gp, gb) \
+    [(gp) - 1][(gb)] = ((i) < NUM_NODES) ? ARB_NODE_ID(i) : 0u,
+
+static const uint8_t arb_req_node[ARB_NUM_PORTS][8] = {
+    ARB_NODE_PINS(ARB_REQ_ENTRY)
+};
+static const uint8_t arb_gnt_node[ARB_NUM_PORTS][8] = {
+    ARB_NODE_PINS(ARB_GNT_ENTRY)
+};
+
 /* ---- Queue helpers ---- */
 
-static uint8_t index_to_node_id(uint8_t idx)
+static uint8_t queue_next(uint8_t pos)
 {
-    if (idx == 0u) return NODE1_ID;
-    if (idx == 1u) return NODE2_ID;
-    if (idx == 2u) return NODE3_ID;
-    return 0u;
+    pos++;
+    return (pos >= NUM_NODES) ? 0u : pos;
 }
 
 static uint8_t queue_contains(uint8_t node_id)
 {
-    volatile uint8_t i;
-
-    for (i = 0u; i < g_q_len; i++) {
-        if (g_queue[i] == node_id) {
-            return 1u;
-        }
-    }
-    return 0u;
+    return (uint8_t)((g_q_mask & ARB_NODE_BIT(node_id)) != 0u);
 }
 
 static void queue_push(uint8_t node_id)
 {
+    uint8_t tail;
+
     if (g_q_len >= NUM_NODES) {
         return;
     }
     if (queue_contains(node_id) != 0u) {
         return;
     }
-    g_queue[g_q_len] = node_id;
+
+    tail = (uint8_t)(g_q_head + g_q_len);
+    if (tail >= NUM_NODES) {
+        tail = (uint8_t)(tail - NUM_NODES);
+    }
+    g_queue[tail] = node_id;
     g_q_len++;
+    g_q_mask |= ARB_NODE_BIT(node_id);
 }
 
 static uint8_t queue_pop(void)
 {
-    uint8_t i;
     uint8_t first;
 
     if (g_q_len == 0u) {
         return 0u;
     }
 
-    first = g_queue[0];
-    for (i = 1u; i < g_q_len; i++) {
-        g_queue[i - 1u] = g_queue[i];
-    }
+    first    = g_queue[g_q_head];
+    g_q_head = queue_next(g_q_head);
     g_q_len--;
+    g_q_mask &= ~ARB_NODE_BIT(first);
 
     return first;
 }
 
+/* Reset pulses and out-of-order picks: closes the gap, keeping the
+ * others' order
+ */
 static void queue_remove(uint8_t node_id)
 {
     uint8_t i;
-    uint8_t j = 0u;
+    uint8_t n;
+    uint8_t src;
+    uint8_t dst;
 
-    for (i = 0u; i < g_q_len; i++) {
-        if (g_queue[i] != node_id) {
-            g_queue[j] = g_queue[i];
-            j++;
+    if (queue_contains(node_id) == 0u) {
+        return;
+    }
+
+    n   = g_q_len;
+    src = g_q_head;
+    dst = g_q_head;
+    for (i = 0u; i < n; i++) {
+        if (g_queue[src] != node_id) {
+            g_queue[dst] = g_queue[src];
+            dst = queue_next(dst);
+        } else {
+            g_q_len--;
         }
+        src = queue_next(src);
     }
-    g_q_len = j;
+    g_q_mask &= ~ARB_NODE_BIT(node_id);
 }
 
-/* ---- GPIO init ---- */
+/* REQ edge latched but not processed yet: the node is waiting for a
+ * grant, which serves as its mail (or space) pulse as well
+ */
+#define ARB_REQ_PENDING_CASE(i, rp, rb, gp, gb) \
+    case (i): return (uint8_t)((P##rp##IFG & BIT##rb) != 0u);
 
-static void arbiter_gpio_init(void)
+static uint8_t node_req_pending(uint8_t idx)
+{
+    if ((g_req_event_mask & ((mailbox_mask_t)1u << idx)) != 0u) {
+        return 1u;
+    }
+    switch (idx) {
+    ARB_NODE_PINS(ARB_REQ_PENDING_CASE)
+    default: return 0u;
+    }
+}
+
+#define ARB_GNT_HIGH_CASE(i, rp, rb, gp, gb) \
+    case (i): return (uint8_t)((P##gp##IN & BIT##gb) != 0u);
+
+/* The node drives its GNT line high right now */
+static uint8_t node_gnt_high(uint8_t idx)
 {
-    /* Port 1: N1_REQ=P1.4, N2_REQ=P1.2, N1_GNT=P1.3 */
-    P1SEL0 &= ~(N1_REQ_P1_PIN | N2_REQ_P1_PIN | N1_GNT_P1_PIN);
-    P1SEL1 &= ~(N1_REQ_P1_PIN | N2_REQ_P1_PIN | N1_GNT_P1_PIN);
+    switch (idx) {
+    ARB_NODE_PINS(ARB_GNT_HIGH_CASE)
+    default: return 0u;
+    }
+}
 
-    /* REQ inputs, pulldown, rising edge interrupt */
-    P1DIR &= ~(N1_REQ_P1_PIN | N2_REQ_P1_PIN);
-    P1REN |= (N1_REQ_P1_PIN | N2_REQ_P1_PIN);
-    P1OUT &= ~(N1_REQ_P1_PIN | N2_REQ_P1_PIN);
+#define ARB_REQ_CLEAR_CASE(i, rp, rb, gp, gb) \
+    case (i): P##rp##IFG &= (uint8_t)~BIT##rb; break;
 
-    P1IES &= ~(N1_REQ_P1_PIN | N2_REQ_P1_PIN);
-    P1IFG &= ~(N1_REQ_P1_PIN | N2_REQ_P1_PIN);
-    P1IE  |= (N1_REQ_P1_PIN | N2_REQ_P1_PIN);
+/* Drop a latched REQ edge. Interrupts disabled. */
+static void node_req_clear(uint8_t idx)
+{
+    g_req_event_mask &= ~((mailbox_mask_t)1u << idx);
+    switch (idx) {
+    ARB_NODE_PINS(ARB_REQ_CLEAR_CASE)
+    default: break;
+    }
+}
 
-    /* GNT1 input, pulldown, rising edge for reset */
-    P1DIR &= ~N1_GNT_P1_PIN;
-    P1REN |= N1_GNT_P1_PIN;
-    P1OUT &= ~N1_GNT_P1_PIN;
-    
-    P1IES &= ~N1_GNT_P1_PIN;
-    P1IFG &= ~N1_GNT_P1_PIN;
-    P1IE  |= N1_GNT_P1_PIN;
-
-    /* Port 3: N3_REQ=P3.5, N2_GNT=P3.0, N3_GNT=P3.6 */
-    P3SEL0 &= ~(N3_REQ_P3_PIN | N2_GNT_P3_PIN | N3_GNT_P3_PIN);
-    P3SEL1 &= ~(N3_REQ_P3_PIN | N2_GNT_P3_PIN | N3_GNT_P3_PIN);
-
-    /* REQ3 */
-    P3DIR &= ~N3_REQ_P3_PIN;
-    P3REN |= N3_REQ_P3_PIN;
-    P3OUT &= ~N3_REQ_P3_PIN;
-    
-    P3IES &= ~N3_REQ_P3_PIN;
-    P3IFG &= ~N3_REQ_P3_PIN;
-    P3IE  |= N3_REQ_P3_PIN;
+#define ARB_GNT_CLEAR_CASE(i, rp, rb, gp, gb) \
+    case (i): P##gp##IFG &= (uint8_t)~BIT##gb; break;
+
+/* Drop a latched GNT edge. Interrupts disabled. */
+static void node_gnt_clear(uint8_t idx)
+{
+    switch (idx) {
+    ARB_NODE_PINS(ARB_GNT_CLEAR_CASE)
+    default: break;
+    }
+}
 
-    /* GNT2, GNT3 inputs with pulldown, rising edge for reset */
-    P3DIR &= ~(N2_GNT_P3_PIN | N3_GNT_P3_PIN);
-    P3REN |= (N2_GNT_P3_PIN | N3_GNT_P3_PIN);
-    P3OUT &= ~(N2_GNT_P3_PIN | N3_GNT_P3_PIN);
+/* ---- GPIO init ---- */
+
+/* Input with pulldown and rising-edge interrupt: REQ lines, and GNT
+ * lines while idle (a worker pulses its GNT line after a reset)
+ */
+#define ARB_PIN_IN_IRQ(p, bit) \
+    do { \
+        P##p##SEL0 &= (uint8_t)~(bit); \
+        P##p##SEL1 &= (uint8_t)~(bit); \
+        P##p##DIR  &= (uint8_t)~(bit); \
+        P##p##REN  |= (bit); \
+        P##p##OUT  &= (uint8_t)~(bit); \
+        P##p##IES  &= (uint8_t)~(bit); \
+        P##p##IFG  &= (uint8_t)~(bit); \
+        P##p##IE   |= (bit); \
+    } while (0)
+
+#define ARB_PIN_INIT(i, rp, rb, gp, gb) \
+    if ((i) < NUM_NODES) { \
+        ARB_PIN_IN_IRQ(rp, BIT##rb); \
+        ARB_PIN_IN_IRQ(gp, BIT##gb); \
+    }
 
-    P3IES &= ~(N2_GNT_P3_PIN | N3_GNT_P3_PIN);
-    P3IFG &= ~(N2_GNT_P3_PIN | N3_GNT_P3_PIN);
-    P3IE  |= (N2_GNT_P3_PIN | N3_GNT_P3_PIN);
+static void arbiter_gpio_init(void)
+{
+    ARB_NODE_PINS(ARB_PIN_INIT)
 
     /* LEDs */
     P1DIR |= BIT0;
@@ -198,82 +447,321 @@ static void arbiter_gpio_init(void)
 
 /* ---- GNT pulses ---- */
 
+/* Drive the GNT line high for 'cycles'; its interrupt is off meanwhile.
+ * The edge of our own pulse is dropped, but one the node raised before
+ * it is kept: a holder's GNT release that the pulse crossed (a nudge or
+ * a lease check) still reaches arbiter_port_event().
+ */
+#define ARB_GNT_PULSE(p, bit, cycles) \
+    do { \
+        uint8_t node_edge; \
+        P##p##IE  &= (uint8_t)~(bit); \
+        node_edge  = (uint8_t)(P##p##IFG & (bit)); \
+        P##p##DIR |= (bit); \
+        P##p##OUT |= (bit); \
+        __delay_cycles(cycles); \
+        P##p##OUT &= (uint8_t)~(bit); \
+        P##p##DIR &= (uint8_t)~(bit); \
+        if (node_edge == 0u) { \
+            P##p##IFG &= (uint8_t)~(bit); \
+        } \
+        P##p##IE  |= (bit); \
+    } while (0)
+
+#define ARB_GNT_CASE(i, rp, rb, gp, gb) \
+    case (i): \
+        if ((i) < NUM_NODES) { \
+            ARB_GNT_PULSE(gp, BIT##gb, GNT_PULSE_GRANT_CYCLES); \
+        } \
+        break;
+
+#define ARB_GNT_MAIL_CASE(i, rp, rb, gp, gb) \
+    case (i): \
+        if ((i) < NUM_NODES) { \
+            ARB_GNT_PULSE(gp, BIT##gb, GNT_PULSE_MAIL_CYCLES); \
+        } \
+        break;
+
+#define ARB_GNT_HANDOFF_CASE(i, rp, rb, gp, gb) \
+    case (i): \
+        if ((i) < NUM_NODES) { \
+            ARB_GNT_PULSE(gp, BIT##gb, GNT_PULSE_HANDOFF_CYCLES); \
+        } \
+        break;
+
 static void gnt_pulse_node(uint8_t node_id)
 {
-    volatile uint8_t *pdir;
-    volatile uint8_t *pout;
-    uint8_t port_bit;
-
-    if (node_id == NODE1_ID) {
-        pdir     = &P1DIR;
-        pout     = &P1OUT;
-        port_bit = N1_GNT_P1_PIN;
-    } else if (node_id == NODE2_ID) {
-        pdir     = &P3DIR;
-        pout     = &P3OUT;
-        port_bit = N2_GNT_P3_PIN;
-    } else if (node_id == NODE3_ID) {
-        pdir     = &P3DIR;
-        pout     = &P3OUT;
-        port_bit = N3_GNT_P3_PIN;
-    } else {
+    if (node_id == 0u || node_id > NUM_NODES) {
         return;
     }
 
-    /* Disable reset interrupt on this pin during pulse */
-    if (node_id == NODE1_ID) {
-        P1IE  &= (uint8_t)~port_bit;
-        P1IFG &= (uint8_t)~port_bit;
-    } else {
-        P3IE  &= (uint8_t)~port_bit;
-        P3IFG &= (uint8_t)~port_bit;
+    switch (node_id - 1u) {
+    ARB_NODE_PINS(ARB_GNT_CASE)
+    default:
+        break;
     }
+}
 
-    *pdir |=  port_bit;
-    *pout |=  port_bit;
-    __delay_cycles(50u);
-    *pout &= (uint8_t)~port_bit;
-    *pdir &= (uint8_t)~port_bit;
+static void gnt_mail_pulse_node(uint8_t node_id)
+{
+    if (node_id == 0u || node_id > NUM_NODES) {
+        return;
+    }
 
-    if (node_id == NODE1_ID) {
-        P1IFG &= (uint8_t)~port_bit;
-        P1IE  |= port_bit;
-    } else {
-        P3IFG &= (uint8_t)~port_bit;
-        P3IE  |= port_bit;
+    switch (node_id - 1u) {
+    ARB_NODE_PINS(ARB_GNT_MAIL_CASE)
+    default:
+        break;
+    }
+}
+
+/* Long pulse: grant and mail at once, for a node that did not ask */
+static void gnt_handoff_pulse_node(uint8_t node_id)
+{
+    if (node_id == 0u || node_id > NUM_NODES) {
+        return;
+    }
+
+    switch (node_id - 1u) {
+    ARB_NODE_PINS(ARB_GNT_HANDOFF_CASE)
+    default:
+        break;
     }
 }
 
 /* ---- Scheduler ---- */
 
-static void arbiter_schedule(void)
+static void arbiter_timer_init(void)
 {
-    uint8_t next;
+    TA0CTL = TASSEL__SMCLK | MC__CONTINUOUS | TACLR | ID__8;  // SMCLK/8
+    TA0EX0 = TAIDEX_7;                                        // /8 -> 8 us
+}
 
-    if (g_lock_holder != 0u) {
-        return;
+/* Intervals are 16-bit differences: valid up to 524 ms */
+static uint16_t arb_now(void)
+{
+    return TA0R;
+}
+
+#define ARB_SCHED_PARAM(tbl, idx, dflt) \
+    (((idx) < sizeof(tbl) / sizeof((tbl)[0]) && (tbl)[idx] != 0u) ? \
+        (tbl)[idx] : (dflt))
+
+static uint8_t sched_pick_priority(void)
+{
+    uint8_t pos;
+    uint8_t i;
+    uint8_t idx;
+    uint8_t best = 0u;
+    uint16_t rank;
+    uint16_t best_rank = 0u;
+
+    pos = g_q_head;
+    for (i = 0u; i < g_q_len; i++) {
+        idx  = (uint8_t)(g_queue[pos] - 1u);
+        rank = (g_debt[idx] != 0u) ? 0u :
+               (uint16_t)(ARB_SCHED_PARAM(arb_priorities, idx, 0u) + 1u);
+        if (best == 0u || rank > best_rank) {
+            best      = g_queue[pos];
+            best_rank = rank;
+        }
+        pos = queue_next(pos);
     }
+    return best;
+}
 
-    next = queue_pop();
-    if (next == 0u) {
-        P4OUT &= ~BIT6;
+static uint8_t sched_pick_edf(uint16_t now)
+{
+    uint8_t pos;
+    uint8_t i;
+    uint8_t idx;
+    uint8_t best = 0u;
+    int32_t slack;
+    int32_t best_slack = 0;
+
+    pos = g_q_head;
+    for (i = 0u; i < g_q_len; i++) {
+        idx   = (uint8_t)(g_queue[pos] - 1u);
+        slack = (int32_t)ARB_SCHED_PARAM(arb_deadlines, idx,
+                                         ARB_DEADLINE_DEFAULT)
+              + (int32_t)g_debt[idx]
+              - (int32_t)(uint16_t)(now - g_req_time[idx]);
+        if (best == 0u || slack < best_slack) {
+            best       = g_queue[pos];
+            best_slack = slack;
+        }
+        pos = queue_next(pos);
+    }
+    return best;
+}
+
+/* Rotate until the head has credit; every pass adds credit, so it ends */
+static uint8_t sched_pick_drr(void)
+{
+    uint8_t node_id;
+    uint8_t idx;
+
+    for (;;) {
+        node_id = queue_pop();
+        if (node_id == 0u) {
+            return 0u;
+        }
+        idx = (uint8_t)(node_id - 1u);
+        if (g_deficit[idx] > 0) {
+            return node_id;
+        }
+        g_deficit[idx] += (int32_t)ARB_DRR_QUANTUM *
+                          (int32_t)ARB_SCHED_PARAM(arb_weights, idx, 1u);
+        queue_push(node_id);
+    }
+}
+
+/* ---- Lease ---- */
+
+static void lease_arm(uint16_t ticks)
+{
+    TA0CCR0  = (uint16_t)(TA0R + ticks);
+    TA0CCTL0 = CCIE;
+}
+
+static void lease_start(void)
+{
+    if (ARB_LEASE_TICKS == 0u) {
         return;
     }
+    g_lease_state    = LEASE_RUNNING;
+    g_lease_renewals = 0u;
+    lease_arm(ARB_LEASE_TICKS);
+}
+
+static void lease_stop(void)
+{
+    TA0CCTL0      = 0u;
+    g_lease_state = LEASE_OFF;
+}
+
+/* Pick and dequeue the next holder, 0 if nobody waits */
+static uint8_t sched_pick(uint16_t now)
+{
+    uint8_t next;
+
+    switch (g_sched_policy) {
+    case ARB_SCHED_PRIORITY:
+        next = sched_pick_priority();
+        break;
+    case ARB_SCHED_EDF:
+        next = sched_pick_edf(now);
+        break;
+    case ARB_SCHED_DRR:
+        return sched_pick_drr();
+    default:
+        return queue_pop();
+    }
+
+    if (next != 0u) {
+        queue_remove(next);
+    }
+    return next;
+}
+
+/* Holder released the bus: account its hold time */
+static void sched_charge(uint8_t node_id, uint16_t now)
+{
+    uint8_t idx = (uint8_t)(node_id - 1u);
+    uint16_t hold;
+    uint16_t budget;
+
+    hold   = (uint16_t)(now - g_grant_time);
+    budget = ARB_SCHED_PARAM(arb_budgets, idx, 0u);
+
+    g_hold_ticks[idx] = hold;
+    if (g_sched_policy == ARB_SCHED_DRR) {
+        g_deficit[idx] -= (int32_t)hold;
+    }
+    if (budget != 0u && hold > budget) {
+        g_overruns[idx]++;
+        g_debt[idx] = (uint16_t)(hold - budget);
+    }
+}
 
+/* Node was reset: it starts over */
+static void sched_forget(uint8_t node_id)
+{
+    uint8_t idx = (uint8_t)(node_id - 1u);
+
+    g_deficit[idx] = 0;
+    g_debt[idx]    = 0u;
+}
+
+/* Make next the holder, before its grant pulse. Interrupts disabled.
+ * Edges it raised before the grant are no release of it: a give-back of
+ * a pulse it lost, or the request this grant answers.
+ */
+static void arbiter_set_holder(uint8_t next, uint16_t now)
+{
+    node_req_clear((uint8_t)(next - 1u));
+    node_gnt_clear((uint8_t)(next - 1u));
     g_lock_holder = next;
+    g_grant_time  = now;
+    g_debt[next - 1u] = 0u;
+    g_nudged      = 0u;
+    lease_start();
+}
+
+/* Hand the bus to next. Interrupts disabled. */
+static void arbiter_grant(uint8_t next, uint16_t now)
+{
+    arbiter_set_holder(next, now);
     gnt_pulse_node(next);   /* grant bus */
 
     P4OUT |= BIT6;
+}
 
+/* Holder pulsed REQ => release. Interrupts disabled. */
+static void arbiter_release(uint8_t node_id, uint16_t now)
+{
+    lease_stop();
+    sched_charge(node_id, now);
+    g_lock_holder = 0u;
+    P4OUT &= ~BIT6;
+    g_need_schedule = 1u;
+    g_credit_check  = 1u;
+}
+
+static void arbiter_schedule(void)
+{
+    uint8_t next;
+    uint16_t now;
+
+    /* A GNT release or a revocation still needs the bus for its scan */
+    if (g_lock_holder != 0u || g_handoff_from != 0u ||
+        g_lease_revoked != 0u) {
+        return;
+    }
+
+    now = arb_now();
+
+    /* The port ISRs drop reset nodes from the queue and hand the bus on */
+    __disable_interrupt();
+    next = sched_pick(now);
+    if (next != 0u) {
+        arbiter_grant(next, now);
+    }
+    __enable_interrupt();
+
+    if (next == 0u) {
+        P4OUT &= ~BIT6;
+    }
 }
 
 /* ---- Process REQ events ---- */
 
 static void arbiter_process_req_events(void)
 {
-    uint8_t events;
+    mailbox_mask_t events;
     uint8_t bit;
     uint8_t node_id;
+    uint16_t now;
 
     if (g_req_event_mask == 0u) {
         return;
@@ -286,132 +774,400 @@ static void arbiter_process_req_events(void)
 
     P1OUT ^= BIT0; /* activity indicator */
 
+    now = arb_now();
+
     for (bit = 0u; bit < NUM_NODES; bit++) {
-        if ((events & (1u << bit)) == 0u) {
+        if ((events & ((mailbox_mask_t)1u << bit)) == 0u) {
             continue;
         }
 
-        node_id = index_to_node_id(bit);
-        if (node_id == 0u) {
-            continue;
-        }
+        node_id = ARB_NODE_ID(bit);
 
+        /* The release ISR also works the queue */
+        __disable_interrupt();
         if (g_lock_holder == node_id) {
             /* Current holder pulsed REQ => release. */
-            g_lock_holder = 0u;
-            P4OUT &= ~BIT6;
-            g_need_schedule = 1u;
+            arbiter_release(node_id, now);
+        } else if (node_id == g_lease_revoked) {
+            /* Released just as the lease ran out: nothing to do */
         } else {
             /* New request */
+            if (queue_contains(node_id) == 0u) {
+                g_req_time[bit] = now;
+            }
             queue_push(node_id);
             g_need_schedule = 1u;
         }
+        __enable_interrupt();
     }
 }
 
+/* The holder has a node waiting behind it: nudge it, once per grant
+ * (ARB_NUDGE_HOLDER). The gap is waited out with interrupts on, so a
+ * release (and a new request) meanwhile is taken as usual.
+ */
+static void arbiter_nudge_holder(void)
+{
+    if (ARB_NUDGE_HOLDER == 0u || g_lock_holder == 0u ||
+        g_nudged != 0u || g_q_len == 0u) {
+        return;
+    }
+    __delay_cycles(ARB_NUDGE_GAP);
+
+    __disable_interrupt();
+    if (g_lock_holder != 0u && g_nudged == 0u && g_q_len != 0u) {
+        g_nudged = 1u;
+        gnt_mail_pulse_node(g_lock_holder);
+    }
+    __enable_interrupt();
+}
+
 /* ---- Notification from FRAM ---- */
 
-static void arbiter_check_notifications(void)
+/* Mail every flagged node that is not waiting for the bus anyway and
+ * clear its flag in notif[]; skip_id (0 = none) is cleared without a
+ * pulse, its grant carries the mail. Flags of waiting nodes stay set and
+ * are returned, bit k = box k.
+ */
+static mailbox_mask_t arbiter_mail_flagged(uint8_t *notif, uint8_t skip_id)
+{
+    mailbox_mask_t owed = 0u;
+    uint8_t idx;
+    uint8_t node_id;
+
+    for (idx = 0u; idx < MAILBOX_NUM_NODES; idx++) {
+        if (notif[idx] == 0u) {
+            continue;
+        }
+        if (idx < NUM_NODES) {
+            node_id = ARB_NODE_ID(idx);
+            if (node_id != skip_id &&
+                (queue_contains(node_id) || node_req_pending(idx))) {
+                owed |= (mailbox_mask_t)1u << idx;
+                continue;
+            }
+            if (node_id != skip_id) {
+                gnt_mail_pulse_node(node_id); /* "you have mail" */
+            }
+        }
+        notif[idx] = 0u;   /* boxes without a node just drop the flag */
+    }
+    return owed;
+}
+
+/* Only a holder that raised flags releases with a GNT pulse, so the flags
+ * are read here and not on every wake: the handoff byte and the flags in
+ * one burst, and only the bytes that changed are cleared. Returns the
+ * node named in the handoff byte if it may be granted, else 0; from is
+ * the releasing holder, 0 after a revocation (no directed release then).
+ * Bus free, interrupts disabled.
+ */
+static uint8_t arbiter_scan_flags(uint8_t from)
+{
+    uint8_t buf[1u + MAILBOX_NUM_NODES];   /* handoff byte, then the flags */
+    uint8_t any = 0u;
+    uint8_t to;
+    uint8_t idx;
+
+    fram_read_bytes(FRAM_HANDOFF_ADDR, buf, sizeof(buf));
+    for (idx = 0u; idx < sizeof(buf); idx++) {
+        any |= buf[idx];
+    }
+    if (any == 0u) {
+        g_notif_owed = 0u;
+        return 0u;
+    }
+
+    to = buf[0];
+    if (from == 0u || to == 0u || to > NUM_NODES || to == from) {
+        to = 0u;
+    } else if (node_req_pending((uint8_t)(to - 1u)) &&
+               queue_contains(to) == 0u) {
+        /* Its REQ is on the way: let it take its turn */
+        to = 0u;
+    }
+    buf[0] = 0u;
+
+    g_notif_owed = arbiter_mail_flagged(&buf[1], to);
+    fram_write_bytes(FRAM_HANDOFF_ADDR, buf, sizeof(buf));
+    return to;
+}
+
+/* Mail the nodes whose flags were left set while they waited, once they
+ * no longer do. Works from SRAM: an idle wake costs no FRAM read.
+ * Interrupts disabled.
+ */
+static void arbiter_notify_owed(void)
 {
-    uint8_t notif;
-    uint8_t mask;
+    uint8_t zero = 0u;
     uint8_t idx;
     uint8_t node_id;
+    mailbox_mask_t bit;
 
-    if (g_lock_holder != 0u) {
+    if (g_notif_owed == 0u || g_lock_holder != 0u ||
+        g_handoff_from != 0u || g_lease_revoked != 0u) {
         return;
     }
 
-    fram_read_bytes(FRAM_NOTIF_BOX_ADDR, &notif, 1u);
-    if (notif == 0u) {
-        // uart0_println("No notifications");
+    for (idx = 0u; idx < NUM_NODES; idx++) {
+        bit = (mailbox_mask_t)1u << idx;
+        if ((g_notif_owed & bit) == 0u) {
+            continue;
+        }
+        node_id = ARB_NODE_ID(idx);
+        if (!queue_contains(node_id) && !node_req_pending(idx)) {
+            gnt_mail_pulse_node(node_id); /* "you have mail" */
+            fram_write_bytes(FRAM_NOTIF_FLAG_ADDR(idx), &zero, 1u);
+            g_notif_owed &= (mailbox_mask_t)~bit;
+        }
+    }
+}
+
+/* ---- Revoked leases ---- */
+
+static void arbiter_process_revocation(void)
+{
+    uint8_t node_id = g_lease_revoked;
+
+    if (node_id == 0u) {
         return;
     }
-    // uart0_println("Notifications received");
-    // uart0_print_hex(notif);
-    // uart0_println("");
+    g_lease_revoked = 0u;
+    g_revocations++;
+
+    sched_charge(node_id, arb_now());
+
+    uart0_print("Lease revoked: node ");
+    uart0_print_uint(node_id);
+    uart0_println("");
+
+    /* Bus is free and nobody is granted before the schedule below. What
+     * the holder flagged before it stopped is unknown: scan them all.
+     */
+    __disable_interrupt();
+    if (ARB_LEASE_RESET_BOX != 0u) {
+        mailbox_reset_box((uint8_t)(node_id - 1u));
+    }
+    (void)arbiter_scan_flags(0u);
+    g_need_schedule = 1u;
+    __enable_interrupt();
+}
+
+/* ---- Directed release ---- */
+
+/* The holder released with a GNT pulse. If it named a node in the handoff
+ * byte, that node is granted next, ahead of the queue; a node that did
+ * not ask gets the long pulse that is also its mail. Otherwise it raised
+ * flags (or was reset while holding, which reads the same) and the bus
+ * goes to the queue after the scan.
+ */
+static void arbiter_process_handoff(void)
+{
+    uint8_t from = g_handoff_from;
+    uint8_t to;
+
+    if (from == 0u) {
+        return;
+    }
+
+    /* One critical section up to the pulse: a REQ from the new holder
+     * must not reach arbiter_port_event() and read as its release
+     */
+    __disable_interrupt();
+    g_handoff_from = 0u;
+    to = arbiter_scan_flags(from);
+
+    if (to == 0u) {
+        g_need_schedule = 1u;
+    } else {
+        if (queue_contains(to) != 0u) {
+            /* Already waiting for a grant */
+            queue_remove(to);
+            arbiter_grant(to, arb_now());
+        } else {
+            arbiter_set_holder(to, arb_now());
+            gnt_handoff_pulse_node(to);
+            P4OUT |= BIT6;
+            /* A REQ latched during the pulse left before the node saw it:
+             * it asked for the bus it now holds
+             */
+            node_req_clear((uint8_t)(to - 1u));
+        }
+    }
+    __enable_interrupt();
+}
+
+/* ---- Space-available wakeups ---- */
+
+static void arbiter_check_credits(void)
+{
+    mailbox_mask_t wake;
+    uint8_t idx;
+    uint8_t node_id;
+
+    if (g_lock_holder != 0u || g_credit_check == 0u) {
+        return;
+    }
+    g_credit_check = 0u;
+
+    wake = mailbox_collect_wakeups();
 
-    mask = 1u;
     for (idx = 0u; idx < NUM_NODES; idx++) {
-        if ((notif & mask) != 0u) {
-            node_id = index_to_node_id(idx);
-            if (node_id != 0u && !queue_contains(node_id)) { // check this condition just in case
-                gnt_pulse_node(node_id); /* "you have mail" */
-                // uart0_print("Notified node ");
-                // uart0_print_uint(node_id);
-                // uart0_println("");
+        if ((wake & ((mailbox_mask_t)1u << idx)) != 0u) {
+            node_id = ARB_NODE_ID(idx);
+            /* A queued node retries once it is granted anyway */
+            if (!queue_contains(node_id) &&
+                !node_req_pending(idx)) {
+                gnt_mail_pulse_node(node_id); /* "space available" */
             }
         }
-        mask <<= 1;
     }
-
-    
-    // notif &= (uint8_t)~((uint8_t)((1u << NUM_NODES) - 1u)); /* Clear only serviced bits */
-    notif = 0u; /* simplest: clear entire notif byte */
-    fram_write_bytes(FRAM_NOTIF_BOX_ADDR, &notif, 1u);
 }
 
 /* ---- ISRs ---- */
 
-#pragma vector = PORT1_VECTOR
-__interrupt void PORT1_ISR(void)
+/* Release pulse from the holder, from its port ISR, with a node waiting:
+ * the next one is granted at once, the main loop is left the bookkeeping
+ */
+static void arbiter_handoff(uint8_t node_id)
 {
-    uint16_t iv = P1IV;
+    uint16_t now = arb_now();
+    uint8_t next;
 
-    switch (iv) {
-    case 0x06:  /* P1.2 = N2_REQ */
-        g_req_event_mask |= (1u << 1);
-        break;
-    case 0x08:  /* P1.3 = N1_GNT reset pulse */
-        queue_remove(NODE1_ID);
-        if (g_lock_holder == NODE1_ID) {
-            g_lock_holder = 0u;
-            P4OUT &= ~BIT6;
-            g_need_schedule = 1u;
-            // uart_print_str("Node 1 detected\r\n");
+    arbiter_release(node_id, now);
+    next = sched_pick(now);
+    if (next != 0u) {
+        arbiter_grant(next, now);
+    }
+}
+
+/* One PxIV source: a REQ edge is queued for the main loop, unless it is
+ * the holder's release; a pulse on an idle GNT line means that node was
+ * reset and gave up its place, on the holder's a directed release (or a
+ * reset) for the main loop
+ */
+static void arbiter_port_event(uint8_t port, uint16_t iv)
+{
+    uint8_t pin;
+    uint8_t node_id;
+
+    if (iv == 0u) {
+        return;
+    }
+    pin = (uint8_t)((iv >> 1) - 1u);
+
+    node_id = arb_req_node[port - 1u][pin];
+    if (node_id != 0u) {
+        /* The holder's release, taken here: a node that asks again
+         * before the main loop runs would share one event bit with it.
+         * With a node waiting and every request queued the bus is handed
+         * on from here too (a REQ release raised no flags, so there is
+         * nothing to scan); otherwise the main loop queues the new
+         * requests first, so the policy sees them all. A release that
+         * answers a lease check may have raised flags: the main loop
+         * reads them, as for a GNT release.
+         */
+        if (node_id == g_lock_holder) {
+            if (g_lease_state == LEASE_CHECK) {
+                arbiter_release(node_id, arb_now());
+                g_handoff_from = node_id;
+            } else if (ARB_DIRECT_HANDOFF != 0u &&
+                g_q_len != 0u && g_req_event_mask == 0u) {
+                arbiter_handoff(node_id);
+            } else {
+                arbiter_release(node_id, arb_now());
+            }
+            return;
         }
-        break;
-    case 0x0A:  /* P1.4 = N1_REQ */
-        g_req_event_mask |= (1u << 0);
-        break;
-    default:
-        break;
+        g_req_event_mask |= ARB_NODE_BIT(node_id);
+        return;
     }
 
+    node_id = arb_gnt_node[port - 1u][pin];
+    if (node_id != 0u) {
+        /* While the lease check is out the holder's GNT pulse is either
+         * a renewal, still high here, or a release that crossed the
+         * check, long over
+         */
+        if (node_id == g_lock_holder && g_lease_state == LEASE_CHECK) {
+            __delay_cycles(GNT_PULSE_RENEW_SAMPLE);
+            if (node_gnt_high((uint8_t)(node_id - 1u))) {
+                if (g_lease_renewals < ARB_LEASE_RENEWALS) {
+                    g_lease_renewals++;
+                    g_lease_state = LEASE_RUNNING;
+                    lease_arm(ARB_LEASE_TICKS);
+                }
+                return;
+            }
+        }
+
+        /* The holder releasing to a node it names, or after raising
+         * flags (or reset while holding): the main loop reads the handoff
+         * byte and the flags together
+         */
+        if (node_id == g_lock_holder) {
+            arbiter_release(node_id, arb_now());
+            g_handoff_from = node_id;
+            return;
+        }
+
+        queue_remove(node_id);
+        sched_forget(node_id);
+    }
+}
+
+#pragma vector = PORT1_VECTOR
+__interrupt void PORT1_ISR(void)
+{
+    arbiter_port_event(1u, P1IV);
+    __bic_SR_register_on_exit(LPM0_bits);
+}
+
+#pragma vector = PORT2_VECTOR
+__interrupt void PORT2_ISR(void)
+{
+    arbiter_port_event(2u, P2IV);
     __bic_SR_register_on_exit(LPM0_bits);
 }
 
 #pragma vector = PORT3_VECTOR
 __interrupt void PORT3_ISR(void)
 {
-    uint16_t iv = P3IV;
+    arbiter_port_event(3u, P3IV);
+    __bic_SR_register_on_exit(LPM0_bits);
+}
 
-    switch (iv) {
-    case 0x02:  /* P3.0 = N2_GNT reset pulse */
-        queue_remove(NODE2_ID);
-        if (g_lock_holder == NODE2_ID) {
-            g_lock_holder = 0u;
-            P4OUT &= ~BIT6;
-            g_need_schedule = 1u;
-            // uart_print_str("Node 2 detected\r\n");
-        }
-        break;
-    case 0x0C:  /* P3.5 = N3_REQ */
-        g_req_event_mask |= (1u << 2);
-        break;
-    case 0x0E:  /* P3.6 = N3_GNT reset pulse */
-        queue_remove(NODE3_ID);
-        if (g_lock_holder == NODE3_ID) {
-            g_lock_holder = 0u;
-            P4OUT &= ~BIT6;
-            g_need_schedule = 1u;
-            // uart_print_str("Node 3 detected\r\n");
-        }
-        break;
-    default:
-        break;
+#pragma vector = PORT4_VECTOR
+__interrupt void PORT4_ISR(void)
+{
+    arbiter_port_event(4u, P4IV);
+    __bic_SR_register_on_exit(LPM0_bits);
+}
+
+/* Lease timer: first the check pulse, then, unanswered, the revocation */
+#pragma vector = TIMER0_A0_VECTOR
+__interrupt void TIMER0_A0_ISR(void)
+{
+    uint8_t holder = g_lock_holder;
+
+    if (holder == 0u || g_lease_state == LEASE_OFF) {
+        lease_stop();
+        return;
+    }
+
+    if (g_lease_state == LEASE_RUNNING) {
+        g_lease_state = LEASE_CHECK;
+        lease_arm(ARB_LEASE_GRACE);
+        gnt_pulse_node(holder);     /* lease check */
+        return;
     }
 
+    lease_stop();
+    g_lock_holder   = 0u;
+    g_lease_revoked = holder;
+    g_need_schedule = 1u;
+    g_credit_check  = 1u;
+    P4OUT &= ~BIT6;
     __bic_SR_register_on_exit(LPM0_bits);
 }
 
@@ -419,13 +1175,24 @@ __interrupt void PORT3_ISR(void)
 
 int main(void)
 {
-    uint8_t zero = 0u;
+    uint8_t zero[1u + MAILBOX_NUM_NODES] = { 0u };
+    uint8_t idx;
 
     WDTCTL = WDTPW | WDTHOLD;
 
     clock_init_8mhz();
     uart0_init();
     arbiter_gpio_init();
+    PM5CTL0 &= ~LOCKLPM5;
+
+    // Clear any startup glitches, before the FRAM init: a node's reset
+    // notice and first REQ during it stay latched
+    P1IFG = 0u;
+    P2IFG = 0u;
+    P3IFG = 0u;
+    P4IFG = 0u;
+
+    arbiter_timer_init();
     spi_pins_init_once();
     
     fram_init();
@@ -433,24 +1200,32 @@ int main(void)
     // else { uart0_println("FRAM init failed"); P4OUT |= BIT6; P1OUT |= BIT0; return 0; }
     mailbox_init_layout();   /* initialize all boxes + clear notif */
 
-    // Clear any startup glitches
-    P1IFG = 0u;
-    P3IFG = 0u;
-
     P1OUT |= BIT0;
     P4OUT &= ~BIT6;
 
-    PM5CTL0 &= ~LOCKLPM5;
-
 
 
     g_lock_holder     = 0u;
+    g_q_head          = 0u;
     g_q_len           = 0u;
+    g_q_mask          = 0u;
     g_req_event_mask  = 0u;
     g_need_schedule   = 0u;
+    g_credit_check    = 0u;
+    g_grant_time      = 0u;
+    g_lease_state     = LEASE_OFF;
+    g_lease_revoked   = 0u;
+    g_handoff_from    = 0u;
+    g_notif_owed      = 0u;
+    g_nudged          = 0u;
+    for (idx = 0u; idx < NUM_NODES; idx++) {
+        g_req_time[idx] = 0u;
+        g_deficit[idx]  = 0;
+        g_debt[idx]     = 0u;
+    }
 
-    /* Ensure notif byte is zero */
-    fram_write_bytes(FRAM_NOTIF_BOX_ADDR, &zero, 1u);
+    /* Ensure the handoff byte and notif flags are zero */
+    fram_write_bytes(FRAM_HANDOFF_ADDR, zero, sizeof(zero));
 
     // uart0_println("Arbiter ready");
 
@@ -458,16 +1233,25 @@ int main(void)
 
     for (;;) {
         arbiter_process_req_events();
+        arbiter_process_revocation();
+        arbiter_process_handoff();
 
         if (g_need_schedule != 0u) {
             g_need_schedule = 0u;
             arbiter_schedule();
         }
 
+        arbiter_nudge_holder();
+
         __disable_interrupt();
-        arbiter_check_notifications(); 
+        arbiter_notify_owed();
+        arbiter_check_credits();
 
-        __bis_SR_register(LPM0_bits | GIE);
+        /* An ISR that ran since the top of the loop left work for it */
+        if (g_req_event_mask == 0u && g_need_schedule == 0u &&
+            g_handoff_from == 0u && g_lease_revoked == 0u) {
+            __bis_SR_register(LPM0_bits | GIE);
+        }
         __enable_interrupt();
     }
 }
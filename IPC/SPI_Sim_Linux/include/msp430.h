@@ -0,0 +1,309 @@
+#ifndef SIM_MSP430_H_
+#define SIM_MSP430_H_
+
+/* Host replacement for <msp430.h> (MSP430FR5969 subset).
+ *
+ * Only the registers, bits and intrinsics used by the IPC firmware are
+ * provided. Register names expand to lvalues inside 'sim_regs' and call
+ * sim_hook() first, so code such as
+ *
+ *     while ((UCB0IFG & UCRXIFG) == 0u) { }
+ *     DMA0SA = (uint32_t)(uintptr_t)&UCB0RXBUF;
+ *
+ * compiles and behaves unmodified. Read-to-clear registers (PxIV, DMAIV, TA1IV)
+ * and counters (TA0R, TA1R) are rvalues; PxIN and PxIFG wait for the
+ * edges other nodes raised before now.
+ */
+
+#include <stdint.h>
+#include "sim_mcu.h"
+
+extern sim_regs_t sim_regs;
+
+#define SIM_REG(kind, field)    (*(sim_hook(kind), &sim_regs.field))
+
+/* ---- Bits ---- */
+
+#define BIT0                    0x0001u
+#define BIT1                    0x0002u
+#define BIT2                    0x0004u
+#define BIT3                    0x0008u
+#define BIT4                    0x0010u
+#define BIT5                    0x0020u
+#define BIT6                    0x0040u
+#define BIT7                    0x0080u
+#define BIT8                    0x0100u
+#define BIT9                    0x0200u
+#define BITA                    0x0400u
+#define BITB                    0x0800u
+#define BITC                    0x1000u
+#define BITD                    0x2000u
+#define BITE                    0x4000u
+#define BITF                    0x8000u
+
+/* ---- Status register ---- */
+
+#define GIE                     0x0008u
+#define CPUOFF                  0x0010u
+#define OSCOFF                  0x0020u
+#define SCG0                    0x0040u
+#define SCG1                    0x0080u
+#define LPM0_bits               (CPUOFF)
+#define LPM1_bits               (SCG0 | CPUOFF)
+#define LPM3_bits               (SCG1 | SCG0 | CPUOFF)
+#define LPM4_bits               (SCG1 | SCG0 | OSCOFF | CPUOFF)
+
+/* ---- Intrinsics ---- */
+
+#define __interrupt
+#define __delay_cycles(n)               sim_delay_cycles((uint32_t)(n))
+#define __no_operation()                sim_delay_cycles(1u)
+#define _NOP()                          sim_delay_cycles(1u)
+#define __bis_SR_register(x)            sim_bis_sr((uint16_t)(x))
+#define __bic_SR_register(x)            sim_bic_sr((uint16_t)(x))
+#define __bis_SR_register_on_exit(x)    sim_bis_sr_on_exit((uint16_t)(x))
+#define __bic_SR_register_on_exit(x)    sim_bic_sr_on_exit((uint16_t)(x))
+#define __disable_interrupt()           sim_disable_interrupt()
+#define __enable_interrupt()            sim_enable_interrupt()
+#define __even_in_range(x, y)           (x)
+
+/* ---- Digital I/O ---- */
+
+#define SIM_PORT(n, f)          SIM_REG(SIM_HOOK_GPIO, port[(n) - 1].f)
+
+#define P1IN                    sim_port_in(1u)
+#define P1OUT                   SIM_PORT(1, out)
+#define P1DIR                   SIM_PORT(1, dir)
+#define P1REN                   SIM_PORT(1, ren)
+#define P1SEL0                  SIM_PORT(1, sel0)
+#define P1SEL1                  SIM_PORT(1, sel1)
+#define P1IES                   SIM_PORT(1, ies)
+#define P1IE                    SIM_PORT(1, ie)
+#define P1IFG                   (*sim_port_ifg(1u))
+#define P1IV                    sim_port_iv(1u)
+
+#define P2IN                    sim_port_in(2u)
+#define P2OUT                   SIM_PORT(2, out)
+#define P2DIR                   SIM_PORT(2, dir)
+#define P2REN                   SIM_PORT(2, ren)
+#define P2SEL0                  SIM_PORT(2, sel0)
+#define P2SEL1                  SIM_PORT(2, sel1)
+#define P2IES                   SIM_PORT(2, ies)
+#define P2IE                    SIM_PORT(2, ie)
+#define P2IFG                   (*sim_port_ifg(2u))
+#define P2IV                    sim_port_iv(2u)
+
+#define P3IN                    sim_port_in(3u)
+#define P3OUT                   SIM_PORT(3, out)
+#define P3DIR                   SIM_PORT(3, dir)
+#define P3REN                   SIM_PORT(3, ren)
+#define P3SEL0                  SIM_PORT(3, sel0)
+#define P3SEL1                  SIM_PORT(3, sel1)
+#define P3IES                   SIM_PORT(3, ies)
+#define P3IE                    SIM_PORT(3, ie)
+#define P3IFG                   (*sim_port_ifg(3u))
+#define P3IV                    sim_port_iv(3u)
+
+#define P4IN                    sim_port_in(4u)
+#define P4OUT                   SIM_PORT(4, out)
+#define P4DIR                   SIM_PORT(4, dir)
+#define P4REN                   SIM_PORT(4, ren)
+#define P4SEL0                  SIM_PORT(4, sel0)
+#define P4SEL1                  SIM_PORT(4, sel1)
+#define P4IES                   SIM_PORT(4, ies)
+#define P4IE                    SIM_PORT(4, ie)
+#define P4IFG                   (*sim_port_ifg(4u))
+#define P4IV                    sim_port_iv(4u)
+
+/* ---- Power, clock, watchdog ---- */
+
+#define PM5CTL0                 SIM_REG(SIM_HOOK_GPIO, pm5ctl0)
+#define LOCKLPM5                0x0001u
+
+#define PMMCTL0                 SIM_REG(SIM_HOOK_GPIO, pmmctl0)
+#define PMMPW                   0xA500u
+#define PMMSWBOR                0x0004u
+#define PMMSWPOR                0x0008u
+
+#define WDTCTL                  SIM_REG(SIM_HOOK_GPIO, wdtctl)
+#define WDTPW                   0x5A00u
+#define WDTHOLD                 0x0080u
+
+#define CSCTL0_H                SIM_REG(SIM_HOOK_GPIO, csctl0_h)
+#define CSCTL1                  SIM_REG(SIM_HOOK_GPIO, csctl1)
+#define CSCTL2                  SIM_REG(SIM_HOOK_GPIO, csctl2)
+#define CSCTL3                  SIM_REG(SIM_HOOK_GPIO, csctl3)
+#define CSKEY                   0xA500u
+#define DCOFSEL_6               0x000Cu
+#define SELS__DCOCLK            0x0030u
+#define SELM__DCOCLK            0x0003u
+#define DIVS__1                 0x0000u
+#define DIVM__1                 0x0000u
+
+/* ---- eUSCI (shared bit names) ---- */
+
+#define UCSWRST                 0x0001u
+#define UCSTEM                  0x0002u
+#define UCSSEL__UCLK            0x0000u
+#define UCSSEL__ACLK            0x0040u
+#define UCSSEL__SMCLK           0x0080u
+#define UCSYNC                  0x0100u
+#define UCMODE_0                0x0000u
+#define UCMST                   0x0800u
+#define UC7BIT                  0x1000u
+#define UCMSB                   0x2000u
+#define UCCKPL                  0x4000u
+#define UCCKPH                  0x8000u
+
+#define UCRXIFG                 0x0001u
+#define UCTXIFG                 0x0002u
+#define UCRXIE                  0x0001u
+#define UCTXIE                  0x0002u
+
+#define UCBUSY                  0x0001u
+#define UCOE                    0x0020u
+#define UCFE                    0x0040u
+
+/* ---- eUSCI_B0 (SPI) ---- */
+
+#define UCB0CTLW0               SIM_REG(SIM_HOOK_SPI, ucb0_ctlw0)
+#define UCB0BRW                 SIM_REG(SIM_HOOK_SPI, ucb0_brw)
+#define UCB0STATW               SIM_REG(SIM_HOOK_SPI_SYNC, ucb0_statw)
+#define UCB0RXBUF               SIM_REG(SIM_HOOK_SPI_RX, ucb0_rxbuf)
+#define UCB0TXBUF               SIM_REG(SIM_HOOK_SPI, ucb0_txbuf)
+#define UCB0IE                  SIM_REG(SIM_HOOK_SPI, ucb0_ie)
+#define UCB0IFG                 SIM_REG(SIM_HOOK_SPI_SYNC, ucb0_ifg)
+
+/* ---- eUSCI_A0 (UART) ---- */
+
+#define UCA0CTLW0               SIM_REG(SIM_HOOK_UART, uca0_ctlw0)
+#define UCA0BR0                 SIM_REG(SIM_HOOK_UART, uca0_br0)
+#define UCA0BR1                 SIM_REG(SIM_HOOK_UART, uca0_br1)
+#define UCA0MCTLW               SIM_REG(SIM_HOOK_UART, uca0_mctlw)
+#define UCA0TXBUF               SIM_REG(SIM_HOOK_UART, uca0_txbuf)
+#define UCA0IFG                 SIM_REG(SIM_HOOK_UART, uca0_ifg)
+
+/* ---- DMA ---- */
+
+#define DMACTL0                 SIM_REG(SIM_HOOK_SPI, dmactl0)
+#define DMACTL1                 SIM_REG(SIM_HOOK_SPI, dmactl1)
+#define DMACTL4                 SIM_REG(SIM_HOOK_SPI, dmactl4)
+#define DMAIV                   sim_dma_iv()
+
+#define DMA0CTL                 SIM_REG(SIM_HOOK_SPI_SYNC, dma[0].ctl)
+#define DMA0SA                  SIM_REG(SIM_HOOK_SPI, dma[0].sa)
+#define DMA0DA                  SIM_REG(SIM_HOOK_SPI, dma[0].da)
+#define DMA0SZ                  SIM_REG(SIM_HOOK_SPI, dma[0].sz)
+#define DMA1CTL                 SIM_REG(SIM_HOOK_SPI_SYNC, dma[1].ctl)
+#define DMA1SA                  SIM_REG(SIM_HOOK_SPI, dma[1].sa)
+#define DMA1DA                  SIM_REG(SIM_HOOK_SPI, dma[1].da)
+#define DMA1SZ                  SIM_REG(SIM_HOOK_SPI, dma[1].sz)
+#define DMA2CTL                 SIM_REG(SIM_HOOK_SPI_SYNC, dma[2].ctl)
+#define DMA2SA                  SIM_REG(SIM_HOOK_SPI, dma[2].sa)
+#define DMA2DA                  SIM_REG(SIM_HOOK_SPI, dma[2].da)
+#define DMA2SZ                  SIM_REG(SIM_HOOK_SPI, dma[2].sz)
+
+/* DMACTL0/1 trigger select: channel 0/2 in bits 0-4, channel 1 in bits 8-12 */
+#define DMA0TSEL0               0x0001u
+#define DMA0TSEL1               0x0002u
+#define DMA0TSEL2               0x0004u
+#define DMA0TSEL3               0x0008u
+#define DMA0TSEL4               0x0010u
+#define DMA1TSEL0               0x0100u
+#define DMA1TSEL1               0x0200u
+#define DMA1TSEL2               0x0400u
+#define DMA1TSEL3               0x0800u
+#define DMA1TSEL4               0x1000u
+#define DMA2TSEL0               0x0001u
+#define DMA2TSEL1               0x0002u
+#define DMA2TSEL2               0x0004u
+#define DMA2TSEL3               0x0008u
+#define DMA2TSEL4               0x0010u
+
+#define DMA0TSEL__DMAREQ        0x0000u
+#define DMA0TSEL__UCB0RXIFG0    0x0012u
+#define DMA0TSEL__UCB0TXIFG0    0x0013u
+#define DMA1TSEL__DMAREQ        0x0000u
+#define DMA1TSEL__UCB0RXIFG0    0x1200u
+#define DMA1TSEL__UCB0TXIFG0    0x1300u
+#define DMA2TSEL__DMAREQ        0x0000u
+#define DMA2TSEL__UCB0RXIFG0    0x0012u
+#define DMA2TSEL__UCB0TXIFG0    0x0013u
+
+#define ENNMI                   0x0001u
+#define ROUNDROBIN              0x0002u
+#define DMARMWDIS               0x0004u
+
+#define DMAREQ                  0x0001u
+#define DMAABORT                0x0002u
+#define DMAIE                   0x0004u
+#define DMAIFG                  0x0008u
+#define DMAEN                   0x0010u
+#define DMALEVEL                0x0020u
+#define DMASRCBYTE              0x0040u
+#define DMADSTBYTE              0x0080u
+#define DMASBDB                 (DMASRCBYTE | DMADSTBYTE)
+#define DMASRCINCR_0            0x0000u
+#define DMASRCINCR_2            0x0200u
+#define DMASRCINCR_3            0x0300u
+#define DMADSTINCR_0            0x0000u
+#define DMADSTINCR_2            0x0800u
+#define DMADSTINCR_3            0x0C00u
+#define DMADT_0                 0x0000u
+#define DMADT_1                 0x1000u
+#define DMADT_4                 0x4000u
+
+#define DMAIV_DMA0IFG           0x0002u
+#define DMAIV_DMA1IFG           0x0004u
+#define DMAIV_DMA2IFG           0x0006u
+
+/* ---- Timer_A0 ---- */
+
+#define TA0CTL                  SIM_REG(SIM_HOOK_GPIO, ta0ctl)
+#define TA0EX0                  SIM_REG(SIM_HOOK_GPIO, ta0ex0)
+#define TA0R                    sim_ta0r()
+#define TA0CCTL0                SIM_REG(SIM_HOOK_GPIO, ta0cctl0)
+#define TA0CCR0                 SIM_REG(SIM_HOOK_GPIO, ta0ccr0)
+
+#define TASSEL__ACLK            0x0100u
+#define TASSEL__SMCLK           0x0200u
+#define MC__STOP                0x0000u
+#define MC__UP                  0x0010u
+#define MC__CONTINUOUS          0x0020u
+#define TACLR                   0x0004u
+#define ID__1                   0x0000u
+#define ID__2                   0x0040u
+#define ID__4                   0x0080u
+#define ID__8                   0x00C0u
+#define TAIDEX_0                0x0000u
+#define TAIDEX_4                0x0004u
+#define TAIDEX_7                0x0007u
+
+#define CCIFG                   0x0001u
+#define COV                     0x0002u
+#define CCI                     0x0008u
+#define CCIE                    0x0010u
+#define CAP                     0x0100u
+#define SCS                     0x0800u
+#define CCIS_0                  0x0000u
+#define CCIS_3                  0x3000u
+#define CM_1                    0x4000u
+#define CM_2                    0x8000u
+#define CM_3                    0xC000u
+
+/* ---- Timer_A1 ---- */
+
+#define TA1CTL                  SIM_REG(SIM_HOOK_GPIO, ta1ctl)
+#define TA1R                    sim_ta1r()
+#define TA1CCTL0                SIM_REG(SIM_HOOK_GPIO, ta1cctl0)
+#define TA1CCR0                 SIM_REG(SIM_HOOK_GPIO, ta1ccr0)
+#define TA1CCTL1                SIM_REG(SIM_HOOK_GPIO, ta1cctl1)
+#define TA1CCR1                 SIM_REG(SIM_HOOK_GPIO, ta1ccr1)
+#define TA1CCTL2                SIM_REG(SIM_HOOK_GPIO, ta1cctl2)
+#define TA1CCR2                 SIM_REG(SIM_HOOK_GPIO, ta1ccr2)
+#define TA1IV                   sim_ta1iv()
+
+#define TA1IV_TACCR1            0x0002u
+#define TA1IV_TACCR2            0x0004u
+
+#endif /* SIM_MSP430_H_ */
@@ -0,0 +1,1159 @@
+/*
+ * msp_sim: multi-node host simulator for the FRAM mailbox IPC stack.
+ *
+ *   msp_sim [options] ARBITER.so NODE1.so [NODE2.so ...]
+ *
+ * Each image is an unmodified MSP430 program (SPI_Arbitrar_5969 or
+ * SPI_Worker_5969 + one of its evals) compiled for the host against
+ * include/msp430.h. Every MCU runs its main() on one pthread and its
+ * interrupt handlers on a second one; REQ/GNT lines are wired between
+ * nodes as timestamped pin events and the shared FRAM is an mmap'd image.
+ *
+ * Time is modeled per MCU in MCLK cycles (see sim_timing_t). Pin events
+ * carry the sender's timestamp and are applied by the receiver once its
+ * own clock has reached that time, or immediately if it is idle (in LPM,
+ * finished, or spinning on a flag without touching a peripheral). An
+ * interrupt taken this way advances the receiver's clock to at least the
+ * event time. There is no global lookahead barrier, so two nodes racing
+ * for the arbiter are ordered by host scheduling, not by modeled time.
+ */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <getopt.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <msp430.h>
+#include "sim.h"
+
+#define SIM_STACK_SIZE      (1024u * 1024u)
+#define SIM_ISR_POLL_NS     2000000L
+#define SIM_STALL_CPU_NS    2000000ull
+
+sim_timing_t sim_timing = {
+    8000000u,   /* mclk_hz     */
+    0u,         /* spi_div     */
+    16u,        /* poll_cycles */
+    1u,         /* reg_cycles  */
+    2u,         /* dma_cycles  */
+    4u,         /* cs_cycles   */
+    30u,        /* isr_cycles  */
+};
+
+/* ---- Wiring ---- */
+
+typedef struct {
+    uint8_t port;           /* 1-based */
+    uint8_t pin;
+} sim_pin_t;
+
+/* Arbiter side of each worker's REQ/GNT pair: the rows of ARB_NODE_PINS
+ * in SPI_Arbitrar_5969/main.c, in node order. Workers beyond the first 3
+ * need an arbiter built with -DNUM_NODES=n (and -DMAILBOX_NUM_NODES=n
+ * everywhere when n > 4).
+ */
+static const sim_pin_t arb_req_pin[SIM_MAX_WORKERS] = {
+    {1u, 4u}, {1u, 2u}, {3u, 5u}, {3u, 1u}, {3u, 3u}, {2u, 3u},
+    {2u, 5u}, {4u, 0u}, {4u, 2u}, {4u, 4u}, {3u, 7u}, {1u, 1u}
+};
+static const sim_pin_t arb_gnt_pin[SIM_MAX_WORKERS] = {
+    {1u, 3u}, {3u, 0u}, {3u, 6u}, {3u, 2u}, {3u, 4u}, {2u, 4u},
+    {2u, 6u}, {4u, 1u}, {4u, 3u}, {4u, 5u}, {4u, 7u}, {2u, 7u}
+};
+
+/* Worker side: REQ P1.4 out, GNT P1.3 in */
+static const sim_pin_t node_req_pin = { 1u, 4u };
+static const sim_pin_t node_gnt_pin = { 1u, 3u };
+
+typedef struct {
+    sim_mcu_t *mcu[2];
+    sim_pin_t  pin[2];
+    uint8_t    drivers;     /* bit per endpoint driving high */
+    uint8_t    level;
+} sim_net_t;
+
+static sim_net_t       nets[2u * SIM_MAX_WORKERS];
+static unsigned        net_count;
+static pthread_mutex_t nets_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* ---- Global state ---- */
+
+static sim_mcu_t       mcus[SIM_MAX_MCUS];
+static unsigned        mcu_count;
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  sim_cv   = PTHREAD_COND_INITIALIZER;
+static volatile int    sim_stopping;
+static int             sim_quiet_flag;
+
+static __thread sim_mcu_t *t_self;
+static __thread int        t_isr;
+
+static const char *const isr_names[SIM_VEC_COUNT] = {
+    "DMA_ISR", "PORT1_ISR", "PORT2_ISR", "PORT3_ISR", "PORT4_ISR",
+    "TIMER0_A0_ISR", "TIMER1_A0_ISR", "TIMER1_A1_ISR"
+};
+
+sim_mcu_t *sim_self(void) { return t_self; }
+int sim_in_isr(void) { return t_isr; }
+int sim_quiet(void) { return sim_quiet_flag; }
+
+static void sim_park(void)
+{
+    for (;;) {
+        pause();
+    }
+}
+
+/* ---- Pin events ---- */
+
+void sim_post_pin(sim_mcu_t *m, uint8_t port, uint8_t pin, uint8_t level,
+                  uint64_t t)
+{
+    sim_event_t *ev = malloc(sizeof(*ev));
+
+    if (ev == NULL) {
+        abort();
+    }
+    ev->next  = NULL;
+    ev->t     = t;
+    ev->port  = port;
+    ev->pin   = pin;
+    ev->level = level;
+
+    pthread_mutex_lock(&m->lock);
+    if (m->ev_tail == NULL) {
+        m->ev_head = ev;
+        m->ev_tail = ev;
+    } else if (m->ev_tail->t <= t) {
+        m->ev_tail->next = ev;
+        m->ev_tail = ev;
+    } else {
+        /* Keep the queue in timestamp order across senders */
+        sim_event_t **pp = &m->ev_head;
+        while ((*pp)->t <= t) {
+            pp = &(*pp)->next;
+        }
+        ev->next = *pp;
+        *pp = ev;
+    }
+    pthread_cond_broadcast(&m->cv);
+    pthread_mutex_unlock(&m->lock);
+}
+
+/* The far end of net n from m drives it high and has not reached time t
+ * yet (busy counts as not there yet). Takes nets_lock and the far end's.
+ */
+static int sim_net_held_before(sim_net_t *n, const sim_mcu_t *m, uint64_t t)
+{
+    unsigned far = (n->mcu[0] == m) ? 1u : 0u;
+    sim_mcu_t *o = n->mcu[far];
+    uint8_t held;
+    int behind;
+
+    pthread_mutex_lock(&nets_lock);
+    held = (uint8_t)((n->drivers >> far) & 1u);
+    pthread_mutex_unlock(&nets_lock);
+    if (held == 0u) {
+        return 0;
+    }
+    if (pthread_mutex_trylock(&o->lock) != 0) {
+        return 1;
+    }
+    behind = o->done == 0u && o->clock < t &&
+             ((o->lpm == 0u && o->stalled == 0u) || o->in_isr != 0u);
+    pthread_mutex_unlock(&o->lock);
+    return behind;
+}
+
+void sim_net_drive(sim_mcu_t *m, int net, uint8_t level, uint64_t t)
+{
+    sim_net_t *n = &nets[net];
+    sim_mcu_t *to = NULL;
+    sim_pin_t  to_pin = { 0u, 0u };
+    uint8_t    new_level = 0u;
+    unsigned   e;
+
+    /* The net is resolved in host order: while the far end still drives
+     * it, let that node reach t first, so that a pulse of its own ending
+     * earlier in modeled time is not merged with this one
+     */
+    while (!sim_stopping && sim_net_held_before(n, m, t)) {
+        sched_yield();
+    }
+
+    pthread_mutex_lock(&nets_lock);
+    for (e = 0u; e < 2u; e++) {
+        if (n->mcu[e] != m) {
+            continue;
+        }
+        if (level != 0u) {
+            n->drivers |= (uint8_t)(1u << e);
+        } else {
+            n->drivers &= (uint8_t)~(1u << e);
+        }
+        if ((uint8_t)(n->drivers != 0u) != n->level) {
+            n->level  = (uint8_t)(n->drivers != 0u);
+            new_level = n->level;
+            to     = n->mcu[e ^ 1u];
+            to_pin = n->pin[e ^ 1u];
+        }
+    }
+    pthread_mutex_unlock(&nets_lock);
+
+    if (to != NULL) {
+        sim_post_pin(to, to_pin.port, to_pin.pin, new_level, t);
+    }
+}
+
+static void sim_deliver(sim_mcu_t *m, const sim_drive_t *d, unsigned n)
+{
+    unsigned i;
+
+    for (i = 0u; i < n; i++) {
+        sim_net_drive(m, d[i].net, d[i].level, d[i].t);
+    }
+}
+
+/* Events and interrupts become visible once the local clock reaches them;
+ * an idle main context takes them at once. Lock held.
+ */
+static uint64_t sim_horizon(const sim_mcu_t *m)
+{
+    if (m->lpm != 0u || m->done != 0u || m->stalled != 0u) {
+        return UINT64_MAX;
+    }
+    return m->clock;
+}
+
+static int sim_dispatchable(sim_mcu_t *m, uint64_t horizon, uint64_t *t);
+
+/* Apply due pin events: input level and edge-selected PxIFG. Stops at the
+ * first edge that makes an interrupt dispatchable so that back-to-back
+ * pulses are not merged into one PxIFG while the MCU sleeps. Lock held.
+ */
+static unsigned sim_apply_events(sim_mcu_t *m, uint64_t horizon)
+{
+    sim_event_t *ev;
+    unsigned n = 0u;
+    uint64_t t;
+
+    while ((ev = m->ev_head) != NULL && ev->t <= horizon) {
+        if (sim_dispatchable(m, horizon, &t) >= 0) {
+            break;
+        }
+        sim_port_regs_t *pr = &m->regs->port[ev->port - 1u];
+        uint8_t bit = (uint8_t)(1u << ev->pin);
+        uint8_t old = (uint8_t)((m->net_in[ev->port - 1u] & bit) != 0u);
+
+        m->ev_head = ev->next;
+        if (m->ev_head == NULL) {
+            m->ev_tail = NULL;
+        }
+
+        if (ev->level != 0u) {
+            m->net_in[ev->port - 1u] |= bit;
+        } else {
+            m->net_in[ev->port - 1u] &= (uint8_t)~bit;
+        }
+
+        /* PxIES = 0: low-to-high edge, PxIES = 1: high-to-low edge */
+        if (old != ev->level && ((pr->ies & bit) != 0u) == (ev->level == 0u)) {
+            pr->ifg |= bit;
+            if (ev->t > m->port_ifg_t[ev->port - 1u]) {
+                m->port_ifg_t[ev->port - 1u] = ev->t;
+            }
+        }
+        if (old != ev->level) {
+            sim_ta1_capture(m, ev->port, ev->pin, ev->level, ev->t);
+        }
+        free(ev);
+        n++;
+    }
+    return n;
+}
+
+/* Highest-priority pending, enabled interrupt, or -1. Lock held. */
+static int sim_pending_vector(sim_mcu_t *m, uint64_t *t)
+{
+    sim_regs_t *r = m->regs;
+    unsigned i;
+
+    if ((r->ta0cctl0 & (CCIFG | CCIE)) == (CCIFG | CCIE)) {
+        *t = m->cmp[SIM_CMP_TA0_0].ifg_t;
+        return SIM_VEC_TIMER0_A0;
+    }
+    for (i = 0u; i < SIM_NUM_DMA; i++) {
+        if ((r->dma[i].ctl & (DMAIFG | DMAIE)) == (DMAIFG | DMAIE)) {
+            *t = m->dma_ifg_t;
+            return SIM_VEC_DMA;
+        }
+    }
+    if ((r->ta1cctl0 & (CCIFG | CCIE)) == (CCIFG | CCIE)) {
+        *t = m->cmp[SIM_CMP_TA1_0].ifg_t;
+        return SIM_VEC_TIMER1_A0;
+    }
+    if ((r->ta1cctl1 & (CCIFG | CCIE)) == (CCIFG | CCIE)) {
+        *t = m->cmp[SIM_CMP_TA1_1].ifg_t;
+        return SIM_VEC_TIMER1_A1;
+    }
+    if ((r->ta1cctl2 & (CCIFG | CCIE)) == (CCIFG | CCIE)) {
+        *t = m->ta1_ifg_t;
+        return SIM_VEC_TIMER1_A1;
+    }
+    for (i = 0u; i < SIM_NUM_PORTS; i++) {
+        if ((r->port[i].ifg & r->port[i].ie) != 0u) {
+            *t = m->port_ifg_t[i];
+            return (int)(SIM_VEC_PORT1 + i);
+        }
+    }
+    return -1;
+}
+
+/* Vector that can be taken now, or -1. Lock held. */
+static int sim_dispatchable(sim_mcu_t *m, uint64_t horizon, uint64_t *t)
+{
+    int vec = sim_pending_vector(m, t);
+
+    if (vec < 0 || m->gie == 0u || m->in_isr != 0u || *t > horizon) {
+        return -1;
+    }
+    return vec;
+}
+
+/* Compare channel with the earliest armed match whose CCIFG is clear, or
+ * -1. Lock held.
+ */
+static int sim_cmp_next(const sim_mcu_t *m)
+{
+    unsigned c;
+    int next = -1;
+
+    for (c = 0u; c < SIM_NUM_CMP; c++) {
+        if (m->cmp[c].match_t == 0u ||
+            (*sim_cmp_cctl(m->regs, c) & CCIFG) != 0u) {
+            continue;
+        }
+        if (next < 0 || m->cmp[c].match_t < m->cmp[next].match_t) {
+            next = (int)c;
+        }
+    }
+    return next;
+}
+
+/* Every other node is past time t, or idle with nothing due before it,
+ * so no earlier pin event can still reach m. Lock of m held; the others
+ * are only tried, a busy one counts as not there yet.
+ */
+static int sim_others_reached(const sim_mcu_t *m, uint64_t t)
+{
+    unsigned i;
+    int reached = 1;
+    uint64_t t_irq;
+    int c;
+
+    for (i = 0u; i < mcu_count && reached; i++) {
+        sim_mcu_t *o = &mcus[i];
+
+        if (o == m) {
+            continue;
+        }
+        if (pthread_mutex_trylock(&o->lock) != 0) {
+            return 0;
+        }
+        c = sim_cmp_next(o);
+        reached = o->done != 0u || o->clock >= t ||
+                  ((o->lpm != 0u || o->stalled != 0u) && o->in_isr == 0u &&
+                   (o->ev_head == NULL || o->ev_head->t >= t) &&
+                   (c < 0 || o->cmp[c].match_t >= t) &&
+                   (sim_pending_vector(o, &t_irq) < 0 || t_irq >= t));
+        pthread_mutex_unlock(&o->lock);
+    }
+    return reached;
+}
+
+/* Compare channel whose match is due, or -1: the modeled time has come,
+ * m has taken every earlier event and interrupt, and no other node could
+ * still send an earlier event. Lock held.
+ */
+static int sim_timer_due(sim_mcu_t *m, uint64_t horizon)
+{
+    uint64_t t_irq;
+    uint64_t t;
+    int c = sim_cmp_next(m);
+
+    if (c < 0 || m->cmp[c].match_t > horizon) {
+        return -1;
+    }
+    t = m->cmp[c].match_t;
+    if ((m->ev_head != NULL && m->ev_head->t < t) ||
+        (sim_pending_vector(m, &t_irq) >= 0 && t_irq < t)) {
+        return -1;
+    }
+    return sim_others_reached(m, t) ? c : -1;
+}
+
+/* Work the ISR thread would do now for the given horizon. Lock held. */
+static int sim_isr_ready(sim_mcu_t *m, uint64_t horizon)
+{
+    uint64_t t;
+
+    if (m->ev_head != NULL && m->ev_head->t <= horizon) {
+        return 1;
+    }
+    if (sim_timer_due(m, horizon) >= 0) {
+        return 1;
+    }
+    return sim_dispatchable(m, horizon, &t) >= 0;
+}
+
+/* ---- Main-context helpers ---- */
+
+/* The main context waits while an interrupt is running or due, and at a
+ * compare match its clock has passed that is not raised yet because
+ * another node could still send an earlier event: it must not run on
+ * past the interrupt (and e.g. cancel it). Lock held.
+ */
+static int sim_main_held(sim_mcu_t *m)
+{
+    int c;
+
+    if (m->in_isr != 0u || sim_isr_ready(m, m->clock)) {
+        return 1;
+    }
+    c = sim_cmp_next(m);
+    return m->gie != 0u && c >= 0 && m->cmp[c].match_t <= m->clock;
+}
+
+/* Every peripheral access is a preemption point: hand over to the ISR
+ * thread while an interrupt is due or running, then continue.
+ */
+static void sim_enter(sim_mcu_t *m)
+{
+    if (sim_stopping) {
+        sim_park();
+    }
+    pthread_mutex_lock(&m->lock);
+    m->clock += sim_timing.reg_cycles;
+    if (t_isr) {
+        return;
+    }
+    m->main_hooks++;
+    m->stalled = 0u;
+    while (sim_main_held(m)) {
+        pthread_cond_broadcast(&m->cv);
+        pthread_cond_wait(&m->cv, &m->lock);
+    }
+}
+
+void sim_hook(unsigned kind)
+{
+    sim_mcu_t *m = t_self;
+    sim_drive_t d[SIM_MAX_DRIVES];
+    unsigned n;
+
+    sim_enter(m);
+    n = sim_periph_step(m, kind, d);
+    pthread_mutex_unlock(&m->lock);
+    sim_deliver(m, d, n);
+}
+
+void sim_delay_cycles(uint32_t cycles)
+{
+    sim_mcu_t *m = t_self;
+    sim_drive_t d[SIM_MAX_DRIVES];
+    unsigned n;
+
+    sim_enter(m);
+    n = sim_periph_step(m, SIM_HOOK_GPIO, d);
+    m->clock += cycles;
+    pthread_mutex_unlock(&m->lock);
+    sim_deliver(m, d, n);
+}
+
+/* Any input pin of port p (0-based) wired to another node. Lock held. */
+static int sim_port_wired(const sim_mcu_t *m, unsigned p)
+{
+    unsigned pin;
+
+    for (pin = 0u; pin < 8u; pin++) {
+        if ((m->regs->port[p].dir & (1u << pin)) == 0u && m->net_of[p][pin] >= 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Sampling a line (or its latched edges) of port p is only exact once
+ * every edge driven onto it before now has arrived: wait for the other
+ * nodes to catch up. Lock held.
+ */
+static void sim_port_sync(sim_mcu_t *m, unsigned p)
+{
+    if (!sim_port_wired(m, p)) {
+        return;
+    }
+    while (!sim_stopping && !sim_others_reached(m, m->clock)) {
+        pthread_mutex_unlock(&m->lock);
+        sched_yield();
+        pthread_mutex_lock(&m->lock);
+        if (!t_isr) {
+            /* Waiting, not spinning: no stall, so that no edge after now
+             * is applied early (and e.g. cleared with the old ones)
+             */
+            m->main_hooks++;
+        }
+    }
+    if (t_isr) {
+        /* A handler polling a pin: nobody else applies its events */
+        (void)sim_apply_events(m, m->clock);
+    } else {
+        while (sim_main_held(m)) {
+            pthread_cond_broadcast(&m->cv);
+            pthread_cond_wait(&m->cv, &m->lock);
+        }
+    }
+}
+
+uint8_t sim_port_in(unsigned port)
+{
+    sim_mcu_t *m = t_self;
+    const sim_port_regs_t *pr;
+    unsigned p = port - 1u;
+    uint8_t v = 0u;
+    unsigned pin;
+
+    sim_hook(SIM_HOOK_GPIO);
+    pthread_mutex_lock(&m->lock);
+    sim_port_sync(m, p);
+    pr = &m->regs->port[p];
+    for (pin = 0u; pin < 8u; pin++) {
+        uint8_t bit = (uint8_t)(1u << pin);
+
+        if ((pr->dir & bit) != 0u) {
+            v |= (uint8_t)(pr->out & bit);
+        } else if (m->net_of[p][pin] >= 0) {
+            v |= (uint8_t)(m->net_in[p] & bit);
+        } else if ((m->in_force_mask[p] & bit) != 0u) {
+            v |= (uint8_t)(m->in_force_val[p] & bit);
+        } else if ((pr->ren & bit) != 0u) {
+            v |= (uint8_t)(pr->out & bit);      /* pull-up / pull-down */
+        }
+    }
+    pthread_mutex_unlock(&m->lock);
+    return v;
+}
+
+/* PxIFG holds every edge raised before now, as on the chip: a node that
+ * reads or clears a latched edge with interrupts off must see the late
+ * ones too
+ */
+volatile uint8_t *sim_port_ifg(unsigned port)
+{
+    sim_mcu_t *m = t_self;
+
+    sim_hook(SIM_HOOK_GPIO);
+    pthread_mutex_lock(&m->lock);
+    sim_port_sync(m, port - 1u);
+    pthread_mutex_unlock(&m->lock);
+    return &m->regs->port[port - 1u].ifg;
+}
+
+uint16_t sim_port_iv(unsigned port)
+{
+    sim_mcu_t *m = t_self;
+    sim_port_regs_t *pr;
+    uint16_t iv = 0u;
+    unsigned pin;
+
+    sim_hook(SIM_HOOK_GPIO);
+    pthread_mutex_lock(&m->lock);
+    pr = &m->regs->port[port - 1u];
+    for (pin = 0u; pin < 8u; pin++) {
+        uint8_t bit = (uint8_t)(1u << pin);
+
+        if ((pr->ifg & pr->ie & bit) != 0u) {
+            pr->ifg &= (uint8_t)~bit;
+            iv = (uint16_t)(2u * (pin + 1u));
+            break;
+        }
+    }
+    pthread_mutex_unlock(&m->lock);
+    return iv;
+}
+
+uint16_t sim_dma_iv(void)
+{
+    sim_mcu_t *m = t_self;
+    uint16_t iv = 0u;
+    unsigned ch;
+
+    sim_hook(SIM_HOOK_SPI);
+    pthread_mutex_lock(&m->lock);
+    for (ch = 0u; ch < SIM_NUM_DMA; ch++) {
+        volatile uint16_t *ctl = &m->regs->dma[ch].ctl;
+
+        if ((*ctl & (DMAIFG | DMAIE)) == (DMAIFG | DMAIE)) {
+            *ctl &= (uint16_t)~DMAIFG;
+            iv = (uint16_t)(2u * (ch + 1u));
+            break;
+        }
+    }
+    pthread_mutex_unlock(&m->lock);
+    return iv;
+}
+
+uint16_t sim_ta0r(void)
+{
+    sim_mcu_t *m = t_self;
+    uint64_t ticks;
+
+    /* The hook applies a pending TACLR */
+    sim_hook(SIM_HOOK_GPIO);
+    pthread_mutex_lock(&m->lock);
+    ticks = sim_ta_ticks(m);
+    pthread_mutex_unlock(&m->lock);
+    return (uint16_t)ticks;
+}
+
+uint16_t sim_ta1r(void)
+{
+    sim_mcu_t *m = t_self;
+    uint64_t ticks;
+
+    sim_hook(SIM_HOOK_GPIO);
+    pthread_mutex_lock(&m->lock);
+    ticks = sim_ta1_ticks(m, m->clock);
+    pthread_mutex_unlock(&m->lock);
+    return (uint16_t)ticks;
+}
+
+/* CCR1 and CCR2: reading TA1IV clears the CCIFG of the highest one */
+uint16_t sim_ta1iv(void)
+{
+    sim_mcu_t *m = t_self;
+    uint16_t iv = 0u;
+
+    sim_hook(SIM_HOOK_GPIO);
+    pthread_mutex_lock(&m->lock);
+    if ((m->regs->ta1cctl1 & (CCIFG | CCIE)) == (CCIFG | CCIE)) {
+        m->regs->ta1cctl1 &= (uint16_t)~CCIFG;
+        iv = TA1IV_TACCR1;
+    } else if ((m->regs->ta1cctl2 & (CCIFG | CCIE)) == (CCIFG | CCIE)) {
+        m->regs->ta1cctl2 &= (uint16_t)~CCIFG;
+        iv = TA1IV_TACCR2;
+    }
+    pthread_mutex_unlock(&m->lock);
+    return iv;
+}
+
+/* ---- Status register ---- */
+
+void sim_bis_sr(uint16_t bits)
+{
+    sim_mcu_t *m = t_self;
+    sim_drive_t d[SIM_MAX_DRIVES];
+    unsigned n;
+
+    if (t_isr) {
+        return;
+    }
+
+    sim_enter(m);
+    n = sim_periph_step(m, SIM_HOOK_GPIO, d);
+    if ((bits & GIE) != 0u) {
+        m->gie = 1u;
+    }
+    if ((bits & CPUOFF) != 0u) {
+        m->lpm = 1u;
+    }
+    pthread_cond_broadcast(&m->cv);
+    pthread_mutex_unlock(&m->lock);
+    sim_deliver(m, d, n);
+
+    if ((bits & CPUOFF) == 0u) {
+        return;
+    }
+
+    pthread_mutex_lock(&sim_lock);
+    pthread_cond_broadcast(&sim_cv);
+    pthread_mutex_unlock(&sim_lock);
+
+    pthread_mutex_lock(&m->lock);
+    while (m->lpm != 0u || m->in_isr) {
+        pthread_cond_wait(&m->cv, &m->lock);
+    }
+    pthread_mutex_unlock(&m->lock);
+}
+
+void sim_bic_sr(uint16_t bits)
+{
+    if ((bits & GIE) != 0u) {
+        sim_disable_interrupt();
+    }
+}
+
+void sim_bis_sr_on_exit(uint16_t bits)
+{
+    (void)bits;
+}
+
+void sim_bic_sr_on_exit(uint16_t bits)
+{
+    sim_mcu_t *m = t_self;
+
+    if (t_isr) {
+        m->sr_clear_on_exit |= bits;
+    }
+}
+
+void sim_disable_interrupt(void)
+{
+    sim_mcu_t *m = t_self;
+
+    if (t_isr) {
+        return;
+    }
+    sim_enter(m);
+    m->gie = 0u;
+    pthread_mutex_unlock(&m->lock);
+}
+
+void sim_enable_interrupt(void)
+{
+    sim_mcu_t *m = t_self;
+
+    if (t_isr) {
+        return;
+    }
+    sim_enter(m);
+    m->gie = 1u;
+    pthread_cond_broadcast(&m->cv);
+    pthread_mutex_unlock(&m->lock);
+}
+
+/* ---- Threads ---- */
+
+/* A main context that burns CPU without touching a peripheral is spinning
+ * on a flag only an interrupt can set: treat it as idle. Lock held.
+ */
+static void sim_check_stall(sim_mcu_t *m)
+{
+    clockid_t cid;
+    struct timespec ts;
+    uint64_t cpu;
+
+    if (m->lpm != 0u || m->done != 0u || m->in_isr != 0u ||
+        pthread_getcpuclockid(m->main_tid, &cid) != 0 ||
+        clock_gettime(cid, &ts) != 0) {
+        return;
+    }
+    cpu = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+
+    if (m->main_hooks != m->stall_seen_hooks) {
+        m->stall_seen_hooks = m->main_hooks;
+        m->stall_cpu_mark   = cpu;
+    } else if (cpu - m->stall_cpu_mark >= SIM_STALL_CPU_NS) {
+        m->stalled = 1u;
+    }
+}
+
+static void *sim_isr_thread(void *arg)
+{
+    sim_mcu_t *m = arg;
+
+    t_self = m;
+    t_isr  = 1;
+
+    pthread_mutex_lock(&m->lock);
+    for (;;) {
+        uint64_t horizon;
+        uint64_t t = 0u;
+        int vec;
+        int c;
+
+        horizon = sim_horizon(m);
+        if (sim_apply_events(m, horizon) != 0u) {
+            /* The main context may be waiting for exactly these */
+            pthread_cond_broadcast(&m->cv);
+        }
+        c = sim_timer_due(m, horizon);
+        if (c >= 0) {
+            /* Continuous mode: the next match is one counter wrap later */
+            sim_cmp_t *k = &m->cmp[c];
+
+            *sim_cmp_cctl(m->regs, (unsigned)c) |= CCIFG;
+            k->ifg_t    = k->match_t;
+            k->match_t += 0x10000u * k->div;
+            pthread_cond_broadcast(&m->cv);
+        }
+        vec = sim_dispatchable(m, horizon, &t);
+
+        if (vec < 0 || sim_stopping) {
+            struct timespec ts;
+
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += SIM_ISR_POLL_NS;
+            if (ts.tv_nsec >= 1000000000L) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&m->cv, &m->lock, &ts);
+            sim_check_stall(m);
+            continue;
+        }
+
+        if (m->isr[vec] == NULL) {
+            fprintf(stderr, "%s: no %s, interrupt dropped\n", m->name, isr_names[vec]);
+            if (vec == SIM_VEC_DMA) {
+                unsigned ch;
+                for (ch = 0u; ch < SIM_NUM_DMA; ch++) {
+                    m->regs->dma[ch].ctl &= (uint16_t)~DMAIE;
+                }
+            } else if (vec == SIM_VEC_TIMER0_A0) {
+                m->regs->ta0cctl0 &= (uint16_t)~CCIE;
+            } else if (vec == SIM_VEC_TIMER1_A0) {
+                m->regs->ta1cctl0 &= (uint16_t)~CCIE;
+            } else if (vec == SIM_VEC_TIMER1_A1) {
+                m->regs->ta1cctl1 &= (uint16_t)~CCIE;
+                m->regs->ta1cctl2 &= (uint16_t)~CCIE;
+            } else {
+                m->regs->port[vec - SIM_VEC_PORT1].ie = 0u;
+            }
+            continue;
+        }
+
+        /* Entry: the CPU wakes no earlier than the flag was raised */
+        if (m->clock < t + sim_timing.isr_cycles) {
+            m->clock = t + sim_timing.isr_cycles;
+        } else {
+            m->clock += sim_timing.isr_cycles;
+        }
+        if (vec == SIM_VEC_TIMER0_A0) {
+            /* Single-source vectors: CCIFG clears on entry */
+            m->regs->ta0cctl0 &= (uint16_t)~CCIFG;
+        } else if (vec == SIM_VEC_TIMER1_A0) {
+            m->regs->ta1cctl0 &= (uint16_t)~CCIFG;
+        }
+        m->in_isr = 1u;
+        m->sr_clear_on_exit = 0u;
+        m->isr_count++;
+        pthread_mutex_unlock(&m->lock);
+
+        m->isr[vec]();
+
+        pthread_mutex_lock(&m->lock);
+        m->in_isr = 0u;
+        if ((m->sr_clear_on_exit & CPUOFF) != 0u) {
+            m->lpm = 0u;
+        }
+        pthread_cond_broadcast(&m->cv);
+    }
+
+    return NULL;
+}
+
+static void *sim_main_thread(void *arg)
+{
+    sim_mcu_t *m = arg;
+    sim_drive_t d[SIM_MAX_DRIVES];
+
+    t_self = m;
+    t_isr  = 0;
+
+    m->entry();
+
+    pthread_mutex_lock(&m->lock);
+    (void)sim_periph_step(m, SIM_HOOK_GPIO, d);
+    sim_uart_flush_line(m);
+    m->done = 1u;
+    pthread_cond_broadcast(&m->cv);
+    pthread_mutex_unlock(&m->lock);
+
+    pthread_mutex_lock(&sim_lock);
+    pthread_cond_broadcast(&sim_cv);
+    pthread_mutex_unlock(&sim_lock);
+
+    /* main() returning would reset the device; stay halted instead */
+    sim_park();
+    return NULL;
+}
+
+static pthread_t sim_spawn(sim_mcu_t *m, void *(*fn)(void *))
+{
+    pthread_attr_t attr;
+    pthread_t tid;
+    void *stack;
+
+    /* Node code casts stack addresses to 32-bit DMA registers */
+    stack = mmap(NULL, SIM_STACK_SIZE, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT | MAP_STACK, -1, 0);
+    if (stack == MAP_FAILED) {
+        perror("mmap stack");
+        exit(1);
+    }
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, stack, SIM_STACK_SIZE);
+    if (pthread_create(&tid, &attr, fn, m) != 0) {
+        fprintf(stderr, "%s: pthread_create failed\n", m->name);
+        exit(1);
+    }
+    pthread_detach(tid);
+    pthread_attr_destroy(&attr);
+    return tid;
+}
+
+/* ---- Setup ---- */
+
+static int sim_load(sim_mcu_t *m, const char *path, unsigned id)
+{
+    unsigned v;
+    const char *base = strrchr(path, '/');
+
+    memset(m, 0, sizeof(*m));
+    memset(m->net_of, -1, sizeof(m->net_of));
+    pthread_mutex_init(&m->lock, NULL);
+    pthread_cond_init(&m->cv, NULL);
+    m->id = id;
+    snprintf(m->name, sizeof(m->name), id == 0u ? "arb" : "n%u", id);
+
+    m->dl = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (m->dl == NULL) {
+        fprintf(stderr, "%s\n", dlerror());
+        return -1;
+    }
+    m->regs  = dlsym(m->dl, "sim_regs");
+    m->entry = (int (*)(void))dlsym(m->dl, "main");
+    if (m->regs == NULL || m->entry == NULL) {
+        fprintf(stderr, "%s: missing sim_regs or main\n", path);
+        return -1;
+    }
+    if ((uintptr_t)m->regs > UINT32_MAX) {
+        fprintf(stderr, "%s: loaded above 4 GB, link with -Wl,-Ttext-segment\n",
+                base != NULL ? base + 1 : path);
+        return -1;
+    }
+    for (v = 0u; v < SIM_VEC_COUNT; v++) {
+        m->isr[v] = (void (*)(void))dlsym(m->dl, isr_names[v]);
+    }
+
+    sim_periph_reset(m);
+    return 0;
+}
+
+static void sim_wire(sim_mcu_t *a, sim_pin_t pa, sim_mcu_t *b, sim_pin_t pb)
+{
+    sim_net_t *n = &nets[net_count];
+
+    n->mcu[0] = a;
+    n->pin[0] = pa;
+    n->mcu[1] = b;
+    n->pin[1] = pb;
+    a->net_of[pa.port - 1u][pa.pin] = (int8_t)net_count;
+    b->net_of[pb.port - 1u][pb.pin] = (int8_t)net_count;
+    net_count++;
+}
+
+/* "-I 1:P4.5=0" forces an otherwise unconnected input of node 1 */
+static int sim_parse_force(const char *arg)
+{
+    unsigned id, port, pin, val;
+
+    if (sscanf(arg, "%u:P%u.%u=%u", &id, &port, &pin, &val) != 4 ||
+        id >= mcu_count || port < 1u || port > SIM_NUM_PORTS || pin > 7u) {
+        return -1;
+    }
+    mcus[id].in_force_mask[port - 1u] |= (uint8_t)(1u << pin);
+    if (val != 0u) {
+        mcus[id].in_force_val[port - 1u] |= (uint8_t)(1u << pin);
+    } else {
+        mcus[id].in_force_val[port - 1u] &= (uint8_t)~(1u << pin);
+    }
+    return 0;
+}
+
+static void sim_report(void)
+{
+    unsigned i;
+
+    printf("\n%-4s %12s %10s %10s %8s %8s %8s\n",
+           "node", "time(us)", "spi_cpu", "spi_dma", "cs", "isr", "pulses");
+    for (i = 0u; i < mcu_count; i++) {
+        sim_mcu_t *m = &mcus[i];
+
+        pthread_mutex_lock(&m->lock);
+        printf("%-4s %12.1f %10llu %10llu %8llu %8llu %8llu%s\n",
+               m->name,
+               (double)m->clock * 1e6 / (double)sim_timing.mclk_hz,
+               (unsigned long long)m->spi_cpu_bytes,
+               (unsigned long long)m->spi_dma_bytes,
+               (unsigned long long)m->cs_count,
+               (unsigned long long)m->isr_count,
+               (unsigned long long)m->pulses_out,
+               m->done ? "  done" : "");
+        pthread_mutex_unlock(&m->lock);
+    }
+    sim_fram_report();
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "usage: %s [options] ARBITER.so NODE1.so [NODE2.so ...]\n"
+        "  -w ids     comma-separated nodes to wait for (default: all workers)\n"
+        "  -T sec     wall-clock timeout (default 60)\n"
+        "  -f file    back the FRAM with a file instead of anonymous memory\n"
+        "  -k kb      FRAM size in KB (default 256)\n"
+        "  -d div     force SPI clock divider (default: UCB0BRW)\n"
+        "  -p cyc     CPU cycles per polled SPI byte (default %u)\n"
+        "  -m cyc     DMA cycles per transfer (default %u)\n"
+        "  -c cyc     cycles per CS edge (default %u)\n"
+        "  -i cyc     interrupt entry/wakeup cycles (default %u)\n"
+        "  -I N:Px.y=V  force unconnected input pin of node N\n"
+        "  -q         suppress node UART output\n",
+        prog, sim_timing.poll_cycles, sim_timing.dma_cycles,
+        sim_timing.cs_cycles, sim_timing.isr_cycles);
+}
+
+int main(int argc, char **argv)
+{
+    const char *fram_path = NULL;
+    const char *wait_arg = NULL;
+    const char *force_arg[16];
+    unsigned force_count = 0u;
+    unsigned fram_kb = 256u;
+    unsigned timeout_s = 60u;
+    uint32_t wait_mask = 0u;
+    struct timespec deadline;
+    unsigned i;
+    int opt;
+    int rc = 0;
+
+    while ((opt = getopt(argc, argv, "w:T:f:k:d:p:m:c:i:I:qh")) != -1) {
+        switch (opt) {
+        case 'w': wait_arg = optarg; break;
+        case 'T': timeout_s = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'f': fram_path = optarg; break;
+        case 'k': fram_kb = (unsigned)strtoul(optarg, NULL, 0); break;
+        case 'd': sim_timing.spi_div = (uint16_t)strtoul(optarg, NULL, 0); break;
+        case 'p': sim_timing.poll_cycles = (uint16_t)strtoul(optarg, NULL, 0); break;
+        case 'm': sim_timing.dma_cycles = (uint16_t)strtoul(optarg, NULL, 0); break;
+        case 'c': sim_timing.cs_cycles = (uint16_t)strtoul(optarg, NULL, 0); break;
+        case 'i': sim_timing.isr_cycles = (uint16_t)strtoul(optarg, NULL, 0); break;
+        case 'I':
+            if (force_count < 16u) {
+                force_arg[force_count++] = optarg;
+            }
+            break;
+        case 'q': sim_quiet_flag = 1; break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (argc - optind < 2 || argc - optind > (int)SIM_MAX_MCUS) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (sim_fram_open(fram_path, fram_kb) != 0) {
+        return 1;
+    }
+
+    mcu_count = (unsigned)(argc - optind);
+    for (i = 0u; i < mcu_count; i++) {
+        if (sim_load(&mcus[i], argv[optind + (int)i], i) != 0) {
+            return 1;
+        }
+    }
+    for (i = 1u; i < mcu_count; i++) {
+        sim_wire(&mcus[i], node_req_pin, &mcus[0], arb_req_pin[i - 1u]);
+        sim_wire(&mcus[0], arb_gnt_pin[i - 1u], &mcus[i], node_gnt_pin);
+    }
+    for (i = 0u; i < force_count; i++) {
+        if (sim_parse_force(force_arg[i]) != 0) {
+            fprintf(stderr, "bad -I %s\n", force_arg[i]);
+            return 2;
+        }
+    }
+
+    if (wait_arg != NULL) {
+        const char *p = wait_arg;
+        while (*p != '\0') {
+            unsigned long id = strtoul(p, (char **)&p, 0);
+            if (id == 0u || id >= mcu_count) {
+                fprintf(stderr, "bad -w %s\n", wait_arg);
+                return 2;
+            }
+            wait_mask |= 1u << id;
+            if (*p == ',') {
+                p++;
+            }
+        }
+    } else {
+        for (i = 1u; i < mcu_count; i++) {
+            wait_mask |= 1u << i;
+        }
+    }
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+
+    /* Boot the arbiter first and let it reach its idle loop */
+    pthread_mutex_lock(&mcus[0].lock);
+    sim_spawn(&mcus[0], sim_isr_thread);
+    mcus[0].main_tid = sim_spawn(&mcus[0], sim_main_thread);
+    pthread_mutex_unlock(&mcus[0].lock);
+    {
+        struct timespec boot = deadline;
+        boot.tv_sec += 2;
+        pthread_mutex_lock(&sim_lock);
+        while (!mcus[0].lpm && !mcus[0].done) {
+            if (pthread_cond_timedwait(&sim_cv, &sim_lock, &boot) == ETIMEDOUT) {
+                break;
+            }
+        }
+        pthread_mutex_unlock(&sim_lock);
+    }
+
+    for (i = 1u; i < mcu_count; i++) {
+        pthread_mutex_lock(&mcus[0].lock);
+        mcus[i].clock = mcus[0].clock;
+        pthread_mutex_unlock(&mcus[0].lock);
+        pthread_mutex_lock(&mcus[i].lock);
+        sim_spawn(&mcus[i], sim_isr_thread);
+        mcus[i].main_tid = sim_spawn(&mcus[i], sim_main_thread);
+        pthread_mutex_unlock(&mcus[i].lock);
+    }
+
+    deadline.tv_sec += (time_t)timeout_s;
+    pthread_mutex_lock(&sim_lock);
+    for (;;) {
+        uint32_t done = 0u;
+
+        for (i = 1u; i < mcu_count; i++) {
+            if (mcus[i].done) {
+                done |= 1u << i;
+            }
+        }
+        if ((done & wait_mask) == wait_mask) {
+            break;
+        }
+        if (pthread_cond_timedwait(&sim_cv, &sim_lock, &deadline) == ETIMEDOUT) {
+            fprintf(stderr, "timeout after %u s\n", timeout_s);
+            rc = 3;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&sim_lock);
+
+    sim_stopping = 1;
+    sim_report();
+    fflush(stdout);
+    _exit(rc);
+}
@@ -0,0 +1,168 @@
+#ifndef SIM_H_
+#define SIM_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include "sim_mcu.h"
+
+/* Arbiter + up to this many workers */
+#define SIM_MAX_WORKERS     12u  /* rows of the arbiter's ARB_NODE_PINS */
+#define SIM_MAX_MCUS        (SIM_MAX_WORKERS + 1u)
+
+/* Interrupt vectors the simulator dispatches, looked up by symbol name */
+enum {
+    SIM_VEC_DMA = 0,
+    SIM_VEC_PORT1,
+    SIM_VEC_PORT2,
+    SIM_VEC_PORT3,
+    SIM_VEC_PORT4,
+    SIM_VEC_TIMER0_A0,
+    SIM_VEC_TIMER1_A0,
+    SIM_VEC_TIMER1_A1,
+    SIM_VEC_COUNT
+};
+
+/* Compare channels, counting in continuous mode: the simulator raises
+ * CCIFG once the counter reaches CCRn
+ */
+enum {
+    SIM_CMP_TA0_0 = 0,
+    SIM_CMP_TA1_0,
+    SIM_CMP_TA1_1,
+    SIM_NUM_CMP
+};
+
+/* ---- Timing model (MCLK = SMCLK cycles) ---- */
+
+typedef struct {
+    uint32_t mclk_hz;       /* DCO frequency, 8 MHz in the firmware      */
+    uint16_t spi_div;       /* 0: use UCB0BRW as programmed              */
+    uint16_t poll_cycles;   /* CPU overhead per polled SPI byte          */
+    uint16_t reg_cycles;    /* per peripheral register access            */
+    uint16_t dma_cycles;    /* DMA bus cycles per transfer               */
+    uint16_t cs_cycles;     /* per CS edge (GPIO write + FRAM tCSU/tCSH) */
+    uint16_t isr_cycles;    /* interrupt entry + LPM0 wakeup             */
+} sim_timing_t;
+
+extern sim_timing_t sim_timing;
+
+/* ---- Per-MCU state ---- */
+
+typedef struct {
+    uint64_t match_t;               /* next match, 0 = not armed */
+    uint64_t ifg_t;
+    uint64_t div;                   /* MCLK cycles per tick */
+    uint16_t ctl_seen;              /* registers the match was armed from */
+    uint16_t ccr_seen;
+    uint16_t cctl_seen;
+} sim_cmp_t;
+
+typedef struct sim_event {
+    struct sim_event *next;
+    uint64_t t;
+    uint8_t  port;          /* 1-based */
+    uint8_t  pin;
+    uint8_t  level;
+} sim_event_t;
+
+typedef struct sim_mcu {
+    char        name[16];
+    unsigned    id;                 /* 0 = arbiter, k = worker node k */
+    void       *dl;
+    sim_regs_t *regs;
+    int       (*entry)(void);
+    void      (*isr[SIM_VEC_COUNT])(void);
+
+    pthread_mutex_t lock;
+    pthread_cond_t  cv;
+
+    uint64_t clock;                 /* modeled MCLK cycles since boot */
+    uint8_t  gie;
+    uint8_t  lpm;                   /* main context sleeping in LPMx */
+    uint8_t  in_isr;
+    uint16_t sr_clear_on_exit;
+    uint8_t  done;
+
+    /* Main-context progress, used to tell a hook-free spin loop
+     * (e.g. "while (!g_mail_flag);") from a thread that is just descheduled
+     */
+    pthread_t main_tid;
+    uint64_t main_hooks;
+    uint64_t stall_seen_hooks;
+    uint64_t stall_cpu_mark;
+    uint8_t  stalled;
+
+    sim_event_t *ev_head;
+    sim_event_t *ev_tail;
+    uint64_t port_ifg_t[SIM_NUM_PORTS];
+
+    /* GPIO */
+    int8_t   net_of[SIM_NUM_PORTS][8];  /* -1: unconnected */
+    uint8_t  drive_hi[SIM_NUM_PORTS];   /* last sampled DIR & OUT */
+    uint8_t  net_in[SIM_NUM_PORTS];     /* level seen on connected pins */
+    uint8_t  in_force_mask[SIM_NUM_PORTS];
+    uint8_t  in_force_val[SIM_NUM_PORTS];
+    uint8_t  cs_asserted;
+
+    /* SPI shifter + DMA */
+    uint64_t spi_free;              /* shifter idle from this time on */
+    uint8_t  dma_trig;              /* pending trigger, bit per channel */
+    uint64_t dma_trig_t[SIM_NUM_DMA];
+    uint8_t  dma_armed;
+    uint32_t dma_tsa[SIM_NUM_DMA];
+    uint32_t dma_tda[SIM_NUM_DMA];
+    uint16_t dma_tsz[SIM_NUM_DMA];
+    uint64_t dma_ifg_t;
+
+    /* Timer_A0, Timer_A1 */
+    uint64_t  ta_base;
+    uint64_t  ta1_base;
+    uint64_t  ta1_ifg_t;            /* CCR2 capture */
+    sim_cmp_t cmp[SIM_NUM_CMP];
+
+    /* UART line buffer */
+    char     line[160];
+    unsigned line_len;
+
+    /* Statistics */
+    uint64_t spi_cpu_bytes;
+    uint64_t spi_dma_bytes;
+    uint64_t cs_count;
+    uint64_t isr_count;
+    uint64_t pulses_out;
+} sim_mcu_t;
+
+/* Pin level change produced by a node, delivered after its lock is dropped */
+#define SIM_MAX_DRIVES      16u
+
+typedef struct {
+    int      net;
+    uint8_t  level;
+    uint64_t t;
+} sim_drive_t;
+
+/* sim.c */
+sim_mcu_t *sim_self(void);
+int        sim_in_isr(void);
+int        sim_quiet(void);
+void       sim_post_pin(sim_mcu_t *m, uint8_t port, uint8_t pin,
+                        uint8_t level, uint64_t t);
+void       sim_net_drive(sim_mcu_t *m, int net, uint8_t level, uint64_t t);
+
+/* sim_periph.c */
+void       sim_periph_reset(sim_mcu_t *m);
+unsigned   sim_periph_step(sim_mcu_t *m, unsigned kind, sim_drive_t *out);
+void       sim_uart_flush_line(sim_mcu_t *m);
+uint64_t   sim_ta_ticks(const sim_mcu_t *m);
+uint64_t   sim_ta1_ticks(const sim_mcu_t *m, uint64_t t);
+volatile uint16_t *sim_cmp_cctl(sim_regs_t *r, unsigned c);
+void       sim_ta1_capture(sim_mcu_t *m, uint8_t port, uint8_t pin,
+                           uint8_t level, uint64_t t);
+
+/* sim_fram.c */
+int        sim_fram_open(const char *path, uint32_t size_kb);
+void       sim_fram_cs(sim_mcu_t *m, int asserted);
+uint8_t    sim_fram_xfer(sim_mcu_t *m, uint8_t mosi);
+void       sim_fram_report(void);
+
+#endif /* SIM_H_ */
@@ -0,0 +1,247 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "sim.h"
+
+/* Shared SPI FRAM (MB85RS-style command set) backed by an mmap'd image.
+ *
+ * The device has a single CS# and is shared by all MCUs; the arbiter's
+ * lock protocol is what keeps transactions from overlapping. Overlaps are
+ * counted and reported instead of being silently merged.
+ */
+
+#define FRAM_OP_WREN    0x06u
+#define FRAM_OP_WRDI    0x04u
+#define FRAM_OP_RDSR    0x05u
+#define FRAM_OP_WRSR    0x01u
+#define FRAM_OP_READ    0x03u
+#define FRAM_OP_WRITE   0x02u
+#define FRAM_OP_RDID    0x9Fu
+
+#define FRAM_SR_WEL     0x02u
+
+typedef enum {
+    PH_IDLE = 0,
+    PH_OPCODE,
+    PH_ADDR,
+    PH_DATA
+} fram_phase_t;
+
+static struct {
+    pthread_mutex_t lock;
+    uint8_t   *mem;
+    uint32_t   size;
+    uint8_t    id[4];
+
+    sim_mcu_t *owner;
+    fram_phase_t phase;
+    uint8_t    op;
+    uint8_t    addr_bytes;
+    uint32_t   addr;
+    uint8_t    sr;
+    uint32_t   pos;
+
+    /* Statistics */
+    uint64_t   transactions;
+    uint64_t   bytes;
+    uint64_t   data_read;
+    uint64_t   data_written;
+    uint64_t   wren;
+    uint64_t   rejected_writes;
+    uint64_t   collisions;
+} fram;
+
+int sim_fram_open(const char *path, uint32_t size_kb)
+{
+    uint32_t size = size_kb * 1024u;
+    unsigned density = 0u;
+    void *p;
+
+    if (size_kb == 0u || (size_kb & (size_kb - 1u)) != 0u) {
+        fprintf(stderr, "fram: size must be a power of two KB\n");
+        return -1;
+    }
+
+    if (path != NULL) {
+        int fd = open(path, O_RDWR | O_CREAT, 0644);
+
+        if (fd < 0 || ftruncate(fd, (off_t)size) != 0) {
+            perror(path);
+            return -1;
+        }
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+    } else {
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (p != MAP_FAILED) {
+            /* Erased FRAM reads back as whatever was there; model all-ones */
+            memset(p, 0xFF, size);
+        }
+    }
+    if (p == MAP_FAILED) {
+        perror("fram: mmap");
+        return -1;
+    }
+
+    while ((1u << density) < size_kb) {
+        density++;
+    }
+
+    pthread_mutex_init(&fram.lock, NULL);
+    fram.mem  = p;
+    fram.size = size;
+    fram.addr_bytes = 3u;
+
+    /* Manufacturer, continuation, product ID (density in low 5 bits) */
+    fram.id[0] = 0x04u;
+    fram.id[1] = 0x7Fu;
+    fram.id[2] = (uint8_t)(0x40u | density);
+    fram.id[3] = 0x03u;
+    return 0;
+}
+
+void sim_fram_cs(sim_mcu_t *m, int asserted)
+{
+    pthread_mutex_lock(&fram.lock);
+
+    if (asserted) {
+        if (fram.owner != NULL && fram.owner != m) {
+            fram.collisions++;
+            fprintf(stderr, "fram: CS collision, %s asserted while %s holds the bus\n",
+                    m->name, fram.owner->name);
+        }
+        fram.owner = m;
+        fram.phase = PH_OPCODE;
+        fram.transactions++;
+    } else if (fram.owner == m) {
+        /* WEL auto-clears at the end of a WRITE / WRSR */
+        if (fram.phase == PH_DATA &&
+            (fram.op == FRAM_OP_WRITE || fram.op == FRAM_OP_WRSR)) {
+            fram.sr &= (uint8_t)~FRAM_SR_WEL;
+        }
+        fram.owner = NULL;
+        fram.phase = PH_IDLE;
+    }
+
+    pthread_mutex_unlock(&fram.lock);
+}
+
+static uint8_t fram_data(uint8_t mosi)
+{
+    uint8_t miso = 0xFFu;
+    uint32_t a = fram.addr & (fram.size - 1u);
+
+    switch (fram.op) {
+    case FRAM_OP_READ:
+        miso = fram.mem[a];
+        fram.addr++;
+        fram.data_read++;
+        break;
+    case FRAM_OP_WRITE:
+        if ((fram.sr & FRAM_SR_WEL) != 0u) {
+            fram.mem[a] = mosi;
+            fram.data_written++;
+        } else {
+            fram.rejected_writes++;
+        }
+        fram.addr++;
+        break;
+    case FRAM_OP_RDSR:
+        miso = fram.sr;
+        break;
+    case FRAM_OP_WRSR:
+        if ((fram.sr & FRAM_SR_WEL) != 0u && fram.pos == 0u) {
+            fram.sr = (uint8_t)((mosi & 0x8Cu) | (fram.sr & FRAM_SR_WEL));
+        }
+        break;
+    case FRAM_OP_RDID:
+        miso = (fram.pos < sizeof(fram.id)) ? fram.id[fram.pos] : 0x00u;
+        break;
+    default:
+        break;
+    }
+
+    fram.pos++;
+    return miso;
+}
+
+uint8_t sim_fram_xfer(sim_mcu_t *m, uint8_t mosi)
+{
+    uint8_t miso = 0xFFu;
+
+    pthread_mutex_lock(&fram.lock);
+
+    if (fram.owner != m) {
+        pthread_mutex_unlock(&fram.lock);
+        return miso;
+    }
+    fram.bytes++;
+
+    switch (fram.phase) {
+    case PH_OPCODE:
+        fram.op   = mosi;
+        fram.pos  = 0u;
+        fram.addr = 0u;
+        switch (mosi) {
+        case FRAM_OP_WREN:
+            fram.sr |= FRAM_SR_WEL;
+            fram.wren++;
+            fram.phase = PH_IDLE;
+            break;
+        case FRAM_OP_WRDI:
+            fram.sr &= (uint8_t)~FRAM_SR_WEL;
+            fram.phase = PH_IDLE;
+            break;
+        case FRAM_OP_READ:
+        case FRAM_OP_WRITE:
+            fram.phase = PH_ADDR;
+            break;
+        default:
+            fram.phase = PH_DATA;
+            break;
+        }
+        break;
+
+    case PH_ADDR:
+        fram.addr = (fram.addr << 8) | mosi;
+        if (++fram.pos == fram.addr_bytes) {
+            fram.pos   = 0u;
+            fram.phase = PH_DATA;
+        }
+        break;
+
+    case PH_DATA:
+        miso = fram_data(mosi);
+        break;
+
+    default:
+        break;
+    }
+
+    pthread_mutex_unlock(&fram.lock);
+    return miso;
+}
+
+void sim_fram_report(void)
+{
+    pthread_mutex_lock(&fram.lock);
+    printf("fram: %u KB, %llu transactions, %llu bytes on the bus "
+           "(%llu read, %llu written), %llu WREN\n",
+           (unsigned)(fram.size / 1024u),
+           (unsigned long long)fram.transactions,
+           (unsigned long long)fram.bytes,
+           (unsigned long long)fram.data_read,
+           (unsigned long long)fram.data_written,
+           (unsigned long long)fram.wren);
+    if (fram.rejected_writes != 0u || fram.collisions != 0u) {
+        printf("fram: %llu bytes written without WEL, %llu CS collisions\n",
+               (unsigned long long)fram.rejected_writes,
+               (unsigned long long)fram.collisions);
+    }
+    pthread_mutex_unlock(&fram.lock);
+}
@@ -0,0 +1,116 @@
+#ifndef SIM_MCU_H_
+#define SIM_MCU_H_
+
+#include <stdint.h>
+
+/* Register file of one simulated MSP430FR5969.
+ *
+ * Every node image (arbiter or worker) is built as its own shared object
+ * with its own copy of 'sim_regs'. The host msp430.h maps the peripheral
+ * register names used by fram.c, mailbox.c, uart.c and main.c onto these
+ * fields, and runs sim_hook() *before* every access so the simulator can
+ * observe pin changes, shift pending SPI bytes and run the DMA engine.
+ */
+
+#define SIM_NUM_PORTS      4u      /* P1..P4 */
+#define SIM_NUM_DMA        3u      /* DMA0..DMA2 */
+
+/* TXBUF value meaning "nothing written since the last shift" */
+#define SIM_TXBUF_EMPTY    0xFFFFu
+
+/* Hook flavours */
+#define SIM_HOOK_GPIO      0u      /* ports, clocks, misc */
+#define SIM_HOOK_SPI       1u      /* eUSCI_B0 + DMA setup */
+#define SIM_HOOK_SPI_SYNC  2u      /* status/RXBUF/DMAxCTL: CPU waits for the shifter */
+#define SIM_HOOK_UART      3u      /* eUSCI_A0 */
+#define SIM_HOOK_SPI_RX    4u      /* UCB0RXBUF: as SPI_SYNC, then clears RXIFG */
+
+typedef struct {
+    volatile uint8_t  out;
+    volatile uint8_t  dir;
+    volatile uint8_t  ren;
+    volatile uint8_t  sel0;
+    volatile uint8_t  sel1;
+    volatile uint8_t  ies;
+    volatile uint8_t  ie;
+    volatile uint8_t  ifg;
+} sim_port_regs_t;
+
+typedef struct {
+    volatile uint16_t ctl;
+    volatile uint32_t sa;
+    volatile uint32_t da;
+    volatile uint16_t sz;
+} sim_dma_regs_t;
+
+typedef struct {
+    sim_port_regs_t port[SIM_NUM_PORTS];
+
+    /* eUSCI_B0, SPI master towards the shared FRAM */
+    volatile uint16_t ucb0_ctlw0;
+    volatile uint16_t ucb0_brw;
+    volatile uint16_t ucb0_statw;
+    volatile uint16_t ucb0_rxbuf;
+    volatile uint16_t ucb0_txbuf;
+    volatile uint16_t ucb0_ie;
+    volatile uint16_t ucb0_ifg;
+
+    /* eUSCI_A0, UART (TX only) */
+    volatile uint16_t uca0_ctlw0;
+    volatile uint8_t  uca0_br0;
+    volatile uint8_t  uca0_br1;
+    volatile uint16_t uca0_mctlw;
+    volatile uint16_t uca0_txbuf;
+    volatile uint16_t uca0_ifg;
+
+    /* DMA controller */
+    volatile uint16_t dmactl0;
+    volatile uint16_t dmactl1;
+    volatile uint16_t dmactl4;
+    sim_dma_regs_t    dma[SIM_NUM_DMA];
+
+    /* Timer_A0 (continuous counter + CCR0 compare) */
+    volatile uint16_t ta0ctl;
+    volatile uint16_t ta0ex0;
+    volatile uint16_t ta0cctl0;
+    volatile uint16_t ta0ccr0;
+
+    /* Timer_A1 (continuous counter + CCR0/CCR1 compare + CCR2 capture
+     * from P1.3 = TA1.2)
+     */
+    volatile uint16_t ta1ctl;
+    volatile uint16_t ta1cctl0;
+    volatile uint16_t ta1ccr0;
+    volatile uint16_t ta1cctl1;
+    volatile uint16_t ta1ccr1;
+    volatile uint16_t ta1cctl2;
+    volatile uint16_t ta1ccr2;
+
+    /* Written by firmware, not interpreted */
+    volatile uint16_t wdtctl;
+    volatile uint16_t pm5ctl0;
+    volatile uint16_t pmmctl0;
+    volatile uint8_t  csctl0_h;
+    volatile uint16_t csctl1;
+    volatile uint16_t csctl2;
+    volatile uint16_t csctl3;
+} sim_regs_t;
+
+/* Provided by the simulator executable, called from node images */
+void     sim_hook(unsigned kind);
+uint8_t  sim_port_in(unsigned port);
+volatile uint8_t *sim_port_ifg(unsigned port);
+uint16_t sim_port_iv(unsigned port);
+uint16_t sim_dma_iv(void);
+uint16_t sim_ta0r(void);
+uint16_t sim_ta1r(void);
+uint16_t sim_ta1iv(void);
+void     sim_delay_cycles(uint32_t cycles);
+void     sim_bis_sr(uint16_t bits);
+void     sim_bic_sr(uint16_t bits);
+void     sim_bis_sr_on_exit(uint16_t bits);
+void     sim_bic_sr_on_exit(uint16_t bits);
+void     sim_disable_interrupt(void);
+void     sim_enable_interrupt(void);
+
+#endif /* SIM_MCU_H_ */
@@ -0,0 +1,548 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <msp430.h>
+#include "sim.h"
+
+/* Peripheral models: GPIO sampling, eUSCI_B0 SPI shifter, DMA, UART,
+ * Timer_A0.
+ * All functions here run with m->lock held.
+ */
+
+#define SIM_FRAM_CS_PORT    0u          /* P1 */
+#define SIM_FRAM_CS_PIN     BIT5        /* P1.5 */
+
+/* DMA trigger numbers (DMACTLx TSEL field) */
+#define SIM_TRIG_DMAREQ     0u
+#define SIM_TRIG_UCB0RX     18u
+#define SIM_TRIG_UCB0TX     19u
+
+void sim_periph_reset(sim_mcu_t *m)
+{
+    sim_regs_t *r = m->regs;
+    unsigned p;
+    unsigned c;
+
+    for (p = 0u; p < SIM_NUM_PORTS; p++) {
+        m->drive_hi[p] = 0u;
+        m->net_in[p]   = 0u;
+    }
+
+    r->ucb0_ctlw0 = UCSWRST;
+    r->ucb0_ifg   = UCTXIFG;
+    r->ucb0_txbuf = SIM_TXBUF_EMPTY;
+
+    r->uca0_ctlw0 = UCSWRST;
+    r->uca0_ifg   = UCTXIFG;
+    r->uca0_txbuf = SIM_TXBUF_EMPTY;
+
+    m->cs_asserted = 0u;
+    m->spi_free    = 0u;
+    m->dma_trig    = 0u;
+    m->dma_armed   = 0u;
+
+    m->ta_base   = 0u;
+    m->ta1_base  = 0u;
+    m->ta1_ifg_t = 0u;
+    memset(m->cmp, 0, sizeof(m->cmp));
+    for (c = 0u; c < SIM_NUM_CMP; c++) {
+        m->cmp[c].div = 1u;
+    }
+}
+
+/* ---- GPIO ---- */
+
+static unsigned gpio_sample(sim_mcu_t *m, sim_drive_t *out)
+{
+    sim_regs_t *r = m->regs;
+    unsigned n = 0u;
+    unsigned p;
+    unsigned pin;
+
+    for (p = 0u; p < SIM_NUM_PORTS; p++) {
+        uint8_t dir = r->port[p].dir;
+        uint8_t hi  = (uint8_t)(dir & r->port[p].out);
+        uint8_t ch  = (uint8_t)(hi ^ m->drive_hi[p]);
+
+        if (p == SIM_FRAM_CS_PORT) {
+            /* CS# is active low; released by switching to input (pull-up) */
+            uint8_t cs = (uint8_t)(((dir & SIM_FRAM_CS_PIN) != 0u) &&
+                                   ((hi & SIM_FRAM_CS_PIN) == 0u));
+            if (cs != m->cs_asserted) {
+                m->clock += sim_timing.cs_cycles;
+                m->cs_asserted = cs;
+                if (cs != 0u) {
+                    m->cs_count++;
+                }
+                sim_fram_cs(m, cs);
+            }
+        }
+
+        m->drive_hi[p] = hi;
+        if (ch == 0u) {
+            continue;
+        }
+
+        for (pin = 0u; pin < 8u; pin++) {
+            if (((ch >> pin) & 1u) == 0u || m->net_of[p][pin] < 0) {
+                continue;
+            }
+            if (n < SIM_MAX_DRIVES) {
+                out[n].net   = m->net_of[p][pin];
+                out[n].level = (uint8_t)((hi >> pin) & 1u);
+                out[n].t     = m->clock;
+                n++;
+            }
+            if (((hi >> pin) & 1u) != 0u) {
+                m->pulses_out++;
+            }
+        }
+    }
+
+    return n;
+}
+
+/* ---- UART (eUSCI_A0) ---- */
+
+void sim_uart_flush_line(sim_mcu_t *m)
+{
+    if (m->line_len == 0u) {
+        return;
+    }
+    m->line[m->line_len] = '\0';
+    if (!sim_quiet()) {
+        printf("[%s] %s\n", m->name, m->line);
+        fflush(stdout);
+    }
+    m->line_len = 0u;
+}
+
+static void uart_step(sim_mcu_t *m)
+{
+    sim_regs_t *r = m->regs;
+    char c;
+
+    if (r->uca0_txbuf == SIM_TXBUF_EMPTY) {
+        return;
+    }
+    c = (char)r->uca0_txbuf;
+    r->uca0_txbuf = SIM_TXBUF_EMPTY;
+    r->uca0_ifg  |= UCTXIFG;
+
+    if ((r->uca0_ctlw0 & UCSWRST) != 0u) {
+        return;
+    }
+
+    /* 10 bit times per character at SMCLK / UCBRx */
+    m->clock += 10u * ((uint32_t)r->uca0_br0 | ((uint32_t)r->uca0_br1 << 8));
+
+    if (c == '\n') {
+        sim_uart_flush_line(m);
+    } else if (c != '\r' && m->line_len < sizeof(m->line) - 1u) {
+        m->line[m->line_len++] = c;
+    }
+}
+
+/* ---- DMA ---- */
+
+static unsigned dma_tsel(const sim_regs_t *r, unsigned ch)
+{
+    switch (ch) {
+    case 0u: return r->dmactl0 & 0x1Fu;
+    case 1u: return (r->dmactl0 >> 8) & 0x1Fu;
+    default: return r->dmactl1 & 0x1Fu;
+    }
+}
+
+static void dma_trigger(sim_mcu_t *m, unsigned trig, uint64_t t)
+{
+    unsigned ch;
+
+    for (ch = 0u; ch < SIM_NUM_DMA; ch++) {
+        if ((m->dma_armed & (1u << ch)) != 0u && dma_tsel(m->regs, ch) == trig) {
+            m->dma_trig |= (uint8_t)(1u << ch);
+            m->dma_trig_t[ch] = t;
+        }
+    }
+}
+
+/* Latch DMAEN edges: the channel works on temporary copies of SA/DA/SZ */
+static void dma_arm(sim_mcu_t *m)
+{
+    sim_regs_t *r = m->regs;
+    unsigned ch;
+
+    for (ch = 0u; ch < SIM_NUM_DMA; ch++) {
+        uint8_t bit = (uint8_t)(1u << ch);
+        uint16_t ctl = r->dma[ch].ctl;
+
+        if ((ctl & DMAEN) == 0u) {
+            m->dma_armed &= (uint8_t)~bit;
+            m->dma_trig  &= (uint8_t)~bit;
+            continue;
+        }
+        if ((m->dma_armed & bit) == 0u) {
+            m->dma_armed |= bit;
+            m->dma_tsa[ch] = r->dma[ch].sa;
+            m->dma_tda[ch] = r->dma[ch].da;
+            m->dma_tsz[ch] = r->dma[ch].sz;
+        }
+        if ((ctl & DMAREQ) != 0u && dma_tsel(r, ch) == SIM_TRIG_DMAREQ) {
+            r->dma[ch].ctl &= (uint16_t)~DMAREQ;
+            m->dma_trig |= bit;
+            m->dma_trig_t[ch] = m->clock;
+        }
+    }
+}
+
+static uint16_t spi_div(const sim_regs_t *r)
+{
+    if (sim_timing.spi_div != 0u) {
+        return sim_timing.spi_div;
+    }
+    return (r->ucb0_brw != 0u) ? r->ucb0_brw : 1u;
+}
+
+/* Clock one byte through the shifter, starting no earlier than t_ready */
+static void spi_shift(sim_mcu_t *m, uint8_t mosi, uint64_t t_ready)
+{
+    sim_regs_t *r = m->regs;
+    uint64_t start;
+    uint64_t end;
+
+    start = (t_ready > m->spi_free) ? t_ready : m->spi_free;
+
+    if ((r->ucb0_ctlw0 & UCSWRST) != 0u) {
+        /* Module held in reset: nothing is clocked out and RXBUF keeps its
+         * old value. The flags are still raised so that firmware touching
+         * the FRAM outside a lock_acquire()/spi_enable() window (e.g.
+         * mailbox_init_layout() in evals/throughput.c) does not spin forever.
+         */
+        end = start;
+    } else {
+        end = start + 8u * (uint64_t)spi_div(r);
+        m->spi_free = end;
+        r->ucb0_rxbuf = (m->cs_asserted != 0u) ? sim_fram_xfer(m, mosi) : 0xFFu;
+    }
+    if ((r->ucb0_ifg & UCRXIFG) != 0u && end != start) {
+        r->ucb0_statw |= UCOE;      /* previous byte never read */
+    }
+    r->ucb0_ifg |= (uint16_t)(UCRXIFG | UCTXIFG);
+
+    /* TXBUF is free as soon as the byte moves into the shift register */
+    dma_trigger(m, SIM_TRIG_UCB0RX, end);
+    dma_trigger(m, SIM_TRIG_UCB0TX, start);
+}
+
+static uint16_t dma_load(sim_mcu_t *m, uint32_t addr, int byte)
+{
+    sim_regs_t *r = m->regs;
+
+    if (addr == (uint32_t)(uintptr_t)&r->ucb0_rxbuf) {
+        r->ucb0_ifg &= (uint16_t)~UCRXIFG;
+        return (uint16_t)(r->ucb0_rxbuf & 0xFFu);
+    }
+    if (byte) {
+        return *(volatile uint8_t *)(uintptr_t)addr;
+    }
+    return *(volatile uint16_t *)(uintptr_t)addr;
+}
+
+static void dma_store(sim_mcu_t *m, uint32_t addr, uint16_t val, int byte,
+                      uint64_t t)
+{
+    sim_regs_t *r = m->regs;
+
+    if (addr == (uint32_t)(uintptr_t)&r->ucb0_txbuf) {
+        spi_shift(m, (uint8_t)val, t);
+        m->spi_dma_bytes++;
+        return;
+    }
+    if (byte) {
+        *(volatile uint8_t *)(uintptr_t)addr = (uint8_t)val;
+    } else {
+        *(volatile uint16_t *)(uintptr_t)addr = val;
+    }
+}
+
+static int32_t dma_step_addr(uint16_t mode, int byte)
+{
+    int32_t unit = byte ? 1 : 2;
+
+    switch (mode & 3u) {
+    case 3u: return unit;
+    case 2u: return -unit;
+    default: return 0;
+    }
+}
+
+static int dma_service(sim_mcu_t *m)
+{
+    sim_regs_t *r = m->regs;
+    int progressed = 0;
+    unsigned ch;
+
+    for (ch = 0u; ch < SIM_NUM_DMA; ch++) {
+        uint8_t  bit = (uint8_t)(1u << ch);
+        uint16_t ctl;
+        unsigned dt;
+        unsigned count;
+        int      sbyte;
+        int      dbyte;
+        uint64_t t;
+
+        if ((m->dma_armed & bit) == 0u || (m->dma_trig & bit) == 0u) {
+            continue;
+        }
+        m->dma_trig &= (uint8_t)~bit;
+        progressed = 1;
+
+        ctl   = r->dma[ch].ctl;
+        dt    = (ctl >> 12) & 7u;
+        sbyte = (ctl & DMASRCBYTE) != 0u;
+        dbyte = (ctl & DMADSTBYTE) != 0u;
+        count = (dt == 1u || dt == 5u) ? m->dma_tsz[ch] : 1u;
+        t     = m->dma_trig_t[ch] + sim_timing.dma_cycles;
+
+        while (count-- > 0u && m->dma_tsz[ch] > 0u) {
+            uint16_t v = dma_load(m, m->dma_tsa[ch], sbyte);
+
+            dma_store(m, m->dma_tda[ch], v, dbyte, t);
+            m->dma_tsa[ch] = (uint32_t)((int32_t)m->dma_tsa[ch] +
+                                        dma_step_addr(ctl >> 8, sbyte));
+            m->dma_tda[ch] = (uint32_t)((int32_t)m->dma_tda[ch] +
+                                        dma_step_addr(ctl >> 10, dbyte));
+            m->dma_tsz[ch]--;
+        }
+
+        if (m->dma_tsz[ch] != 0u) {
+            continue;
+        }
+
+        /* Block complete */
+        r->dma[ch].ctl |= DMAIFG;
+        if ((ctl & DMAIE) != 0u) {
+            if (t > m->dma_ifg_t) {
+                m->dma_ifg_t = t;
+            }
+            pthread_cond_broadcast(&m->cv);
+        }
+        if (dt == 4u || dt == 5u) {
+            m->dma_tsa[ch] = r->dma[ch].sa;
+            m->dma_tda[ch] = r->dma[ch].da;
+            m->dma_tsz[ch] = r->dma[ch].sz;
+        } else {
+            /* A trigger raised by the last transfer itself is lost, as on
+             * the real part, so that re-arming the channel starts clean.
+             */
+            r->dma[ch].ctl &= (uint16_t)~DMAEN;
+            m->dma_armed   &= (uint8_t)~bit;
+            m->dma_trig    &= (uint8_t)~bit;
+        }
+    }
+
+    return progressed;
+}
+
+/* ---- SPI (eUSCI_B0) ---- */
+
+static void spi_step(sim_mcu_t *m)
+{
+    sim_regs_t *r = m->regs;
+
+    dma_arm(m);
+
+    for (;;) {
+        int progressed = 0;
+
+        if (r->ucb0_txbuf != SIM_TXBUF_EMPTY) {
+            uint8_t b = (uint8_t)r->ucb0_txbuf;
+
+            r->ucb0_txbuf = SIM_TXBUF_EMPTY;
+            m->clock += sim_timing.poll_cycles;
+            spi_shift(m, b, m->clock);
+            m->spi_cpu_bytes++;
+            progressed = 1;
+        }
+
+        if (dma_service(m)) {
+            progressed = 1;
+        }
+
+        if (!progressed) {
+            break;
+        }
+    }
+
+    r->ucb0_statw &= (uint16_t)~UCBUSY;
+}
+
+/* ---- Timer_A0 ---- */
+
+static uint64_t ta_div(const sim_regs_t *r)
+{
+    uint64_t div;
+
+    div = (uint64_t)(1u << ((r->ta0ctl >> 6) & 3u)) *
+          (uint64_t)((r->ta0ex0 & 7u) + 1u);
+    if ((r->ta0ctl & 0x0300u) == TASSEL__ACLK) {
+        /* ACLK = 32768 Hz, expressed in MCLK cycles per tick */
+        div *= (sim_timing.mclk_hz + 16384u) / 32768u;
+    }
+    return div;
+}
+
+/* Counter value (unwrapped) at the current clock */
+uint64_t sim_ta_ticks(const sim_mcu_t *m)
+{
+    if ((m->regs->ta0ctl & 0x0030u) == MC__STOP) {
+        return 0u;
+    }
+    return (m->clock - m->ta_base) / ta_div(m->regs);
+}
+
+/* Capture/compare control register of compare channel c */
+volatile uint16_t *sim_cmp_cctl(sim_regs_t *r, unsigned c)
+{
+    switch (c) {
+    case SIM_CMP_TA1_0: return &r->ta1cctl0;
+    case SIM_CMP_TA1_1: return &r->ta1cctl1;
+    default:            return &r->ta0cctl0;
+    }
+}
+
+/* A new control word, CCRn or CCIE re-arms compare channel c for the next
+ * time the counter (started at 'base', 'div' MCLK cycles per tick)
+ * reaches CCRn; only continuous mode is modeled. The simulator raises
+ * CCIFG once the match time is due.
+ */
+static void cmp_arm(sim_mcu_t *m, unsigned c, uint16_t ctl, uint16_t ccr,
+                    uint64_t base, uint64_t div)
+{
+    sim_cmp_t *k = &m->cmp[c];
+    uint16_t cctl = *sim_cmp_cctl(m->regs, c);
+    uint64_t ticks;
+    uint64_t delta;
+
+    if (ctl == k->ctl_seen && ccr == k->ccr_seen &&
+        ((cctl ^ k->cctl_seen) & (CCIE | CAP)) == 0u) {
+        return;
+    }
+    k->ctl_seen  = ctl;
+    k->ccr_seen  = ccr;
+    k->cctl_seen = cctl;
+
+    if ((ctl & 0x0030u) != MC__CONTINUOUS || (cctl & (CCIE | CAP)) != CCIE) {
+        k->match_t = 0u;
+        return;
+    }
+
+    k->div = div;
+    ticks = (m->clock - base) / div;
+    delta = (uint64_t)((ccr - (uint16_t)ticks) & 0xFFFFu);
+    if (delta == 0u) {
+        delta = 0x10000u;
+    }
+    k->match_t = base + (ticks + delta) * div;
+}
+
+/* TACLR restarts the count and re-arms CCR0 */
+static void ta_step(sim_mcu_t *m)
+{
+    sim_regs_t *r = m->regs;
+
+    if ((r->ta0ctl & TACLR) != 0u) {
+        r->ta0ctl = (uint16_t)(r->ta0ctl & ~TACLR);
+        m->ta_base = m->clock;
+        m->cmp[SIM_CMP_TA0_0].ctl_seen = (uint16_t)~r->ta0ctl;  /* force re-arm */
+    }
+    cmp_arm(m, SIM_CMP_TA0_0, r->ta0ctl, r->ta0ccr0, m->ta_base, ta_div(r));
+}
+
+/* ---- Timer_A1 ---- */
+
+/* Counter value at time t: ID divider only, TA1EX0 is not modeled */
+uint64_t sim_ta1_ticks(const sim_mcu_t *m, uint64_t t)
+{
+    const sim_regs_t *r = m->regs;
+
+    if ((r->ta1ctl & 0x0030u) == MC__STOP || t < m->ta1_base) {
+        return 0u;
+    }
+    return (t - m->ta1_base) / (uint64_t)(1u << ((r->ta1ctl >> 6) & 3u));
+}
+
+/* Level change on a pin: P1.3 in its TA1.2 function (PxSEL0 set, input)
+ * feeds CCI2A. CCI follows the pin; a CM-selected edge latches the count
+ * at the event time into TA1CCR2 and sets CCIFG, or COV if CCIFG is still
+ * set. Lock held.
+ */
+void sim_ta1_capture(sim_mcu_t *m, uint8_t port, uint8_t pin,
+                     uint8_t level, uint64_t t)
+{
+    sim_regs_t *r = m->regs;
+    uint16_t cctl = r->ta1cctl2;
+    uint16_t edge;
+
+    if (port != 1u || pin != 3u ||
+        (r->port[0].sel0 & BIT3) == 0u || (r->port[0].sel1 & BIT3) != 0u ||
+        (r->port[0].dir & BIT3) != 0u) {
+        return;
+    }
+
+    cctl = (uint16_t)((level != 0u) ? (cctl | CCI) : (cctl & ~CCI));
+    edge = (level != 0u) ? CM_1 : CM_2;
+    if ((cctl & CAP) != 0u && (cctl & CCIS_3) == CCIS_0 &&
+        (cctl & edge) != 0u && (r->ta1ctl & 0x0030u) != MC__STOP) {
+        if ((cctl & CCIFG) != 0u) {
+            cctl |= COV;
+        }
+        cctl |= CCIFG;
+        r->ta1ccr2   = (uint16_t)sim_ta1_ticks(m, t);
+        m->ta1_ifg_t = t;
+    }
+    r->ta1cctl2 = cctl;
+}
+
+/* TACLR restarts the count and re-arms CCR0 and CCR1 */
+static void ta1_step(sim_mcu_t *m)
+{
+    sim_regs_t *r = m->regs;
+    uint64_t div;
+
+    if ((r->ta1ctl & TACLR) != 0u) {
+        r->ta1ctl  = (uint16_t)(r->ta1ctl & ~TACLR);
+        m->ta1_base = m->clock;
+        m->cmp[SIM_CMP_TA1_0].ctl_seen = (uint16_t)~r->ta1ctl;
+        m->cmp[SIM_CMP_TA1_1].ctl_seen = (uint16_t)~r->ta1ctl;
+    }
+    div = (uint64_t)(1u << ((r->ta1ctl >> 6) & 3u));
+    cmp_arm(m, SIM_CMP_TA1_0, r->ta1ctl, r->ta1ccr0, m->ta1_base, div);
+    cmp_arm(m, SIM_CMP_TA1_1, r->ta1ctl, r->ta1ccr1, m->ta1_base, div);
+}
+
+unsigned sim_periph_step(sim_mcu_t *m, unsigned kind, sim_drive_t *out)
+{
+    unsigned n;
+
+    uart_step(m);
+    ta_step(m);
+    ta1_step(m);
+    n = gpio_sample(m, out);
+    spi_step(m);
+
+    /* A CPU polling UCB0IFG / UCB0STATW / DMAxCTL waits for the shifter */
+    if ((kind == SIM_HOOK_SPI_SYNC || kind == SIM_HOOK_SPI_RX) &&
+        m->clock < m->spi_free) {
+        m->clock = m->spi_free;
+    }
+
+    /* Reading RXBUF clears RXIFG (taking its address for DMAxSA does too,
+     * which is harmless: DMA setup always discards a stale RX byte first)
+     */
+    if (kind == SIM_HOOK_SPI_RX) {
+        m->regs->ucb0_ifg &= (uint16_t)~UCRXIFG;
+    }
+
+    return n;
+}
@@ -0,0 +1,6 @@
+#include "sim_mcu.h"
+
+/* Linked into every node image: one register file per simulated MCU.
+ * The simulator locates it with dlsym() and resets it before boot.
+ */
+sim_regs_t sim_regs;
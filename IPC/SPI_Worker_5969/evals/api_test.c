@@ -0,0 +1,952 @@
+// ========================= Worker Node =========================
+//                   MSP430FR5969 (Worker Node k)
+//                 ---------------------------
+//            /|\ |                       XIN|-
+//             |  |                           | 32 kHz Crystal (optional)
+//             ---|RST                    XOUT|-
+//                |                           |
+//                |                       P1.6|-> FRAM SI   (UCB0SIMO, MOSI, shared bus)
+//                |                       P1.7|<- FRAM SO   (UCB0SOMI, MISO, shared bus)
+//                |                       P2.2|-> FRAM SCK  (UCB0CLK, shared bus)
+//                |                       P1.5|-> FRAM CS#  (chip select, active low, shared)
+//                |                           |
+//                |                       P1.4|-> REQk      (Node k -> Arbiter, request / release)
+//                |                       P1.3|<-> GNTk     (Arbiter <-> Node k, grant / mail / reset; TA1.2)
+//                |                           |
+//                |                       P1.0|-> LED (lock held indication, green)
+//                |                       P4.6|-> LED (no lock / idle indication, red)
+//                |                           |
+//               GND|---------------------------
+
+
+
+#include <msp430.h>
+#include <stdint.h>
+#include "fram.h"
+#include "mailbox.h"
+#include "uart.h"
+#include "worker.h"
+
+/* Adjust per node build: IDs 1,2,3,... (index = ID-1) */
+#ifndef NODE_ID
+#define NODE_ID         1u
+#endif
+#define NODE_INDEX      (NODE_ID - 1u)
+
+/* Evaluations and Experiments*/
+
+/* Mailbox API run on three nodes: node 1 drives each phase, nodes 2 and 3
+ * check what arrives and ack each message with one byte in node 1's box.
+ * Every node prints one line per phase.
+ */
+#define API_DRIVER_ID       1u
+#define API_NUM_PEERS       2u
+#define API_PEER_MASK       ((mailbox_mask_t)0x06u)     /* boxes 1, 2 */
+
+#define API_MCAST_LEN       600u
+#define API_MCAST_ROUNDS    (2u * MCAST_NUM_BUFS)
+
+#define API_FLOW_LEN        1024u
+
+#define API_BATCH_COUNT     12u
+
+#define API_ITER_COUNT      16u
+#define API_ITER_BULK       10u     /* message API_ITER_BULK is a bulk */
+#define API_ITER_BULK_LEN   200u
+
+#define API_PEEK_LEN        1000u
+#define API_PEEK_PIECE      96u
+
+/* Largest bulk the wrap phase sends: a little over half of box 1's
+ * normal lane (912 slots in the 128 kB layout)
+ */
+#define API_WRAP_MAX        30720u
+#define API_WRAP_FILL       15u     /* slots per filler bulk (<= payload) */
+
+#define API_STREAM_LEN      5000u
+#define API_STREAM_CHUNK    1000u   /* per lock hold on the sending end */
+#define API_STREAM_PIECE    300u    /* per mailbox_stream_read() */
+
+/* 300 ms in TA0 ticks of 8 us: longer than the arbiter's lease
+ * (ARB_LEASE_TICKS, same tick)
+ */
+#define API_LEASE_HOLD      37500u
+
+/* A lock session doing one operation every 40 ms (same tick) for longer
+ * than a lease, its idle timeout above that gap: some lease check finds
+ * it idle
+ */
+#define API_SESSION_OPS     10u
+#define API_SESSION_GAP     5000u
+#define API_SESSION_IDLE_US 60000u
+
+static uint8_t payload[1024u];
+static uint16_t api_errors = 0u;
+
+static void build_pattern(uint8_t *buf, uint16_t len, uint8_t seed)
+{
+    uint16_t i;
+    for (i = 0u; i < len; i++) {
+        buf[i] = (uint8_t)(seed * 31u + i);
+    }
+}
+
+static uint8_t check_pattern(const uint8_t *buf, uint16_t len, uint8_t seed)
+{
+    uint16_t i;
+    for (i = 0u; i < len; i++) {
+        if (buf[i] != (uint8_t)(seed * 31u + i)) {
+            return 0u;
+        }
+    }
+    return 1u;
+}
+
+static void api_report(const char *phase)
+{
+    uart0_print("API ");
+    uart0_print(phase);
+    if (api_errors == 0u) {
+        uart0_println(" ok");
+    } else {
+        uart0_print(" errors=");
+        uart0_print_uint(api_errors);
+        uart0_println("");
+    }
+    api_errors = 0u;
+}
+
+/* Next message of our own box, sleeping until there is one */
+static void recv_wait(uint8_t *src_id, uint16_t *len, uint8_t *buf)
+{
+    uint8_t got;
+
+    for (;;) {
+        lock_acquire();
+        got = mailbox_recv_msg(NODE_INDEX, src_id, len, buf);
+        lock_release();
+        if (got != 0u) {
+            return;
+        }
+        node_wait_mail();
+    }
+}
+
+static void send_ack(uint8_t seq)
+{
+    lock_acquire();
+    if (mailbox_send_msg(API_DRIVER_ID - 1u, NODE_ID, &seq, 1u,
+                         MAILBOX_PRIO_NORMAL) == 0u) {
+        api_errors++;
+    }
+    lock_release();
+}
+
+static void wait_acks(uint8_t count)
+{
+    uint8_t src_id;
+    uint16_t len;
+
+    while (count--) {
+        recv_wait(&src_id, &len, payload);
+        if (len != 1u || src_id == API_DRIVER_ID || src_id > API_NUM_PEERS + 1u) {
+            api_errors++;
+        }
+    }
+}
+
+/* Every multicast buffer is free again: the peers' receives gave back
+ * each reference the driver took
+ */
+static void mcast_refs_free(void)
+{
+    uint8_t refs[MCAST_NUM_BUFS];
+    uint8_t k;
+
+    lock_acquire();
+    fram_read_bytes(MCAST_REF_ADDR, refs, MCAST_NUM_BUFS);
+    lock_release();
+    for (k = 0u; k < MCAST_NUM_BUFS; k++) {
+        if (refs[k] != 0u) {
+            api_errors++;
+        }
+    }
+}
+
+/* ---- Multicast ---- */
+
+/* Rounds of MCAST_NUM_BUFS multicasts to both peers in one hold: every
+ * buffer is referenced then, so one more must find none free. The peers'
+ * receives give them all back before the next round.
+ */
+static void mcast_driver(void)
+{
+    uint8_t round;
+    uint8_t k;
+
+    for (round = 0u; round < API_MCAST_ROUNDS; round += MCAST_NUM_BUFS) {
+        lock_acquire();
+        for (k = 0u; k < MCAST_NUM_BUFS; k++) {
+            build_pattern(payload, API_MCAST_LEN, (uint8_t)(round + k));
+            if (mailbox_send_multicast(API_PEER_MASK, NODE_ID, payload,
+                                       API_MCAST_LEN) != API_PEER_MASK) {
+                api_errors++;
+            }
+        }
+        if (mailbox_send_multicast(API_PEER_MASK, NODE_ID, payload,
+                                   API_MCAST_LEN) != 0u) {
+            api_errors++;
+        }
+        lock_release();
+
+        wait_acks(MCAST_NUM_BUFS * API_NUM_PEERS);
+    }
+}
+
+static void mcast_peer(void)
+{
+    uint8_t i;
+    uint8_t src_id;
+    uint16_t len;
+
+    for (i = 0u; i < API_MCAST_ROUNDS; i++) {
+        recv_wait(&src_id, &len, payload);
+        if (src_id != API_DRIVER_ID || len != API_MCAST_LEN ||
+            !check_pattern(payload, len, i)) {
+            api_errors++;
+        }
+        send_ack(i);
+    }
+}
+
+/* ---- Flow control ---- */
+
+/* Node 1 sends more bulk messages to node 2 than its box holds. At the
+ * first full box it tells node 2 so on the high lane, which still has
+ * room, and from then on sleeps in lock_wait_space(). Node 2 reads
+ * nothing before that message, so every later send has to wait for the
+ * arbiter's space-available pulse.
+ */
+static void flow_driver(void)
+{
+    uint16_t count;
+    uint16_t i;
+    uint16_t waits = 0u;
+    uint8_t sent;
+    uint8_t full[2];
+
+    lock_acquire();
+    count = (uint16_t)(mailbox_node_box_size(1u) / API_FLOW_LEN) + 4u;
+    lock_release();
+
+    full[0] = (uint8_t)count;
+    full[1] = (uint8_t)(count >> 8);
+
+    for (i = 0u; i < count; i++) {
+        build_pattern(payload, API_FLOW_LEN, (uint8_t)i);
+        lock_acquire();
+        do {
+            sent = mailbox_send_bulk(1u, NODE_ID, payload, API_FLOW_LEN);
+            if (!sent && waits++ == 0u &&
+                !mailbox_send_msg(1u, NODE_ID, full, 2u, MAILBOX_PRIO_HIGH)) {
+                api_errors++;
+            }
+        } while (!sent && lock_wait_space(1u, NODE_INDEX, API_FLOW_LEN));
+
+        if (!sent) {
+            sent = mailbox_send_bulk(1u, NODE_ID, payload, API_FLOW_LEN);
+        }
+        if (!sent) {
+            api_errors++;
+        }
+        lock_release();
+    }
+
+    if (waits == 0u) {
+        api_errors++;   /* the box never filled up */
+    }
+}
+
+static void flow_peer(void)
+{
+    mailbox_peek_t pk;
+    uint8_t full[2] = { 0u, 0u };
+    uint8_t got;
+    uint8_t src_id;
+    uint16_t count;
+    uint16_t len;
+    uint16_t i;
+
+    /* Leave the box alone until node 1 says it is full */
+    for (;;) {
+        lock_acquire();
+        got = mailbox_peek(NODE_INDEX, &pk);
+        if (got && pk.lane == MAILBOX_PRIO_HIGH) {
+            if (mailbox_read_at(&pk, 0u, full, 2u) != 2u || pk.len != 2u) {
+                api_errors++;
+            }
+            mailbox_consume(&pk);
+            lock_release();
+            break;
+        }
+        lock_release();
+        node_wait_mail();
+    }
+
+    count = (uint16_t)full[0] | ((uint16_t)full[1] << 8);
+    for (i = 0u; i < count; i++) {
+        recv_wait(&src_id, &len, payload);
+        if (src_id != API_DRIVER_ID || len != API_FLOW_LEN ||
+            !check_pattern(payload, len, (uint8_t)i)) {
+            api_errors++;
+        }
+    }
+}
+
+/* ---- Batched send ---- */
+
+/* One mailbox_send_batch() per peer of API_BATCH_COUNT messages, message
+ * k carrying k + 1 bytes (the last ones a whole slot)
+ */
+static void batch_driver(void)
+{
+    mailbox_msg_t msgs[API_BATCH_COUNT];
+    uint8_t peer;
+    uint8_t k;
+
+    build_pattern(payload, MSG_SLOT_PAYLOAD_MAX, 0x5Au);
+    for (k = 0u; k < API_BATCH_COUNT; k++) {
+        msgs[k].data = payload;
+        msgs[k].len  = (k == API_BATCH_COUNT - 1u) ? MSG_SLOT_PAYLOAD_MAX
+                                                   : (uint8_t)(k + 1u);
+    }
+
+    lock_acquire();
+    for (peer = 1u; peer <= API_NUM_PEERS; peer++) {
+        if (mailbox_send_batch(peer, NODE_ID, msgs, API_BATCH_COUNT) !=
+            API_BATCH_COUNT) {
+            api_errors++;
+        }
+    }
+    lock_release();
+}
+
+static void batch_peer(void)
+{
+    uint8_t k;
+    uint8_t src_id;
+    uint16_t len;
+    uint16_t want;
+
+    for (k = 0u; k < API_BATCH_COUNT; k++) {
+        want = (k == API_BATCH_COUNT - 1u) ? MSG_SLOT_PAYLOAD_MAX : (uint16_t)(k + 1u);
+        recv_wait(&src_id, &len, payload);
+        if (src_id != API_DRIVER_ID || len != want ||
+            !check_pattern(payload, len, 0x5Au)) {
+            api_errors++;
+        }
+    }
+}
+
+/* ---- Batched receive ---- */
+
+static uint16_t iter_len(uint8_t k)
+{
+    return (k == API_ITER_BULK) ? API_ITER_BULK_LEN : 8u;
+}
+
+/* API_ITER_COUNT messages per peer in one hold, one of them a bulk;
+ * together they take more slots than one batch buffer holds
+ */
+static void iter_driver(void)
+{
+    uint8_t peer;
+    uint8_t k;
+    uint8_t sent;
+
+    lock_acquire();
+    for (peer = 1u; peer <= API_NUM_PEERS; peer++) {
+        for (k = 0u; k < API_ITER_COUNT; k++) {
+            build_pattern(payload, iter_len(k), k);
+            if (k == API_ITER_BULK) {
+                sent = mailbox_send_bulk(peer, NODE_ID, payload, API_ITER_BULK_LEN);
+            } else {
+                sent = mailbox_send_msg(peer, NODE_ID, payload, (uint8_t)iter_len(k),
+                                        MAILBOX_PRIO_NORMAL);
+            }
+            if (!sent) {
+                api_errors++;
+            }
+        }
+    }
+    lock_release();
+}
+
+static void iter_peer(void)
+{
+    mailbox_iter_t it;
+    const uint8_t *data;
+    uint8_t src_id;
+    uint16_t len;
+    uint16_t n;
+    uint8_t k = 0u;
+
+    while (k < API_ITER_COUNT) {
+        lock_acquire();
+        n = mailbox_recv_batch(NODE_INDEX, payload, (uint16_t)sizeof(payload), &it);
+        lock_release();
+        if (n == 0u) {
+            node_wait_mail();
+            continue;
+        }
+        while (mailbox_iter_next(&it, &src_id, &len, &data)) {
+            if (k >= API_ITER_COUNT || src_id != API_DRIVER_ID ||
+                len != iter_len(k) || !check_pattern(data, len, k)) {
+                api_errors++;
+            }
+            k++;
+        }
+    }
+}
+
+/* ---- Zero-copy receive ---- */
+
+/* A bulk in each peer's ring and a multicast reference after it: the
+ * peers read both in pieces through mailbox_peek() / mailbox_read_at()
+ */
+static void peek_driver(void)
+{
+    uint8_t peer;
+
+    lock_acquire();
+    build_pattern(payload, API_PEEK_LEN, 0u);
+    for (peer = 1u; peer <= API_NUM_PEERS; peer++) {
+        if (!mailbox_send_bulk(peer, NODE_ID, payload, API_PEEK_LEN)) {
+            api_errors++;
+        }
+    }
+    build_pattern(payload, API_PEEK_LEN, 1u);
+    if (mailbox_send_multicast(API_PEER_MASK, NODE_ID, payload,
+                               API_PEEK_LEN) != API_PEER_MASK) {
+        api_errors++;
+    }
+    lock_release();
+}
+
+static void peek_peer(void)
+{
+    mailbox_peek_t pk;
+    uint16_t off;
+    uint16_t n;
+    uint8_t k = 0u;
+
+    while (k < 2u) {
+        lock_acquire();
+        if (!mailbox_peek(NODE_INDEX, &pk)) {
+            lock_release();
+            node_wait_mail();
+            continue;
+        }
+        if (pk.src_id != API_DRIVER_ID || pk.len != API_PEEK_LEN) {
+            api_errors++;
+        }
+        for (off = 0u; off < pk.len; off = (uint16_t)(off + n)) {
+            n = mailbox_read_at(&pk, off, &payload[off], API_PEEK_PIECE);
+            if (n == 0u) {
+                api_errors++;
+                break;
+            }
+        }
+        /* Past the end nothing more is read */
+        if (mailbox_read_at(&pk, pk.len, payload, 1u) != 0u ||
+            !check_pattern(payload, pk.len, k)) {
+            api_errors++;
+        }
+        mailbox_consume(&pk);
+        lock_release();
+        k++;
+    }
+}
+
+/* ---- Bulk across the ring end ---- */
+
+/* Source of the wrap phase's bulk; its bytes are all 0, while everything
+ * sent to box 1 before carries a pattern
+ */
+static const uint8_t api_wrap_src[API_WRAP_MAX] = { 0u };
+
+/* Read box 1's normal lane descriptor */
+static void wrap_desc(node_box_desc_t *d)
+{
+    fram_read_bytes(mailbox_node_desc_addr(1u), (uint8_t *)d,
+                    (uint32_t)sizeof(*d));
+}
+
+/* Node 2 drains its box with head and tail left mid-ring, then gets one
+ * bulk of more units than head that crosses the ring end. Nothing else
+ * is queued, so head never moves again: it only fits split at the end.
+ */
+static void wrap_driver(void)
+{
+    node_box_desc_t d;
+    uint16_t slots;
+    uint16_t mid;
+    uint16_t tail;
+    uint16_t n;
+    uint16_t bulk_len;
+    uint8_t  info[4];
+    uint16_t fillers = 0u;
+
+    lock_acquire();
+    wrap_desc(&d);
+    slots    = (uint16_t)(d.size / d.msg_size);
+    mid      = (uint16_t)(slots / 2u);
+    bulk_len = (uint16_t)((slots - mid + 1u) * MSG_SLOT_SIZE - sizeof(msg_hdr_t));
+
+    /* Filler bulks move tail to mid, none of them across the ring end */
+    build_pattern(payload, API_WRAP_FILL * MSG_SLOT_SIZE, 0x3Cu);
+    for (tail = d.tail; tail != mid; tail = (uint16_t)((tail + n) % slots)) {
+        n = (uint16_t)((mid + slots - tail) % slots);
+        if (n > API_WRAP_FILL) {
+            n = API_WRAP_FILL;
+        }
+        if (n > slots - tail) {
+            n = (uint16_t)(slots - tail);
+        }
+        if (!mailbox_send_bulk(1u, NODE_ID, payload,
+                               (uint16_t)(n * MSG_SLOT_SIZE - sizeof(msg_hdr_t)))) {
+            api_errors++;
+            break;
+        }
+        fillers++;
+    }
+
+    info[0] = (uint8_t)fillers;
+    info[1] = (uint8_t)(fillers >> 8);
+    info[2] = (uint8_t)bulk_len;
+    info[3] = (uint8_t)(bulk_len >> 8);
+    if (!mailbox_send_msg(1u, NODE_ID, info, 4u, MAILBOX_PRIO_HIGH)) {
+        api_errors++;
+    }
+    lock_release();
+
+    wait_acks(1u);
+
+    lock_acquire();
+    wrap_desc(&d);
+    if (d.head != mid || d.tail != mid || bulk_len > API_WRAP_MAX) {
+        api_errors++;
+    }
+    if (bulk_len > API_WRAP_MAX ||
+        !mailbox_send_bulk(1u, NODE_ID, api_wrap_src, bulk_len)) {
+        /* Still give node 2 something to read, so the phase ends */
+        api_errors++;
+        (void)mailbox_send_msg(1u, NODE_ID, api_wrap_src, 1u,
+                               MAILBOX_PRIO_NORMAL);
+    }
+    lock_release();
+}
+
+static void wrap_peer(void)
+{
+    mailbox_peek_t pk;
+    uint8_t  src_id;
+    uint16_t fillers;
+    uint16_t bulk_len;
+    uint16_t len;
+    uint16_t off;
+    uint16_t n;
+    uint16_t i;
+
+    /* The high lane is read first: filler count and bulk length */
+    recv_wait(&src_id, &len, payload);
+    if (len != 4u) {
+        api_errors++;
+    }
+    fillers  = (uint16_t)payload[0] | ((uint16_t)payload[1] << 8);
+    bulk_len = (uint16_t)payload[2] | ((uint16_t)payload[3] << 8);
+
+    while (fillers--) {
+        recv_wait(&src_id, &len, payload);
+        if (src_id != API_DRIVER_ID || !check_pattern(payload, len, 0x3Cu)) {
+            api_errors++;
+        }
+    }
+    send_ack(1u);
+
+    for (;;) {
+        lock_acquire();
+        if (mailbox_peek(NODE_INDEX, &pk)) {
+            break;
+        }
+        lock_release();
+        node_wait_mail();
+    }
+    if (pk.src_id != API_DRIVER_ID || pk.len != bulk_len) {
+        api_errors++;
+    }
+    for (off = 0u; off < pk.len; off = (uint16_t)(off + n)) {
+        n = mailbox_read_at(&pk, off, payload, (uint16_t)sizeof(payload));
+        if (n == 0u) {
+            api_errors++;
+            break;
+        }
+        for (i = 0u; i < n; i++) {
+            if (payload[i] != 0u) {
+                api_errors++;
+                break;
+            }
+        }
+    }
+    mailbox_consume(&pk);
+    lock_release();
+}
+
+/* ---- Streams ---- */
+
+static uint8_t stream_byte(uint32_t pos)
+{
+    return (uint8_t)(pos * 7u + 3u);
+}
+
+/* Queue bytes [from, to) of a stream, in chunks of API_STREAM_CHUNK */
+static void stream_put(mailbox_stream_t *st, uint32_t from, uint32_t to)
+{
+    uint16_t len;
+    uint16_t i;
+
+    while (from < to) {
+        len = (to - from > API_STREAM_CHUNK) ? API_STREAM_CHUNK
+                                             : (uint16_t)(to - from);
+        for (i = 0u; i < len; i++) {
+            payload[i] = stream_byte(from + i);
+        }
+        if (mailbox_stream_write(st, payload, len) != len) {
+            api_errors++;
+        }
+        from += len;
+    }
+}
+
+/* Node 2 gets API_STREAM_LEN bytes written over several holds while it
+ * reads. Node 3 gets two streams that break the length they announce at
+ * OPEN, each queued in one hold: one stops short, one runs over.
+ */
+static void stream_driver(void)
+{
+    mailbox_stream_t st;
+    uint32_t pos;
+
+    lock_acquire();
+    if (!mailbox_stream_open(&st, 1u, NODE_ID, 1u, API_STREAM_LEN)) {
+        api_errors++;
+    }
+    lock_release();
+    for (pos = 0u; pos < API_STREAM_LEN; pos += API_STREAM_CHUNK) {
+        lock_acquire();
+        stream_put(&st, pos, pos + API_STREAM_CHUNK);
+        lock_release();
+    }
+    lock_acquire();
+    if (!mailbox_stream_close(&st)) {
+        api_errors++;
+    }
+
+    if (!mailbox_stream_open(&st, 2u, NODE_ID, 2u, API_STREAM_LEN)) {
+        api_errors++;
+    }
+    stream_put(&st, 0u, API_STREAM_LEN - API_STREAM_CHUNK);
+    if (!mailbox_stream_close(&st)) {
+        api_errors++;
+    }
+    lock_release();
+
+    wait_acks(1u);
+
+    lock_acquire();
+    if (!mailbox_stream_open(&st, 2u, NODE_ID, 3u, API_STREAM_LEN - API_STREAM_CHUNK)) {
+        api_errors++;
+    }
+    stream_put(&st, 0u, API_STREAM_LEN);
+    if (!mailbox_stream_close(&st)) {
+        api_errors++;
+    }
+    lock_release();
+}
+
+/* Read one stream to its end; returns the final state */
+static uint8_t stream_take(uint32_t *bytes)
+{
+    mailbox_stream_reader_t r;
+    uint8_t got;
+    uint16_t n;
+    uint16_t i;
+
+    for (;;) {
+        lock_acquire();
+        got = mailbox_stream_accept(&r, NODE_INDEX);
+        lock_release();
+        if (got) {
+            break;
+        }
+        node_wait_mail();
+    }
+
+    *bytes = 0u;
+    while (r.state == MAILBOX_STREAM_ACTIVE) {
+        lock_acquire();
+        n = mailbox_stream_read(&r, payload, API_STREAM_PIECE);
+        lock_release();
+        for (i = 0u; i < n; i++) {
+            if (payload[i] != stream_byte(*bytes + i)) {
+                api_errors++;
+                break;
+            }
+        }
+        *bytes += n;
+        if (n == 0u && r.state == MAILBOX_STREAM_ACTIVE) {
+            node_wait_mail();
+        }
+    }
+    return r.state;
+}
+
+static void stream_peer(void)
+{
+    uint32_t bytes;
+    uint8_t src_id;
+    uint16_t len;
+    uint8_t got;
+
+    if (NODE_ID == 2u) {
+        if (stream_take(&bytes) != MAILBOX_STREAM_DONE || bytes != API_STREAM_LEN) {
+            api_errors++;
+        }
+    } else {
+        /* Short: every byte sent arrives, but fewer than announced */
+        if (stream_take(&bytes) != MAILBOX_STREAM_ERROR ||
+            bytes != API_STREAM_LEN - API_STREAM_CHUNK) {
+            api_errors++;
+        }
+        send_ack(0u);
+
+        /* Over: stopped at the first fragment past the announced length */
+        if (stream_take(&bytes) != MAILBOX_STREAM_ERROR ||
+            bytes > API_STREAM_LEN - API_STREAM_CHUNK) {
+            api_errors++;
+        }
+        /* The rest of that stream is left in the box: drop it */
+        do {
+            lock_acquire();
+            got = mailbox_recv_msg(NODE_INDEX, &src_id, &len, payload);
+            lock_release();
+        } while (got);
+    }
+}
+
+/* ---- Lease ---- */
+
+static volatile uint8_t g_hold_over = 0u;
+
+#pragma vector = TIMER0_A0_VECTOR
+__interrupt void TIMER0_A0_ISR(void)
+{
+    TA0CCTL0    = 0u;
+    g_hold_over = 1u;
+    __bic_SR_register_on_exit(LPM0_bits);
+}
+
+/* Sleep for ticks of TA0 (8 us) */
+static void api_sleep(uint16_t ticks)
+{
+    TA0CTL = TASSEL__SMCLK | MC__CONTINUOUS | TACLR | ID__8;  // SMCLK/8
+    TA0EX0 = TAIDEX_7;                                        // /8 -> 8 us
+
+    __disable_interrupt();
+    g_hold_over = 0u;
+    TA0CCR0  = (uint16_t)(TA0R + ticks);
+    TA0CCTL0 = CCIE;
+    while (!g_hold_over) {
+        __bis_SR_register(LPM0_bits | GIE);
+        __disable_interrupt();
+    }
+    __enable_interrupt();
+}
+
+/* Send ourselves one byte and read it back, bus held */
+static uint8_t lease_echo(uint8_t mark)
+{
+    uint8_t src_id;
+    uint16_t len;
+
+    return (uint8_t)(mailbox_send_msg(NODE_INDEX, NODE_ID, &mark, 1u,
+                                      MAILBOX_PRIO_NORMAL) &&
+                     mailbox_recv_msg(NODE_INDEX, &src_id, &len, payload) &&
+                     len == 1u && payload[0] == mark);
+}
+
+/* Sleep through API_LEASE_HOLD with the bus held (the arbiter's lease
+ * check comes in meanwhile), then send ourselves a message and read it
+ * back
+ */
+static uint8_t lease_hold(void)
+{
+    uint8_t ok;
+
+    api_sleep(API_LEASE_HOLD);
+
+    ok = lease_echo(0xA5u);
+    if (lock_revoked()) {
+        ok = 0u;
+    }
+    lock_release();
+    return ok;
+}
+
+/* A session idle at the lease check gives the bus back, and the next
+ * operation asks for it again: none of them may hang or be revoked
+ */
+static uint8_t lease_session(void)
+{
+    uint8_t ok = 1u;
+    uint8_t i;
+
+    lock_session_begin(API_SESSION_IDLE_US, 0u);
+    for (i = 0u; i < API_SESSION_OPS; i++) {
+        lock_acquire();
+        if (!lease_echo(i) || lock_revoked()) {
+            ok = 0u;
+        }
+        lock_session_done();
+        api_sleep(API_SESSION_GAP);
+    }
+    lock_session_end();
+    return ok;
+}
+
+/* Node 1 alone, once the peers are done: a hold that asked for more time
+ * keeps the bus past the lease check, one that did not loses it there
+ * and none of its FRAM accesses after the check take effect. Last, a
+ * lock session that outlives a lease.
+ */
+static void lease_driver(void)
+{
+    uint8_t src_id;
+    uint16_t len;
+
+    lock_acquire();
+    lock_extend_lease();
+    if (!lease_hold()) {
+        api_errors++;
+    }
+
+    lock_acquire();
+    if (lease_hold()) {
+        api_errors++;
+    }
+
+    /* The bus is granted again, and nothing of the revoked hold landed */
+    lock_acquire();
+    if (mailbox_recv_msg(NODE_INDEX, &src_id, &len, payload)) {
+        api_errors++;
+    }
+    lock_release();
+
+    if (!lease_session()) {
+        api_errors++;
+    }
+}
+
+
+/* ---- Phases ---- */
+
+/* One phase per API feature. The driver runs driver(); every peer in
+ * peers (box bits, box = node ID - 1) runs peer() and then acks once;
+ * the driver waits for those acks, runs verify() if there is one, and
+ * each node taking part reports the phase.
+ */
+typedef struct {
+    const char *name;
+    void (*driver)(void);
+    void (*peer)(void);
+    void (*verify)(void);
+    mailbox_mask_t peers;
+} api_phase_t;
+
+static const api_phase_t api_phases[] = {
+    { "mcast",      mcast_driver,  mcast_peer,  mcast_refs_free, API_PEER_MASK },
+    { "flow",       flow_driver,   flow_peer,   0,               (mailbox_mask_t)0x02u },
+    { "batch send", batch_driver,  batch_peer,  0,               API_PEER_MASK },
+    { "batch recv", iter_driver,   iter_peer,   0,               API_PEER_MASK },
+    { "peek",       peek_driver,   peek_peer,   mcast_refs_free, API_PEER_MASK },
+    { "wrap",       wrap_driver,   wrap_peer,   0,               (mailbox_mask_t)0x02u },
+    { "stream",     stream_driver, stream_peer, 0,               API_PEER_MASK },
+    { "lease",      lease_driver,  0,           0,               0u },
+};
+
+static void api_run(const api_phase_t *ph)
+{
+    mailbox_mask_t m;
+    uint8_t acks = 0u;
+
+    if (NODE_ID == API_DRIVER_ID) {
+        ph->driver();
+        for (m = ph->peers; m != 0u; m &= (mailbox_mask_t)(m - 1u)) {
+            acks++;
+        }
+        wait_acks(acks);
+        if (ph->verify != 0) {
+            ph->verify();
+        }
+    } else if (ph->peers & ((mailbox_mask_t)1u << NODE_INDEX)) {
+        ph->peer();
+        send_ack(0u);
+    } else {
+        return;
+    }
+    api_report(ph->name);
+}
+
+/* ---- main ---- */
+
+void test(){
+
+    uint8_t i;
+
+    for (i = 0u; i < sizeof(api_phases) / sizeof(api_phases[0]); i++) {
+        api_run(&api_phases[i]);
+    }
+
+    uart0_println("API done");
+}
+
+
+
+
+int main(void){
+
+    WDTCTL = WDTPW | WDTHOLD;
+
+    clock_init_8mhz();
+    uart0_init(); //
+    node_gpio_init();
+
+    PM5CTL0 &= ~LOCKLPM5;
+
+    spi_init();
+
+    /* Reset pulse to arbiter (inform it we may have reset) */
+    node_pulse_reset_on_gnt();
+
+    /* LED: red ON (no lock), green OFF */
+    P1OUT &= ~BIT0;
+    P4OUT |= BIT6;
+
+    __bis_SR_register(GIE);
+
+
+    uart0_println("SPI Worker Node Started");
+
+    test();
+
+}
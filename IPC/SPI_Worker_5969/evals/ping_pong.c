@@ -25,194 +25,14 @@
 #include "fram.h"
 #include "mailbox.h"
 #include "uart.h"
+#include "worker.h"
 
 /* Adjust per node build: IDs 1,2,3,... (index = ID-1) */
+#ifndef NODE_ID
 #define NODE_ID         1u
+#endif
 #define NODE_INDEX      (NODE_ID - 1u)
 
-/* REQ = P1.4, GNT = P1.3 */
-#define NODE_REQ_PIN    BIT4
-#define NODE_GNT_PIN    BIT3
-#define NODE_GNT_IV     0x08    /* P1.3 in P1IV */
-
-/* ---- Lock state ---- */
-
-typedef enum {
-    LOCK_IDLE = 0,
-    LOCK_WAIT_GRANT,
-    LOCK_HELD
-} lock_state_t;
-
-static volatile lock_state_t g_lock_state = LOCK_IDLE;
-static volatile uint8_t      g_mail_flag  = 0u;
-
-
-static const uint16_t spi_clk_div = 2u;
-
-/* ---- Clock ---- */
-
-static void clock_init_8mhz(void)
-{
-    CSCTL0_H = CSKEY >> 8;
-    CSCTL1   = DCOFSEL_6;
-    CSCTL2   = SELS__DCOCLK | SELM__DCOCLK;
-    CSCTL3   = DIVS__1 | DIVM__1;
-    CSCTL0_H = 0;
-}
-
-/* ---- GPIO ---- */
-
-static void node_gpio_init(void)
-{
-    /* REQ: P1.4 in, pulldown */
-    P1SEL0 &= (uint8_t)~NODE_REQ_PIN;
-    P1SEL1 &= (uint8_t)~NODE_REQ_PIN;
-
-    P1DIR  &= (uint8_t)~NODE_REQ_PIN;
-    P1REN  |= NODE_REQ_PIN;
-    P1OUT  &= (uint8_t)~NODE_REQ_PIN;
-
-    /* GNT: P1.3 in, pulldown, rising-edge interrupt */
-    P1SEL0 &= (uint8_t)~NODE_GNT_PIN;
-    P1SEL1 &= (uint8_t)~NODE_GNT_PIN;
-
-    P1DIR  &= (uint8_t)~NODE_GNT_PIN;
-    P1REN  |= NODE_GNT_PIN;
-    P1OUT  &= (uint8_t)~NODE_GNT_PIN;
-
-    P1IES  &= (uint8_t)~NODE_GNT_PIN;  /* low->high */
-    P1IFG  &= (uint8_t)~NODE_GNT_PIN;
-    P1IE   |= NODE_GNT_PIN;
-
-    /* LEDs */
-    P1DIR |= BIT0;
-    P4DIR |= BIT6;
-
-}
-
-/* High pulse on REQ */
-static void node_pulse_req_line(void)
-{
-    P1DIR |= NODE_REQ_PIN;
-    P1OUT |= NODE_REQ_PIN;
-    __delay_cycles(50u);
-    P1OUT &= (uint8_t)~NODE_REQ_PIN;
-    P1DIR &= (uint8_t)~NODE_REQ_PIN;
-}
-
-/* High pulse on GNT for reset notification at startup */
-static void node_pulse_reset_on_gnt(void)
-{
-    P1IE  &= (uint8_t)~NODE_GNT_PIN;
-    P1IFG &= (uint8_t)~NODE_GNT_PIN;
-
-    P1DIR |= NODE_GNT_PIN;
-    P1OUT |= NODE_GNT_PIN;
-    __delay_cycles(50u);
-    P1OUT &= (uint8_t)~NODE_GNT_PIN;
-    P1DIR &= (uint8_t)~NODE_GNT_PIN;
-
-    P1IFG &= (uint8_t)~NODE_GNT_PIN;
-    P1IE  |= NODE_GNT_PIN;
-}
-
-/* ---- Lock API ---- */
-
-static void lock_acquire(void)
-{
-    if (g_lock_state == LOCK_HELD) {
-        return;
-    }
-
-    __disable_interrupt();
-    g_lock_state = LOCK_WAIT_GRANT;
-    // uart0_println("Acquiring lock");
-    node_pulse_req_line();    /* request FRAM bus */
-
-    while (g_lock_state != LOCK_HELD) {
-        __bis_SR_register(LPM0_bits | GIE);
-        __disable_interrupt();
-    }
-    __enable_interrupt();
-
-    spi_enable(spi_clk_div);
-    // uart0_println("Lock acquired");
-}
-
-static void lock_release(void)
-{
-    if (g_lock_state != LOCK_HELD) {
-        return;
-    }
-
-    spi_disable();
-    // uart0_println("Releasing lock");
-    node_pulse_req_line();    /* release FRAM bus */
-
-    __disable_interrupt();
-    g_lock_state = LOCK_IDLE;
-    __enable_interrupt();
-
-}
-
-/* ---- Mailbox helpers ---- */
-
-static void process_incoming_messages(void)
-{
-    lock_acquire();
-    g_mail_flag = 0u; // clear flag**
-
-    P1OUT |= BIT0;
-    P4OUT &= ~BIT6;
-
-
-    uint8_t src_id = 0u;
-    uint16_t len = 0u;
-    uint8_t buf[MSG_SLOT_PAYLOAD_MAX];
-    uint8_t got;
-
-    for (;;) {
-        got = mailbox_recv_msg(0u, &src_id, &len, buf);
-
-        if (got == 0u) {
-            break;
-        }
-        uart0_print("Received msg from ");
-        uart0_print_uint(src_id); 
-        uart0_print(", len=");
-        uart0_print_uint(len);
-        uart0_println("");
-        /* TODO: handle message (src_id, buf[0..len-1]) */
-        /* For now, just toggle green LED once per message */
-        P1OUT ^= BIT0;
-    }
-
-    // notification bytes cleared by arbiter
-
-    lock_release();
-    P1OUT &= ~BIT0;
-    P4OUT |= BIT6;
-}
-
-/* ---- ISR ---- */
-
-#pragma vector = PORT1_VECTOR
-__interrupt void PORT1_ISR(void)
-{
-    uint16_t iv = P1IV;
-
-    if (iv == NODE_GNT_IV) {
-        if (g_lock_state == LOCK_WAIT_GRANT) {
-            g_lock_state = LOCK_HELD;
-        } else {
-            /* GNT pulse with no pending lock => mail notification */
-            // uart0_println("Mail");
-            g_mail_flag = 1u;
-        }
-        __bic_SR_register_on_exit(LPM0_bits);
-    }
-}
-
 /* Evaluations and Experiments*/
 
 static uint8_t payload[1024u];
@@ -220,9 +40,9 @@ static uint8_t payload[1024u];
 static void send_dummy_message(uint8_t dst_idx, uint8_t src_idx, uint16_t len, const uint8_t *payload)
 {
     uint8_t i;
-    // i = mailbox_send_msg(dst_idx, src_idx, payload, len);
+    // i = mailbox_send_msg(dst_idx, src_idx, payload, len, MAILBOX_PRIO_NORMAL);
     i = mailbox_send_bulk(dst_idx, src_idx, payload, len);
-    // if(!i) {P4OUT |= BIT6; P1OUT |= BIT0;} // indicate failure
+    if(!i) {P4OUT |= BIT6; P1OUT |= BIT0;} // indicate failure
     // else {uart0_println("Message sent");uart0_print_uint(i);uart0_println("");}
 }
 
@@ -247,19 +67,6 @@ void timer_start(void){
 
 
 
-static inline void wait_for_mail(void)
-{
-    while(!g_mail_flag);
-    // __disable_interrupt();
-    // while (!g_mail_flag) {
-    //     __bis_SR_register(LPM0_bits | GIE);  // sleep, atomically set GIE+LPM
-
-    //     // Woke up from ISR: interrupts are enabled here.
-    //     __disable_interrupt();               // close race before rechecking
-    // }
-    // __enable_interrupt();
-}
-
 void test(void){
     uint32_t e1, e2, e3;
     build_msg_payload(payload, 1024u);
@@ -304,11 +111,10 @@ void ping_pong_test_sender(void)
 {
     uint16_t size[] = {16u, 32u, 64u, 128u, 256u, 512u, 1024u};
     uint8_t i;
-    uint32_t  e1, e2, e3, e4, e5, e0;
+    uint32_t  e1, e2, e3, e0;
 
     uint8_t src_id = 0u;
     uint16_t len = 0u;
-    uint8_t got;
 
     for (i=0; i<7; i++){
 
@@ -322,13 +128,12 @@ void ping_pong_test_sender(void)
         // e4 = TA0R;
         send_dummy_message(1u, NODE_INDEX, size[i], payload);
         // e4 = TA0R - e4;
-        lock_release();
+        lock_release_to(2u);    /* the receiver reads without a REQ */
         e1 = TA0R - e1;
 
 
         e2 = TA0R;
-        wait_for_mail();
-        g_mail_flag = 0u; // clear flag**
+        node_wait_mail();
         e2 = TA0R - e2;
 
 
@@ -391,8 +196,7 @@ void ping_pong_test_receiver(void)
 {
     while(1){
 
-        wait_for_mail();
-        g_mail_flag = 0u; // clear flag**
+        node_wait_mail();
         lock_acquire();
         // process_incoming_messages();
         uint8_t src_id = 0u;
@@ -400,8 +204,12 @@ void ping_pong_test_receiver(void)
         uint8_t got;
 
         got = mailbox_recv_msg(NODE_INDEX, &src_id, &len, payload);
+        if (!got) {
+            lock_release();     /* woken with nothing to echo */
+            continue;
+        }
         send_dummy_message(src_id, NODE_INDEX, len, payload);
-        lock_release();
+        lock_release_to((uint8_t)(src_id + 1u));   /* src_id is an index */
         }
 }
 
@@ -409,7 +217,6 @@ void ping_pong_test_receiver(void)
 
 int main(void){
 
-    uint32_t delay_cnt;
     // spi_clk_div = 16u; // SMCLK / 2 = 4MHz
     // change payload size in mailbox.h 
 
@@ -428,7 +235,6 @@ int main(void){
 
     /* Reset pulse to arbiter (inform it we may have reset) */
     node_pulse_reset_on_gnt();
-    g_lock_state = LOCK_IDLE;
 
     /* LED: red ON (no lock), green OFF */
     P1OUT &= ~BIT0;
@@ -650,7 +456,7 @@ int main(void){
 // static void send_dummy_message(uint8_t dst_idx, uint8_t src_idx, uint16_t len, const uint8_t *payload)
 // {
 //     uint8_t i;
-//     // i = mailbox_send_msg(dst_idx, src_idx, payload, len);
+//     // i = mailbox_send_msg(dst_idx, src_idx, payload, len, MAILBOX_PRIO_NORMAL);
 //     i = mailbox_send_bulk(dst_idx, src_idx, payload, len);
 //     // if(!i) {P4OUT |= BIT6; P1OUT |= BIT0;} // indicate failure
 //     // else {uart0_println("Message sent");uart0_print_uint(i);uart0_println("");}
@@ -1,5 +1,6 @@
 #include <msp430.h>
 #include <stdint.h>
+#include <string.h>
 #include "fram.h"
 
 /* FRAM opcodes */
@@ -26,8 +27,13 @@
     FRAM_CS_DIR &= (uint8_t)~FRAM_CS_PIN;       /* input, high-Z */ \
 } while (0)
 
+/* Set by fram_revoke(): the bus is no longer ours */
+static volatile uint8_t fram_revoked = 0u;
+
 /* -------------- Internal SPI helpers (UCB0) -------------- */
 
+static void fram_config_dma_spi_txrx(void);
+
 static uint8_t spi_transfer(uint8_t data)
 {
     while ((UCB0IFG & UCTXIFG) == 0u) { }
@@ -38,6 +44,25 @@ static uint8_t spi_transfer(uint8_t data)
     return UCB0RXBUF;
 }
 
+/* TX-only streaming: bytes go out back-to-back, RX is ignored */
+static void spi_tx_bytes(const uint8_t *src, uint16_t n)
+{
+    uint16_t i;
+
+    for (i = 0u; i < n; i++) {
+        while ((UCB0IFG & UCTXIFG) == 0u) { }
+        UCB0TXBUF = src[i];
+    }
+}
+
+/* Wait for the wire to go idle and drop the RX bytes spi_tx_bytes left */
+static void spi_tx_end(void)
+{
+    while (UCB0STATW & UCBUSY) { }
+    (void)UCB0RXBUF;
+    UCB0STATW &= (uint16_t)~(UCOE | UCFE);
+}
+
 void spi_init(void)
 {
     // Make sure I/Os are unlocked if you use LPMx.5 at any point
@@ -59,10 +84,16 @@ void spi_init(void)
     FRAM_CS_DIR &= (uint8_t)~FRAM_CS_PIN;
     FRAM_CS_REN &= (uint8_t)~FRAM_CS_PIN;
     FRAM_CS_HIGH();  // input, high-Z, external pull keeps it high
+
+    /* DMA routing does not depend on the eUSCI state: set it up once */
+    fram_config_dma_spi_txrx();
 }
 
 void spi_enable(uint8_t clk_div)
 {
+    /* A new grant */
+    fram_revoked = 0u;
+
     // Still keep in reset while configuring
     UCB0CTLW0 = UCSWRST |
                 UCMST    |
@@ -82,6 +113,9 @@ void spi_enable(uint8_t clk_div)
 
 void spi_disable(void)
 {
+    /* Never drop the bus under an asynchronous transfer */
+    fram_wait();
+
     // Make sure last byte fully clocked
     while ((UCB0IFG & UCTXIFG) == 0u) {
         /* wait */
@@ -97,13 +131,32 @@ void spi_disable(void)
 }
 
 
-/* -------------- FRAM + DMA (TX only) -------------- */
+/* -------------- FRAM + DMA -------------- */
 
 /* Threshold above which we use DMA; below this use simple polled SPI */
 static volatile uint8_t fram_dma_dummy = 0u;
 #define FRAM_DMA_THRESHOLD   16u
 
-/* Route DMA0 -> UCB0RXIFG0, DMA1 -> UCB0TXIFG0 */
+/* Synchronous DMA transfers go out in pieces of at most this many bytes,
+ * with fram_revoked checked between them: a holder whose lease check
+ * revoked the bus lets go of it within one piece, whatever the length of
+ * the transfer (the arbiter's ARB_LEASE_GRACE is sized for one piece)
+ */
+#define FRAM_REVOKE_PIECE    256u
+
+/* Command + 24-bit address, streamed ahead of the payload */
+#define FRAM_CMD_HDR_LEN     4u
+static uint8_t fram_cmd_hdr[FRAM_CMD_HDR_LEN];
+
+/* In-flight asynchronous transfer (completed by DMA_ISR) */
+static volatile uint8_t fram_async_busy = 0u;
+static fram_done_cb_t   fram_async_cb   = 0;
+static void            *fram_async_ctx  = 0;
+
+/* Route DMA0 -> UCB0RXIFG0, DMA1 -> UCB0TXIFG0.
+ * Called once from spi_init(); the fixed ends of both channels
+ * (DMA0 reads RXBUF, DMA1 writes TXBUF) are set here as well.
+ */
 static void fram_config_dma_spi_txrx(void)
 {
     /* Configure DMA0 trigger (low 5 bits of DMACTL0) */
@@ -116,185 +169,146 @@ static void fram_config_dma_spi_txrx(void)
 
     /* Avoid DMA during CPU read-modify-write sequences */
     DMACTL4 |= DMARMWDIS;
+
+    DMA0CTL = 0;
+    DMA1CTL = 0;
+    DMA0SA  = (uint32_t)(uintptr_t)&UCB0RXBUF;     /* source: SPI RXBUF */
+    DMA1DA  = (uint32_t)(uintptr_t)&UCB0TXBUF;     /* dest: TXBUF       */
 }
 
-/* Stream-write bytes over SPI using DMA0 for TX.
- * Assumes:
- *  - FRAM_CS_LOW(), WRITE opcode and address have already been sent.
- *  - len >= FRAM_DMA_THRESHOLD.
- */
-/* Stream-write bytes over SPI using DMA (TX + RX drain).
- * Assumes:
- *  - FRAM_CS_LOW(), WRITE opcode and address have already been sent.
- *  - len >= FRAM_DMA_THRESHOLD.
- */
-static void fram_stream_write_dma(const uint8_t *src, uint32_t len)
+static void fram_build_hdr(uint8_t cmd, uint32_t addr)
 {
-    uint16_t n = (uint16_t)len;
+    fram_cmd_hdr[0] = cmd;
+    fram_cmd_hdr[1] = (uint8_t)((addr >> 16) & 0xFFu);
+    fram_cmd_hdr[2] = (uint8_t)((addr >>  8) & 0xFFu);
+    fram_cmd_hdr[3] = (uint8_t)( addr        & 0xFFu);
+}
 
+/* Queue one fragment behind the previous one on DMA1.
+ * DMA1 must have finished the previous fragment (DMAEN self-clears) and
+ * TXBUF must be empty before re-arming, otherwise the TXIFG edge of the
+ * previous last byte would fire DMA1 early. The CPU sends src[0]; when it
+ * moves to the shifter, TXIFG triggers DMA1 for src[1..n-1].
+ */
+static void fram_dma_tx_frag(const uint8_t *src, uint16_t n)
+{
     if (n == 0u) {
         return;
     }
 
-    // /* Small transfers: just use blocking spi_transfer */
-    // if (n < FRAM_DMA_THRESHOLD) {
-    //     uint16_t i;
-    //     for (i = 0u; i < n; i++) {
-    //         (void)spi_transfer(*src++);
-    //     }
-    //     return;
-    // }
+    while ((DMA1CTL & DMAEN) != 0u) { }
+    while ((UCB0IFG & UCTXIFG) == 0u) { }
 
-    /* Configure DMA triggers for UCB0 RX/TX */
-    fram_config_dma_spi_txrx();
+    if (n > 1u) {
+        DMA1SA  = (uint32_t)(uintptr_t)&src[1];
+        DMA1SZ  = (uint16_t)(n - 1u);
+        DMA1CTL =
+            DMADT_0        |    /* Single block transfer                  */
+            DMASRCINCR_3   |    /* increment source address               */
+            DMADSTINCR_0   |    /* dest fixed (TXBUF)                     */
+            DMASBDB        |    /* byte -> byte                           */
+            DMAEN;
+    }
 
-    /* Clear any stale errors / flags on eUSCI_B0 */
-    (void)UCB0RXBUF;                           /* flush RXBUF */
-    UCB0STATW &= (uint16_t)~(UCOE | UCFE);     /* clear overrun/frame error */
+    UCB0TXBUF = src[0];
+}
 
-    /* ---------- Prepare DMA0: RXBUF -> dummy ---------- */
+/* Start a DMA stream-write of fram_cmd_hdr followed by a fragment list,
+ * all under the current CS-low window, queued on DMA1 in pieces of at
+ * most 'piece' bytes.
+ * DMA0 drains RX for the whole stream and completes once the last byte
+ * has been clocked; rx_ie = DMAIE makes that completion raise DMA_ISR.
+ * Returns 1 as soon as the last piece is running, or 0 if fram_revoke()
+ * came first: nothing more is queued then (see fram_stream_stop()).
+ * Assumes:
+ *  - FRAM_CS_LOW() and fram_build_hdr(FRAM_CMD_WRITE, addr) done.
+ *  - total = sum of fragment lengths.
+ */
+static uint8_t fram_stream_writev_start(const fram_wfrag_t *frags,
+                                        uint8_t count,
+                                        uint16_t total,
+                                        uint16_t piece,
+                                        uint16_t rx_ie)
+{
+    uint8_t k;
+    uint16_t off;
+    uint16_t n;
 
-    DMA0CTL = 0;
-    DMA0SZ  = 0;
-    DMA0CTL &= (uint16_t)~DMAIFG;
+    /* Make sure SPI is idle and no stale RX byte is pending */
+    spi_tx_end();
 
-    DMA0SA = (uint32_t)(uintptr_t)&UCB0RXBUF;      /* source: SPI RXBUF */
-    DMA0DA = (uint32_t)(uintptr_t)&fram_dma_dummy; /* dest: dummy byte  */
-    DMA0SZ = n;                                    /* same count as TX   */
+    /* ---------- DMA0: RXBUF -> dummy, whole stream ---------- */
 
+    DMA0CTL = 0;
+    DMA0DA  = (uint32_t)(uintptr_t)&fram_dma_dummy;
+    DMA0SZ  = (uint16_t)(total + FRAM_CMD_HDR_LEN);
     DMA0CTL =
         DMADT_0        |    /* Single block transfer (SZ down to 0)       */
         DMASRCINCR_0   |    /* source fixed (RXBUF)                       */
         DMADSTINCR_0   |    /* dest fixed (dummy)                         */
-        DMASBDB;             /* byte -> byte                              */
-
-    /* ---------- Prepare DMA1: src[] -> TXBUF ---------- */
-
-    DMA1CTL = 0;
-    DMA1SZ  = 0;
-    DMA1CTL &= (uint16_t)~DMAIFG;
-
-    /* We will send src[0] with CPU and src[1..n-1] via DMA1 */
-    if (n <= 1u) {
-        /* Degenerate: only one byte, just send by CPU and return */
-        while ((UCB0IFG & UCTXIFG) == 0u) { }
-        UCB0TXBUF = src[0];
-        while (UCB0STATW & UCBUSY) { }
-        return;
-    }
-
-    DMA1SA = (uint32_t)(uintptr_t)&src[1];        /* start from src[1]  */
-    DMA1DA = (uint32_t)(uintptr_t)&UCB0TXBUF;     /* dest: TXBUF        */
-    DMA1SZ = (uint16_t)(n - 1u);                  /* remaining bytes    */
-
-    DMA1CTL =
-        DMADT_0        |    /* Single block transfer                      */
-        DMASRCINCR_3   |    /* increment source address                   */
-        DMADSTINCR_0   |    /* dest fixed (TXBUF)                         */
-        DMASBDB;             /* byte -> byte                              */
-
-    /* ---------- Enable DMA and kick off transfer ---------- */
-
-    /* Make sure SPI is idle before starting a new burst */
-    while (UCB0STATW & UCBUSY) {
-        /* wait */
-    }
-
-    /* Enable both channels before first TXIFG edge */
-    DMA0CTL |= DMAEN;
-    DMA1CTL |= DMAEN;
-
-    /* Send first byte by CPU: this starts the SPI stream.
-     * When this byte finishes, UCB0TXIFG0 asserts, which will trigger
-     * DMA1 to start feeding src[1..].
-     */
-    while ((UCB0IFG & UCTXIFG) == 0u) {
-        /* TXBUF empty */
-    }
-    UCB0TXBUF = src[0];
-
-    /* Wait until DMA1 has pushed all remaining bytes */
-    while ((DMA1CTL & DMAIFG) == 0u) {
-        /* spin until SZ->0 and DMAIFG set */
-    }
-
-    /* Optional: wait until last bit actually leaves the wire */
-    while (UCB0STATW & UCBUSY) {
-        /* last byte still shifting out */
+        DMASBDB        |    /* byte -> byte                               */
+        rx_ie          |
+        DMAEN;
+
+    /* ---------- DMA1: prefix, then each fragment ---------- */
+
+    fram_dma_tx_frag(fram_cmd_hdr, FRAM_CMD_HDR_LEN);
+    for (k = 0u; k < count; k++) {
+        for (off = 0u; off < frags[k].len; off = (uint16_t)(off + n)) {
+            n = (uint16_t)(frags[k].len - off);
+            if (n > piece) {
+                n = piece;
+            }
+            while ((DMA1CTL & DMAEN) != 0u) { }
+            if (fram_revoked != 0u) {
+                return 0u;
+            }
+            fram_dma_tx_frag(&frags[k].src[off], n);
+        }
     }
-
-    /* Disable DMA channels until next use */
-    DMA0CTL &= (uint16_t)~DMAEN;
-    DMA1CTL &= (uint16_t)~DMAEN;
+    return 1u;
 }
 
-/* Stream-read bytes over SPI using DMA (RX -> dst, TX <- dummy).
+/* Start a DMA stream-read (RX -> dst, TX <- dummy) and return once it is
+ * running. rx_ie = DMAIE raises DMA_ISR when dst is complete.
  * Assumes:
  *  - FRAM_CS_LOW(), READ opcode and address have already been sent.
- *  - len >= FRAM_DMA_THRESHOLD.
+ *  - n >= 1.
  */
-static void fram_stream_read_dma(uint8_t *dst, uint32_t len)
+static void fram_stream_read_start(uint8_t *dst, uint16_t n, uint16_t rx_ie)
 {
-    uint16_t n = (uint16_t)len;
-
-    if (n == 0u) {
-        return;
-    }
-
-    /* We only call this when len >= FRAM_DMA_THRESHOLD, so n >= 2. */
-
-    /* Configure DMA triggers for UCB0 RX/TX */
-    fram_config_dma_spi_txrx();
-
-    /* Clear any stale errors / flags on eUSCI_B0 */
-    (void)UCB0RXBUF;                           /* flush RXBUF */
-    UCB0STATW &= (uint16_t)~(UCOE | UCFE);     /* clear overrun/frame error */
+    /* The prefix went out TX-only: wait for it and drop its RX bytes */
+    spi_tx_end();
 
     fram_dma_dummy = 0xFFu;
 
     /* ---------- DMA0: RXBUF -> dst[0..n-1] ---------- */
 
     DMA0CTL = 0;
-    DMA0SZ  = 0;
-    DMA0CTL &= (uint16_t)~DMAIFG;
-
-    DMA0SA = (uint32_t)(uintptr_t)&UCB0RXBUF;  /* source: SPI RXBUF */
-    DMA0DA = (uint32_t)(uintptr_t)dst;         /* dest: dst[]       */
-    DMA0SZ = n;
-
+    DMA0DA  = (uint32_t)(uintptr_t)dst;
+    DMA0SZ  = n;
     DMA0CTL =
         DMADT_0        |    /* Single block transfer                  */
         DMASRCINCR_0   |    /* source fixed (RXBUF)                   */
         DMADSTINCR_3   |    /* dest increment                         */
-        DMASBDB;             /* byte -> byte                           */
+        DMASBDB        |    /* byte -> byte                           */
+        rx_ie          |
+        DMAEN;
 
     /* ---------- DMA1: dummy -> TXBUF for remaining n-1 bytes ---------- */
 
     DMA1CTL = 0;
-    DMA1SZ  = 0;
-    DMA1CTL &= (uint16_t)~DMAIFG;
-
-    DMA1SA = (uint32_t)(uintptr_t)&fram_dma_dummy;  /* src: dummy       */
-    DMA1DA = (uint32_t)(uintptr_t)&UCB0TXBUF;       /* dest: TXBUF      */
-    DMA1SZ = (uint16_t)(n - 1u);                    /* remaining bytes  */
-
-    DMA1CTL =
-        DMADT_0        |    /* Single block transfer                  */
-        DMASRCINCR_0   |    /* source fixed                           */
-        DMADSTINCR_0   |    /* dest fixed (TXBUF)                     */
-        DMASBDB;             /* byte -> byte                           */
-
-    /* ---------- Enable DMA and run ---------- */
-
-    /* Make sure SPI is idle before starting a new burst */
-    while (UCB0STATW & UCBUSY) {
-        /* wait */
+    if (n > 1u) {
+        DMA1SA  = (uint32_t)(uintptr_t)&fram_dma_dummy;
+        DMA1SZ  = (uint16_t)(n - 1u);
+        DMA1CTL =
+            DMADT_0        |    /* Single block transfer              */
+            DMASRCINCR_0   |    /* source fixed                       */
+            DMADSTINCR_0   |    /* dest fixed (TXBUF)                 */
+            DMASBDB        |    /* byte -> byte                       */
+            DMAEN;
     }
 
-    /* Enable both channels before first TXIFG edge */
-    DMA0CTL |= DMAEN;
-    DMA1CTL |= DMAEN;
-
     /* Kick off stream: send first dummy byte by CPU.
      * This will produce the first RX byte, which DMA0 will store as dst[0].
      * DMA1 will then drive the remaining n-1 dummy bytes.
@@ -303,29 +317,41 @@ static void fram_stream_read_dma(uint8_t *dst, uint32_t len)
         /* wait for TXBUF empty */
     }
     UCB0TXBUF = fram_dma_dummy;
+}
 
-    /* Wait until RX DMA completes all n bytes */
+/* Block until DMA0 has seen the last RX byte of the running stream */
+static void fram_stream_wait(void)
+{
     while ((DMA0CTL & DMAIFG) == 0u) {
         /* spin */
     }
 
-    /* Ensure last bit has left the wire */
-    while (UCB0STATW & UCBUSY) {
-        /* wait */
-    }
-
     /* Disable DMA channels until next use */
     DMA0CTL &= (uint16_t)~DMAEN;
     DMA1CTL &= (uint16_t)~DMAEN;
 }
 
+/* A write stream cut short by fram_revoke(): let the piece in flight go
+ * out, then stop DMA0, which still counts the bytes never queued
+ */
+static void fram_stream_stop(void)
+{
+    while ((DMA1CTL & DMAEN) != 0u) { }
+    spi_tx_end();
+    DMA0CTL &= (uint16_t)~DMAEN;
+    DMA1CTL &= (uint16_t)~DMAEN;
+}
+
 
 /* -------------- FRAM core helpers -------------- */
 
 static void fram_write_enable(void)
 {
+    static const uint8_t wren = FRAM_CMD_WREN;
+
     FRAM_CS_LOW();
-    spi_transfer(FRAM_CMD_WREN);
+    spi_tx_bytes(&wren, 1u);
+    spi_tx_end();
     FRAM_CS_HIGH();
 }
 
@@ -333,6 +359,11 @@ uint8_t fram_read_status(void)
 {
     uint8_t sr;
 
+    fram_wait();
+    if (fram_revoked != 0u) {
+        return 0u;
+    }
+
     FRAM_CS_LOW();
     spi_transfer(FRAM_CMD_RDSR);
     sr = spi_transfer(0xFF);
@@ -341,82 +372,251 @@ uint8_t fram_read_status(void)
     return sr;
 }
 
-static void fram_send_addr(uint32_t addr)
+/* Send command + address from the RAM header, TX only */
+static void fram_send_cmd(uint8_t cmd, uint32_t addr)
 {
-    spi_transfer((uint8_t)((addr >> 16) & 0xFFu));
-    spi_transfer((uint8_t)((addr >>  8) & 0xFFu));
-    spi_transfer((uint8_t)( addr        & 0xFFu));
+    fram_build_hdr(cmd, addr);
+    spi_tx_bytes(fram_cmd_hdr, FRAM_CMD_HDR_LEN);
 }
 
 /* -------------- Public API -------------- */
 
 void fram_read_bytes(uint32_t addr, uint8_t *dst, uint32_t len)
 {
-    uint32_t i;
+    fram_rfrag_t frag;
+
+    frag.dst = dst;
+    frag.len = (uint16_t)len;
+    fram_readv(addr, &frag, 1u);
+}
+
+void fram_write_bytes(uint32_t addr, const uint8_t *src, uint32_t len)
+{
+    fram_wfrag_t frag;
+
+    frag.src = src;
+    frag.len = (uint16_t)len;
+    fram_writev(addr, &frag, 1u);
+}
+
+void fram_read_id(uint8_t *id, uint8_t len)
+{
+    uint8_t i;
 
     if (len == 0u) {
         return;
     }
 
+    fram_wait();
+    if (fram_revoked != 0u) {
+        memset(id, 0, len);
+        return;
+    }
+
     FRAM_CS_LOW();
-    spi_transfer(FRAM_CMD_READ);
-    fram_send_addr(addr);
+    spi_transfer(FRAM_CMD_RDID);
+    for (i = len; i > 0u; i--) {
+        *id = spi_transfer(0xFF);
+        id++;
+    }
+    FRAM_CS_HIGH();
+}
+
+/* Scatter-gather write: the fragments land back-to-back starting at addr.
+ * The WRITE command + address go out in the same stream as the payload:
+ * TX-only for short lists, through the DMA chain above otherwise.
+ */
+void fram_writev(uint32_t addr, const fram_wfrag_t *frags, uint8_t count)
+{
+    uint16_t total = 0u;
+    uint8_t k;
 
-    /* Symmetric to write: use DMA for larger transfers */
-    if (len >= FRAM_DMA_THRESHOLD) {
-        fram_stream_read_dma(dst, len);
+    for (k = 0u; k < count; k++) {
+        total = (uint16_t)(total + frags[k].len);
+    }
+    if (total == 0u) {
+        return;
+    }
+
+    fram_wait();
+    if (fram_revoked != 0u) {
+        return;
+    }
+    fram_write_enable();
+
+    FRAM_CS_LOW();
+    fram_build_hdr(FRAM_CMD_WRITE, addr);
+
+    if (total + FRAM_CMD_HDR_LEN >= FRAM_DMA_THRESHOLD) {
+        if (fram_stream_writev_start(frags, count, total,
+                                     FRAM_REVOKE_PIECE, 0u)) {
+            fram_stream_wait();
+        } else {
+            fram_stream_stop();
+        }
     } else {
-        /* Small reads: simple polled SPI */
-        for (i = len; i > 0u; i--) {
-            *dst = spi_transfer(0xFF);
-            dst++;
+        spi_tx_bytes(fram_cmd_hdr, FRAM_CMD_HDR_LEN);
+        for (k = 0u; k < count; k++) {
+            spi_tx_bytes(frags[k].src, frags[k].len);
+        }
+        spi_tx_end();
+    }
+
+    FRAM_CS_HIGH();
+}
+
+/* Scatter-gather read: consecutive FRAM bytes from addr are split over
+ * the fragment list. Each fragment is polled or, by its size, DMA bursts
+ * of up to FRAM_REVOKE_PIECE bytes; what a revocation leaves unread
+ * reads as zeros.
+ */
+void fram_readv(uint32_t addr, const fram_rfrag_t *frags, uint8_t count)
+{
+    uint8_t k;
+    uint16_t i;
+    uint16_t n;
+
+    fram_wait();
+    if (fram_revoked != 0u) {
+        for (k = 0u; k < count; k++) {
+            memset(frags[k].dst, 0, frags[k].len);
+        }
+        return;
+    }
+
+    FRAM_CS_LOW();
+    fram_send_cmd(FRAM_CMD_READ, addr);
+
+    for (k = 0u; k < count; k++) {
+        uint8_t *dst = frags[k].dst;
+        uint16_t len = frags[k].len;
+
+        if (len < FRAM_DMA_THRESHOLD && fram_revoked == 0u) {
+            spi_tx_end();
+            for (i = 0u; i < len; i++) {
+                dst[i] = spi_transfer(0xFF);
+            }
+            continue;
+        }
+        for (i = 0u; i < len && fram_revoked == 0u; i = (uint16_t)(i + n)) {
+            n = (uint16_t)(len - i);
+            if (n > FRAM_REVOKE_PIECE) {
+                n = FRAM_REVOKE_PIECE;
+            }
+            fram_stream_read_start(&dst[i], n, 0u);
+            fram_stream_wait();
+        }
+        if (i < len) {
+            memset(&dst[i], 0, len - i);
         }
     }
 
+    spi_tx_end();
     FRAM_CS_HIGH();
 }
 
+/* -------------- Asynchronous transfers -------------- */
 
-void fram_write_bytes(uint32_t addr, const uint8_t *src, uint32_t len)
+/* Both calls start the command + address and payload stream and return.
+ * DMA0 (RX side) completing means every byte has been clocked; DMA_ISR
+ * then raises CS and runs cb(ctx) in interrupt context.
+ * Short transfers, and any after fram_revoke(), are done synchronously
+ * and cb runs before returning. The stream is not cut into pieces, so a
+ * revocation does not stop it.
+ */
+void fram_write_async(uint32_t addr, const uint8_t *src, uint16_t len,
+                      fram_done_cb_t cb, void *ctx)
 {
-    uint32_t i;
+    fram_wfrag_t frag;
 
-    if (len == 0u) {
+    if (len < FRAM_DMA_THRESHOLD || fram_revoked != 0u) {
+        fram_write_bytes(addr, src, len);
+        if (cb != 0) {
+            cb(ctx);
+        }
         return;
     }
 
+    fram_wait();
     fram_write_enable();
 
     FRAM_CS_LOW();
-    spi_transfer(FRAM_CMD_WRITE);
-    fram_send_addr(addr);
+    fram_build_hdr(FRAM_CMD_WRITE, addr);
 
-    /* Use DMA for larger payloads, polled for very small writes. */
-    if (len >= FRAM_DMA_THRESHOLD) {
-        fram_stream_write_dma(src, len);
-    } else {
-        for (i = len; i > 0u; i--) {
-            (void)spi_transfer(*src);
-            src++;
+    frag.src = src;
+    frag.len = len;
+
+    fram_async_cb   = cb;
+    fram_async_ctx  = ctx;
+    fram_async_busy = 1u;
+    (void)fram_stream_writev_start(&frag, 1u, len, len, DMAIE);
+}
+
+void fram_read_async(uint32_t addr, uint8_t *dst, uint16_t len,
+                     fram_done_cb_t cb, void *ctx)
+{
+    if (len < FRAM_DMA_THRESHOLD || fram_revoked != 0u) {
+        fram_read_bytes(addr, dst, len);
+        if (cb != 0) {
+            cb(ctx);
         }
+        return;
     }
 
-    FRAM_CS_HIGH();
+    fram_wait();
+
+    FRAM_CS_LOW();
+    fram_send_cmd(FRAM_CMD_READ, addr);
+
+    fram_async_cb   = cb;
+    fram_async_ctx  = ctx;
+    fram_async_busy = 1u;
+    fram_stream_read_start(dst, len, DMAIE);
 }
 
-void fram_read_id(uint8_t *id, uint8_t len)
+void fram_revoke(void)
 {
-    uint8_t i;
+    fram_revoked = 1u;
+}
 
-    if (len == 0u) {
-        return;
+uint8_t fram_busy(void)
+{
+    return fram_async_busy;
+}
+
+/* Sleep in LPM0 until the in-flight transfer (if any) has completed */
+void fram_wait(void)
+{
+    while (fram_async_busy != 0u) {
+        __disable_interrupt();
+        if (fram_async_busy != 0u) {
+            __bis_SR_register(LPM0_bits | GIE);
+        }
+        __enable_interrupt();
     }
+}
 
-    FRAM_CS_LOW();
-    spi_transfer(FRAM_CMD_RDID);
-    for (i = len; i > 0u; i--) {
-        *id = spi_transfer(0xFF);
-        id++;
+#pragma vector = DMA_VECTOR
+__interrupt void DMA_ISR(void)
+{
+    fram_done_cb_t cb;
+
+    switch (__even_in_range(DMAIV, DMAIV_DMA2IFG)) {
+    case DMAIV_DMA0IFG:
+        DMA0CTL &= (uint16_t)~(DMAEN | DMAIE);
+        DMA1CTL &= (uint16_t)~DMAEN;
+        FRAM_CS_HIGH();
+
+        /* Clear busy first so the callback may chain the next transfer */
+        cb = fram_async_cb;
+        fram_async_busy = 0u;
+        if (cb != 0) {
+            cb(fram_async_ctx);
+        }
+
+        __bic_SR_register_on_exit(LPM0_bits);
+        break;
+    default:
+        break;
     }
-    FRAM_CS_HIGH();
 }
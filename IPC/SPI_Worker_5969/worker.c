@@ -0,0 +1,649 @@
+// ========================= Worker Node =========================
+//                   MSP430FR5969 (Worker Node k)
+//                 ---------------------------
+//            /|\ |                       XIN|-
+//             |  |                           | 32 kHz Crystal (optional)
+//             ---|RST                    XOUT|-
+//                |                           |
+//                |                       P1.6|-> FRAM SI   (UCB0SIMO, MOSI, shared bus)
+//                |                       P1.7|<- FRAM SO   (UCB0SOMI, MISO, shared bus)
+//                |                       P2.2|-> FRAM SCK  (UCB0CLK, shared bus)
+//                |                       P1.5|-> FRAM CS#  (chip select, active low, shared)
+//                |                           |
+//                |                       P1.4|-> REQk      (Node k -> Arbiter, request / release)
+//                |                       P1.3|<-> GNTk     (Arbiter <-> Node k, grant / mail / reset; TA1.2)
+//                |                           |
+//                |                       P1.0|-> LED (lock held indication, green)
+//                |                       P4.6|-> LED (no lock / idle indication, red)
+//                |                           |
+//               GND|---------------------------
+
+
+#include <msp430.h>
+#include <stdint.h>
+#include "worker.h"
+#include "gnt_pulse.h"
+#include "fram.h"
+#include "mailbox.h"
+
+/* After handing back a pulse whose width was lost, wait this long before
+ * asking again, so the arbiter's port ISR sees the GNT pulse first
+ */
+#define NODE_REREQ_GAP          400u
+
+/* Before driving GNT ourselves, wait for the arbiter's pulse on it (if
+ * any) to end and this long more: the arbiter drops the edge of its own
+ * pulse after the falling edge, and ours must come after that
+ */
+#define NODE_GNT_GAP            20u
+
+/* A request goes out at least this long (Timer_A1, us) after a release
+ * on REQ: the arbiter's nudge of a holder keeps its interrupts off for a
+ * mail pulse, and the two REQ edges within it would read as one, the
+ * release. The gap is waited out idle with interrupts on, so a pulse
+ * meanwhile (the mail that release may bring) is decoded, not lost.
+ */
+#define NODE_REQ_GAP_US         30u
+
+static volatile lock_state_t g_lock_state = LOCK_IDLE;
+static volatile uint8_t      g_mail_flag  = 0u;
+static volatile uint8_t      g_notif_seq  = 0u;  /* bumped per mail/space pulse */
+static volatile uint8_t      g_lease_extend = 0u; /* lease checks to answer */
+static volatile uint16_t     g_gnt_rise   = 0u;  /* TA1CCR2 at the last GNT rising edge */
+static uint8_t               g_req_released = 0u; /* released on REQ at g_req_release_at */
+static uint16_t              g_req_release_at;
+
+/* Lock session: grant kept between operations, see lock_session_begin() */
+static volatile uint8_t g_session_on     = 0u;
+static volatile uint8_t g_session_idle   = 0u;   /* held, idle timer armed */
+static volatile uint8_t g_session_waiter = 0u;   /* arbiter wants the bus */
+static volatile uint16_t g_session_yields = 0u;  /* released for a waiter */
+static uint16_t         g_session_idle_us;
+static uint8_t          g_session_max_ops;
+static uint8_t          g_session_ops;
+
+/* Non-blocking acquisition, see lock_try_acquire() / lock_acquire_async() */
+static volatile lock_callback_t g_async_cb    = 0;
+static volatile uint8_t         g_async_ready = 0u;   /* granted, cb not run */
+static volatile uint8_t         g_lock_abandon = 0u;  /* give the grant back */
+static volatile uint8_t         g_lock_timeout = 0u;
+
+static uint8_t spi_clk_div = 2u;
+
+
+void clock_init_8mhz(void)
+{
+    CSCTL0_H = CSKEY >> 8;
+    CSCTL1   = DCOFSEL_6;
+    CSCTL2   = SELS__DCOCLK | SELM__DCOCLK;
+    CSCTL3   = DIVS__1 | DIVM__1;
+    CSCTL0_H = 0;
+}
+/* Timer_A1 at SMCLK/8 = 1 MHz, free running: session idle time (CCR0),
+ * try-acquire timeout (CCR1) and GNT pulse widths (CCR2)
+ */
+static void timer1_start(void)
+{
+    if ((TA1CTL & MC__CONTINUOUS) == 0u) {
+        TA1CTL = TASSEL__SMCLK | ID__8 | MC__CONTINUOUS | TACLR;
+    }
+}
+
+/* ---- GPIO ---- */
+
+void node_gpio_init(void)
+{
+    /* REQ: P1.4 in, pulldown */
+    P1SEL0 &= (uint8_t)~NODE_REQ_PIN;
+    P1SEL1 &= (uint8_t)~NODE_REQ_PIN;
+
+    P1DIR  &= (uint8_t)~NODE_REQ_PIN;
+    P1REN  |= NODE_REQ_PIN;
+    P1OUT  &= (uint8_t)~NODE_REQ_PIN;
+
+    /* GNT: P1.3 in, pulldown, as TA1.2 (CCI2A) */
+    P1SEL0 |= NODE_GNT_PIN;
+    P1SEL1 &= (uint8_t)~NODE_GNT_PIN;
+
+    P1DIR  &= (uint8_t)~NODE_GNT_PIN;
+    P1REN  |= NODE_GNT_PIN;
+    P1OUT  &= (uint8_t)~NODE_GNT_PIN;
+
+    /* CCR2 captures both GNT edges */
+    timer1_start();
+    TA1CCTL2 = CM_3 | CCIS_0 | SCS | CAP | CCIE;
+
+    /* LEDs */
+    P1DIR |= BIT0;
+    P4DIR |= BIT6;
+
+}
+
+/* High pulse on REQ */
+void node_pulse_req_line(void)
+{
+    P1DIR |= NODE_REQ_PIN;
+    P1OUT |= NODE_REQ_PIN;
+    __delay_cycles(50u);
+    P1OUT &= (uint8_t)~NODE_REQ_PIN;
+    P1DIR &= (uint8_t)~NODE_REQ_PIN;
+}
+
+/* High pulse on GNT, driven by this node: the pin leaves its timer
+ * function meanwhile, so the capture does not see our own pulse (nor an
+ * arbiter pulse it waits out first, which it drops)
+ */
+#define NODE_GNT_PULSE(cycles) \
+    do { \
+        TA1CCTL2 &= (uint16_t)~CCIE; \
+        P1SEL0   &= (uint8_t)~NODE_GNT_PIN; \
+        if ((P1IN & NODE_GNT_PIN) != 0u) { \
+            while ((P1IN & NODE_GNT_PIN) != 0u) { } \
+            __delay_cycles(NODE_GNT_GAP); \
+        } \
+        P1DIR    |= NODE_GNT_PIN; \
+        P1OUT    |= NODE_GNT_PIN; \
+        __delay_cycles(cycles); \
+        P1OUT    &= (uint8_t)~NODE_GNT_PIN; \
+        P1DIR    &= (uint8_t)~NODE_GNT_PIN; \
+        P1SEL0   |= NODE_GNT_PIN; \
+        TA1CCTL2 &= (uint16_t)~(CCIFG | COV); \
+        TA1CCTL2 |= CCIE; \
+    } while (0)
+
+static void node_pulse_gnt_line(void)
+{
+    NODE_GNT_PULSE(GNT_PULSE_RELEASE_CYCLES);
+}
+
+/* Answer to a lease check: long enough not to read as a release */
+static void node_pulse_renew(void)
+{
+    NODE_GNT_PULSE(GNT_PULSE_RENEW_CYCLES);
+}
+
+/* High pulse on GNT for reset notification at startup */
+void node_pulse_reset_on_gnt(void)
+{
+    node_pulse_gnt_line();
+
+    g_lock_state = LOCK_IDLE;
+}
+
+/* Ask for the bus from LOCK_IDLE: REQ pulse, NODE_REQ_GAP_US after a
+ * REQ release. A handoff during the gap grants it without one. Called
+ * and returns with interrupts disabled.
+ */
+static void node_request(void)
+{
+    if (g_req_released != 0u) {
+        g_req_released = 0u;
+        __enable_interrupt();
+        while ((uint16_t)(TA1R - g_req_release_at) < NODE_REQ_GAP_US) { }
+        __disable_interrupt();
+    }
+    if (g_lock_state == LOCK_HANDED) {
+        g_lock_state = LOCK_HELD;
+    } else if (g_lock_state == LOCK_IDLE) {
+        g_lock_state = LOCK_WAIT_GRANT;
+        node_pulse_req_line();
+    }
+}
+
+void node_wait_mail(void)
+{
+    __disable_interrupt();
+    while (g_mail_flag == 0u) {
+        __bis_SR_register(LPM0_bits | GIE);
+        __disable_interrupt();
+    }
+    g_mail_flag = 0u;
+    __enable_interrupt();
+}
+
+/* ---- Lock API ---- */
+
+void lock_set_spi_div(uint8_t div)
+{
+    spi_clk_div = div;
+}
+
+/* Give the bus back. Interrupts disabled, or from an ISR. Released on
+ * REQ if no notification flag was raised under this hold; after a send
+ * it is a GNT pulse, on which the arbiter reads the flags.
+ */
+static void lock_drop(void)
+{
+    TA1CCTL0 &= (uint16_t)~CCIE;
+    g_session_idle   = 0u;
+    g_session_waiter = 0u;
+    g_session_ops    = 0u;
+    g_async_cb       = 0;
+    g_async_ready    = 0u;
+
+    spi_disable();
+    if (g_lock_state == LOCK_REVOKED) {
+        /* The arbiter already took the bus back: no release pulse */
+        (void)mailbox_take_notified();
+        g_lock_state = LOCK_IDLE;
+        return;
+    }
+    g_lock_state = LOCK_IDLE;
+    if (mailbox_take_notified() != 0u) {
+        node_pulse_gnt_line();    /* release, flags to read */
+    } else {
+        node_pulse_req_line();    /* release FRAM bus */
+        g_req_release_at = TA1R;
+        g_req_released   = 1u;
+    }
+}
+
+/* Post REQ unless one is out and sleep until the grant, at most
+ * timeout_us (0 = no limit). A pending async request is taken over.
+ * Called with interrupts disabled, returns with them enabled.
+ */
+static uint8_t lock_wait(uint16_t timeout_us)
+{
+    g_lock_abandon = 0u;
+    g_lock_timeout = 0u;
+
+    if (g_lock_state == LOCK_REVOKED) {
+        lock_drop();    /* not released yet: ask again */
+    }
+
+    if (g_lock_state == LOCK_HELD && g_async_ready == 0u) {
+        /* Kept by the session: the idle timer must not fire mid-operation */
+        TA1CCTL0 &= (uint16_t)~CCIE;
+        g_session_idle = 0u;
+        g_async_cb = 0;
+        __enable_interrupt();
+        return 1u;
+    }
+    g_async_cb    = 0;
+    g_async_ready = 0u;
+
+    if (g_lock_state == LOCK_HANDED) {
+        /* Handed over already: no REQ, the arbiter counts us as holder */
+        g_lock_state = LOCK_HELD;
+    } else if (g_lock_state == LOCK_IDLE) {
+        // uart0_println("Acquiring lock");
+        node_request();           /* request FRAM bus */
+    }
+
+    if (timeout_us != 0u) {
+        timer1_start();
+        TA1CCR1  = (uint16_t)(TA1R + timeout_us);
+        TA1CCTL1 = CCIE;
+    }
+
+    while (g_lock_state != LOCK_HELD && g_lock_timeout == 0u) {
+        __bis_SR_register(LPM0_bits | GIE);
+        __disable_interrupt();
+    }
+    TA1CCTL1 &= (uint16_t)~CCIE;
+
+    if (g_lock_state != LOCK_HELD) {
+        /* Still queued, and the arbiter has no cancel: release the
+         * grant from the GNT interrupt when it comes
+         */
+        g_lock_abandon = 1u;
+        __enable_interrupt();
+        return 0u;
+    }
+    __enable_interrupt();
+
+    spi_enable(spi_clk_div);
+    // uart0_println("Lock acquired");
+    return 1u;
+}
+
+void lock_acquire(void)
+{
+    __disable_interrupt();
+    (void)lock_wait(0u);
+}
+
+uint8_t lock_try_acquire(uint16_t timeout_us)
+{
+    __disable_interrupt();
+    return lock_wait(timeout_us);
+}
+
+void lock_acquire_async(lock_callback_t cb)
+{
+    __disable_interrupt();
+    g_lock_abandon = 0u;
+    if (g_lock_state == LOCK_REVOKED) {
+        lock_drop();
+    }
+    if (g_lock_state == LOCK_HANDED) {
+        g_lock_state = LOCK_HELD;
+    }
+    g_async_cb     = cb;
+    if (g_lock_state == LOCK_HELD) {
+        /* Kept by the session or handed to us: run cb on the next
+         * lock_poll()
+         */
+        TA1CCTL0 &= (uint16_t)~CCIE;
+        g_session_idle = 0u;
+        g_async_ready  = 1u;
+    } else if (g_lock_state == LOCK_IDLE) {
+        node_request();           /* request FRAM bus */
+        if (g_lock_state == LOCK_HELD) {
+            g_async_ready = 1u;   /* handed over meanwhile */
+        }
+    }
+    __enable_interrupt();
+}
+
+uint8_t lock_poll(void)
+{
+    lock_callback_t cb;
+
+    __disable_interrupt();
+    if (g_async_ready == 0u) {
+        __enable_interrupt();
+        return 0u;
+    }
+    cb = g_async_cb;
+    g_async_cb    = 0;
+    g_async_ready = 0u;
+    __enable_interrupt();
+
+    spi_enable(spi_clk_div);
+    cb();
+    return 1u;
+}
+
+void lock_release(void)
+{
+    /* The session timer may have released it already */
+    __disable_interrupt();
+    if (g_lock_state == LOCK_HELD || g_lock_state == LOCK_REVOKED ||
+        g_lock_state == LOCK_HANDED) {
+        // uart0_println("Releasing lock");
+        lock_drop();
+    } else if (g_lock_state == LOCK_WAIT_GRANT) {
+        /* Cancel a pending async request */
+        g_async_cb     = 0;
+        g_lock_abandon = 1u;
+    }
+    __enable_interrupt();
+}
+
+void lock_release_to(uint8_t node_id)
+{
+    if (g_lock_state != LOCK_HELD || node_id == 0u) {
+        lock_release();
+        return;
+    }
+
+    fram_write_bytes(FRAM_HANDOFF_ADDR, &node_id, 1u);
+
+    /* Idle first: the peer may hand the bus straight back */
+    __disable_interrupt();
+    if (g_lock_state == LOCK_REVOKED) {
+        lock_drop();    /* the byte was dropped with the bus */
+    } else {
+        (void)mailbox_take_notified();   /* read with the handoff byte */
+        TA1CCTL0 &= (uint16_t)~CCIE;
+        g_session_idle = 0u;
+        spi_disable();
+        g_lock_state = LOCK_IDLE;
+        node_pulse_gnt_line();    /* release, next holder in FRAM */
+    }
+    __enable_interrupt();
+}
+
+void lock_extend_lease(void)
+{
+    __disable_interrupt();
+    if (g_lock_state == LOCK_HELD && g_lease_extend != 0xFFu) {
+        g_lease_extend++;
+    }
+    __enable_interrupt();
+}
+
+uint8_t lock_revoked(void)
+{
+    return (uint8_t)(g_lock_state == LOCK_REVOKED);
+}
+
+uint8_t lock_wait_space(uint8_t dest, uint8_t id, uint16_t len)
+{
+    uint8_t seq = g_notif_seq;
+
+    if (!mailbox_want_space(dest, id, len)) {
+        return 0u;  /* fits now, or never will */
+    }
+
+    lock_release();
+
+    __disable_interrupt();
+    while (g_notif_seq == seq) {
+        __bis_SR_register(LPM0_bits | GIE);
+        __disable_interrupt();
+    }
+    __enable_interrupt();
+
+    lock_acquire();
+    return 1u;
+}
+
+/* ---- Lock sessions ---- */
+
+void lock_session_begin(uint16_t idle_us, uint8_t max_ops)
+{
+    __disable_interrupt();
+    g_session_idle_us = idle_us;
+    g_session_max_ops = max_ops;
+    g_session_on      = 1u;
+    timer1_start();
+    __enable_interrupt();
+}
+
+void lock_session_done(void)
+{
+    __disable_interrupt();
+    if (g_lock_state == LOCK_HELD) {
+        g_session_ops++;
+        if (g_session_waiter != 0u) {
+            g_session_yields++;
+        }
+        if (g_session_on == 0u || g_session_waiter != 0u ||
+            g_session_idle_us == 0u ||
+            (g_session_max_ops != 0u && g_session_ops >= g_session_max_ops)) {
+            lock_drop();
+        } else {
+            TA1CCR0  = (uint16_t)(TA1R + g_session_idle_us);
+            TA1CCTL0 = CCIE;
+            g_session_idle = 1u;
+        }
+    } else if (g_lock_state == LOCK_REVOKED) {
+        lock_drop();
+    }
+    __enable_interrupt();
+}
+
+uint16_t lock_session_yields(void)
+{
+    return g_session_yields;
+}
+
+void lock_session_end(void)
+{
+    __disable_interrupt();
+    g_session_on = 0u;
+    if (g_lock_state == LOCK_HELD || g_lock_state == LOCK_REVOKED) {
+        lock_drop();
+    }
+    __enable_interrupt();
+}
+
+/* ---- ISR ---- */
+
+/* The grant a lock_wait() or lock_acquire_async() asked for */
+static void node_granted(void)
+{
+    g_lock_state   = LOCK_HELD;
+    g_lease_extend = 0u;
+    if (g_lock_abandon != 0u) {
+        /* Nobody waits for it any more (try-acquire timed out) */
+        g_lock_abandon = 0u;
+        lock_drop();
+    } else if (g_async_cb != 0) {
+        g_async_ready = 1u;    /* lock_poll() runs the callback */
+    }
+}
+
+/* The arbiter's nudge to the holder (another node queued): a session
+ * keeping the bus hands it back, now if idle
+ */
+static void node_nudge(void)
+{
+    if (g_session_on != 0u) {
+        g_session_waiter = 1u;
+        if (g_session_idle != 0u) {
+            g_session_yields++;
+            lock_drop();
+        }
+    }
+}
+
+/* The lease ran out: an idle session releases, which ends the lease as
+ * well. It does so on REQ, flags raised or not: the arbiter reads the
+ * flags of a release that answers its check. Otherwise a requested
+ * extension is answered with the long renewal pulse (from the falling
+ * edge), or the bus is gone.
+ */
+static void node_lease_check(void)
+{
+    if (g_session_idle != 0u) {
+        (void)mailbox_take_notified();
+        lock_drop();
+    } else if (g_lease_extend != 0u) {
+        g_lease_extend--;
+        __delay_cycles(50u);
+        node_pulse_renew();
+    } else {
+        TA1CCTL0 &= (uint16_t)~CCIE;
+        g_session_waiter = 0u;
+        g_lock_state = LOCK_REVOKED;
+        fram_revoke();
+    }
+}
+
+/* One decoded GNT pulse from the arbiter */
+static void node_gnt_pulse(gnt_pulse_t kind)
+{
+    uint8_t holding = (uint8_t)(g_lock_state == LOCK_HELD ||
+                                g_lock_state == LOCK_HANDED);
+
+    switch (kind) {
+    case GNT_PULSE_GRANT:
+        if (g_lock_state == LOCK_WAIT_GRANT) {
+            node_granted();
+            return;
+        }
+        if (holding) {
+            node_lease_check();
+            return;
+        }
+        break;  /* not waiting: an uncoded mail pulse */
+    case GNT_PULSE_MAIL:
+        if (holding) {
+            node_nudge();
+            return;
+        }
+        break;
+    case GNT_PULSE_LOST:
+        if (holding) {
+            node_lease_check();
+            return;
+        }
+        /* A grant, mail or a handoff: never taken as a grant. A GNT pulse
+         * gives back whatever it may have granted (to the arbiter it is
+         * the holder's release, or a waiting node leaving the queue), and
+         * a waiting node asks again.
+         */
+        node_pulse_gnt_line();
+        if (g_lock_state == LOCK_WAIT_GRANT) {
+            __delay_cycles(NODE_REREQ_GAP);
+            node_pulse_req_line();
+        }
+        break;
+    case GNT_PULSE_HANDOFF:
+        /* Another node's lock_release_to(): the bus and its message. The
+         * arbiter takes a REQ of ours seen during the pulse as asking for
+         * this grant, not as the release.
+         */
+        if (g_lock_state == LOCK_WAIT_GRANT) {
+            node_granted();
+        } else if (g_lock_state == LOCK_IDLE) {
+            g_lock_state   = LOCK_HANDED;
+            g_lease_extend = 0u;
+        }
+        break;
+    default:
+        break;
+    }
+
+    /* Mail or space available; never a grant, whatever our state */
+    g_mail_flag = 1u;
+    g_notif_seq++;
+}
+
+/* Session idle time is up: release */
+#pragma vector = TIMER1_A0_VECTOR
+__interrupt void TIMER1_A0_ISR(void)
+{
+    if (g_session_idle != 0u && g_lock_state == LOCK_HELD) {
+        lock_drop();
+    } else {
+        TA1CCTL0 &= (uint16_t)~CCIE;
+    }
+}
+
+/* Try-acquire timeout (CCR1), or a GNT edge captured (CCR2): note the
+ * rising one, decode the pulse at the falling one. A pulse whose edges
+ * were both captured before we got here (COV) has lost its width.
+ */
+#pragma vector = TIMER1_A1_VECTOR
+__interrupt void TIMER1_A1_ISR(void)
+{
+    uint16_t t;
+    uint16_t cctl;
+    gnt_pulse_t kind;
+
+    switch (TA1IV) {
+    case TA1IV_TACCR1:
+        TA1CCTL1 &= (uint16_t)~CCIE;
+        g_lock_timeout = 1u;
+        __bic_SR_register_on_exit(LPM0_bits);
+        return;
+    case TA1IV_TACCR2:
+        break;
+    default:
+        return;
+    }
+
+    t    = TA1CCR2;
+    cctl = TA1CCTL2;
+
+    if ((cctl & CCI) != 0u) {
+        g_gnt_rise = t;
+        if ((cctl & COV) == 0u) {
+            return;
+        }
+        TA1CCTL2 &= (uint16_t)~COV;     /* a whole pulse went by */
+        kind = GNT_PULSE_LOST;
+    } else if ((cctl & COV) != 0u) {
+        TA1CCTL2 &= (uint16_t)~COV;
+        kind = GNT_PULSE_LOST;
+    } else {
+        kind = gnt_pulse_decode((uint16_t)(t - g_gnt_rise));
+    }
+
+    node_gnt_pulse(kind);
+    __bic_SR_register_on_exit(LPM0_bits);
+}